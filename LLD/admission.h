@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include "stripedHashMap.h"
+
+/*
+ Admission: the check a service runs before doing any work for a caller, so
+ that overload is turned away at a fixed cost instead of piling onto the locks
+ every accepted call needs.
+
+ Two stages, each off unless its policy field is set:
+  - a token bucket per key (a gate, a tenant): ratePerSecond tokens a second,
+    up to `burst` banked. It is kept as GCRA, one "theoretical arrival time"
+    per key in a StripedHashMap, so a check is one probe under one segment lock
+    and a key costs one int64. Keys are never dropped: use a bounded set.
+  - an in-flight limit with a bounded FIFO queue: at most maxInFlight callers
+    hold a ticket at once, the next maxQueued wait in arrival order for at most
+    maxWait each, and anyone past that is shed at once. However deep the
+    overload, a caller waits at most maxWait.
+
+ admit() hands back a Ticket; an admitted one holds its in-flight slot until
+ it is destroyed, so keep it for the whole call.
+*/
+
+struct AdmissionPolicy {
+  double ratePerSecond = 0;   // per key; 0: no rate limit
+  double burst = 1;           // back-to-back calls one key may make
+  size_t maxInFlight = 0;     // 0: no concurrency limit
+  size_t maxQueued = 0;       // callers that may wait for an in-flight slot
+  std::chrono::milliseconds maxWait{0};
+};
+
+class Admission {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Throttled: the key is over its rate. Shed: the queue was full or the
+  // wait ran past maxWait.
+  enum class Verdict : uint8_t { Admitted, Throttled, Shed };
+
+  class Ticket {
+  public:
+    Ticket(Ticket&& o) noexcept : owner_(std::exchange(o.owner_, nullptr)), verdict_(o.verdict_) {}
+    Ticket& operator=(Ticket&&) = delete;
+    ~Ticket() {
+      if (owner_) owner_->leave();
+    }
+
+    explicit operator bool() const { return verdict_ == Verdict::Admitted; }
+    Verdict verdict() const { return verdict_; }
+
+  private:
+    friend class Admission;
+    Ticket(Admission* owner, Verdict v) : owner_(owner), verdict_(v) {}
+    Admission* owner_;   // set while holding an in-flight slot
+    Verdict verdict_;
+  };
+
+  explicit Admission(AdmissionPolicy p = {})
+    : policy_(p),
+      interval_(p.ratePerSecond > 0 ? int64_t(1e9 / p.ratePerSecond) : 0),
+      tolerance_(int64_t(std::max(0.0, p.burst - 1) * double(interval_))),
+      buckets_(64, 16) {}
+
+  bool enabled() const { return interval_ || policy_.maxInFlight; }
+
+  Ticket admit(std::string_view key, Clock::time_point now = Clock::now()) {
+    if (interval_ && !take(key, now)) return Ticket(nullptr, Verdict::Throttled);
+    if (!policy_.maxInFlight) return Ticket(nullptr, Verdict::Admitted);
+    return enter(now + policy_.maxWait);
+  }
+
+private:
+  // GCRA: a call at t is within the rate iff the key's arrival time, pushed
+  // one interval per admitted call, is at most `tolerance` ahead of t
+  bool take(std::string_view key, Clock::time_point now) {
+    int64_t t = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    return buckets_.with(key, [&](auto& ref) {
+      int64_t* tat = ref.get();
+      int64_t from = tat ? std::max(*tat, t) : t;
+      if (from - t > tolerance_) return false;
+      ref.put(from + interval_);
+      return true;
+    });
+  }
+
+  Ticket enter(Clock::time_point deadline) {
+    std::unique_lock lock(mtx_);
+    if (queue_.empty() && inFlight_ < policy_.maxInFlight) {
+      ++inFlight_;
+      return Ticket(this, Verdict::Admitted);
+    }
+    if (queue_.size() >= policy_.maxQueued) return Ticket(nullptr, Verdict::Shed);
+    uint64_t me = next_++;
+    queue_.push_back(me);
+    bool turn = cv_.wait_until(lock, deadline, [&] {
+      return queue_.front() == me && inFlight_ < policy_.maxInFlight;
+    });
+    if (!turn) {
+      queue_.erase(std::find(queue_.begin(), queue_.end(), me));
+      cv_.notify_all();   // the new head may be able to go
+      return Ticket(nullptr, Verdict::Shed);
+    }
+    queue_.pop_front();
+    ++inFlight_;
+    cv_.notify_all();
+    return Ticket(this, Verdict::Admitted);
+  }
+
+  void leave() {
+    {
+      std::lock_guard lock(mtx_);
+      --inFlight_;
+    }
+    cv_.notify_all();
+  }
+
+  const AdmissionPolicy policy_;
+  const int64_t interval_;    // ns per token; 0: no rate limit
+  const int64_t tolerance_;   // ns a key's arrival time may run ahead
+  StripedHashMap<int64_t> buckets_;   // key -> theoretical arrival time, ns
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  size_t inFlight_ = 0;
+  std::deque<uint64_t> queue_;   // waiters in arrival order
+  uint64_t next_ = 0;
+};
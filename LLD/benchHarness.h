@@ -0,0 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ Bench: tiny multi-threaded latency harness for the LLD drivers (no external deps).
+
+ run() starts `threads` workers behind a start barrier; each performs `ops`
+ iterations of before(t, i) -> timed op(t, i) -> after(t, i), and only op is
+ timed. before/after let a benchmark set up or undo state (park then leave)
+ without polluting the sample. Samples stay per thread until the end, so the
+ hot loop shares nothing. Reports p50/p99/max of the timed sections and
+ ops/sec as total ops over wall time, from the start barrier to the last
+ worker finishing. Summed per-thread timed sections would overstate it:
+ threads descheduled on a shared core do not count that time, so two threads
+ on one vCPU looked twice as fast as one. The wall time includes before/after,
+ so keep them cheap next to op.
+*/
+
+struct BenchResult {
+  std::string name;
+  std::string params;
+  size_t threads;
+  uint64_t ops;
+  double seconds;
+  double p50us, p99us, maxus;
+};
+
+class Bench {
+public:
+  template <class Before, class Op, class After>
+  static BenchResult run(const std::string& name, const std::string& params,
+                         size_t threads, size_t ops,
+                         Before&& before, Op&& op, After&& after) {
+    using clock = std::chrono::steady_clock;
+    std::vector<std::vector<uint64_t>> samples(threads);
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> ts;
+    for (size_t t = 0; t < threads; ++t) {
+      ts.emplace_back([&, t] {
+        auto& s = samples[t];
+        s.reserve(ops);
+        ++ready;
+        while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+        for (size_t i = 0; i < ops; ++i) {
+          before(t, i);
+          auto t0 = clock::now();
+          op(t, i);
+          auto t1 = clock::now();
+          after(t, i);
+          s.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        }
+      });
+    }
+    while (ready.load() < threads) std::this_thread::yield();
+    auto start = clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& th : ts) th.join();
+    auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+
+    std::vector<uint64_t> all;
+    for (auto& s : samples) all.insert(all.end(), s.begin(), s.end());
+    double secs = std::max<int64_t>(wall, 1) / 1e9;
+    return BenchResult{name, params, threads, all.size(), secs,
+                       percentile(all, 0.50), percentile(all, 0.99), percentile(all, 1.0)};
+  }
+
+  template <class Op>
+  static BenchResult run(const std::string& name, const std::string& params,
+                         size_t threads, size_t ops, Op&& op) {
+    auto none = [](size_t, size_t) {};
+    return run(name, params, threads, ops, none, op, none);
+  }
+
+  static void printHeader() {
+    std::printf("%-20s %-28s %7s %10s %12s %10s %10s %10s\n",
+                "benchmark", "params", "threads", "ops", "ops/sec", "p50(us)", "p99(us)", "max(us)");
+  }
+
+  static void print(const BenchResult& r) {
+    std::printf("%-20s %-28s %7zu %10llu %12.0f %10.2f %10.2f %10.2f\n",
+                r.name.c_str(), r.params.c_str(), r.threads,
+                (unsigned long long)r.ops, r.ops / r.seconds, r.p50us, r.p99us, r.maxus);
+  }
+
+private:
+  // microseconds at quantile q of the samples (reorders v)
+  static double percentile(std::vector<uint64_t>& v, double q) {
+    if (v.empty()) return 0;
+    size_t k = std::min(v.size() - 1, size_t(q * (v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k] / 1000.0;
+  }
+};
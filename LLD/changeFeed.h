@@ -0,0 +1,148 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+/*
+ ChangeFeed: a Disruptor-style broadcast ring of small fixed-size binary events.
+
+ A producer claims a sequence number with one fetch_add, fills the slot it maps
+ to and publishes it by stamping the slot with that sequence; no lock, and it
+ never waits for a reader. Readers each keep their own cursor and copy events
+ out seqlock-style (stamp, payload, stamp again), so any number of them can
+ tail the feed without writing to anything a producer touches.
+
+ Memory is fixed at construction: capacity slots of one cache-line-aligned
+ 128-byte record each. A reader that falls more than capacity events behind
+ finds its slots overwritten, skips to the oldest event still held and counts
+ the gap in lost(). The only wait a producer can hit is for the producer that
+ used its slot one full lap earlier to finish stamping it.
+
+ Payloads are trivially copyable structs of at most kPayload bytes; events of
+ one feed come out in claim order.
+*/
+
+class ChangeFeed {
+public:
+  static constexpr size_t kPayload = 112;
+
+  struct Event {
+    uint64_t seq;
+    uint8_t type;
+    alignas(8) unsigned char data[kPayload];
+
+    template <class T>
+    T as() const {
+      static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= kPayload, "payload type");
+      T t;
+      std::memcpy(&t, data, sizeof t);
+      return t;
+    }
+  };
+
+  explicit ChangeFeed(size_t capacity = 4096) {
+    size_t n = 1;
+    while (n < capacity) n *= 2;
+    cap_ = n;
+    slots_ = std::make_unique<Slot[]>(n);
+  }
+
+  // returns the event's sequence number
+  template <class T>
+  uint64_t publish(uint8_t type, const T& payload) {
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= kPayload, "payload type");
+    uint64_t words[kWords] = {};
+    std::memcpy(words, &payload, sizeof payload);
+
+    uint64_t s = head_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[s & (cap_ - 1)];
+    // 2s+1 marks the slot as being written; the previous lap must be stamped first
+    uint64_t prev = s >= cap_ ? 2 * (s - cap_) + 2 : 0;
+    for (uint64_t expected = prev;
+         !slot.stamp.compare_exchange_strong(expected, 2 * s + 1, std::memory_order_relaxed);
+         expected = prev)
+      std::this_thread::yield();
+
+    // release stores (plain movs on x86): a reader that sees any of these words
+    // also sees the odd stamp before them, and rejects its copy
+    slot.type.store(type, std::memory_order_release);
+    for (size_t i = 0; i < kWords; ++i) slot.words[i].store(words[i], std::memory_order_release);
+    slot.stamp.store(2 * s + 2, std::memory_order_release);
+    return s;
+  }
+
+  // one past the last claimed sequence number
+  uint64_t head() const { return head_.load(std::memory_order_acquire); }
+  size_t capacity() const { return cap_; }
+
+  class Reader {
+  public:
+    // hands up to max events, in order, to f(const Event&); returns how many.
+    // Stops at the first event not yet published.
+    template <class F>
+    size_t poll(F&& f, size_t max = SIZE_MAX) {
+      size_t n = 0;
+      Event e;
+      while (n < max) {
+        const Slot& slot = feed_->slots_[pos_ & (feed_->cap_ - 1)];
+        uint64_t want = 2 * pos_ + 2;
+        uint64_t st = slot.stamp.load(std::memory_order_acquire);
+        if (st < want) break;   // not published yet
+        if (st == want) {
+          e.seq = pos_;
+          e.type = slot.type.load(std::memory_order_acquire);
+          uint64_t words[kWords];
+          for (size_t i = 0; i < kWords; ++i) words[i] = slot.words[i].load(std::memory_order_acquire);
+          if (slot.stamp.load(std::memory_order_relaxed) == want) {
+            std::memcpy(e.data, words, kPayload);
+            ++pos_;
+            ++n;
+            f(static_cast<const Event&>(e));
+            continue;
+          }
+        }
+        // lapped: our event was overwritten; resume at the oldest one still held
+        uint64_t head = feed_->head();
+        uint64_t oldest = head > feed_->cap_ ? head - feed_->cap_ : 0;
+        if (oldest <= pos_) oldest = pos_ + 1;
+        lost_ += oldest - pos_;
+        pos_ = oldest;
+      }
+      return n;
+    }
+
+    uint64_t position() const { return pos_; }
+    uint64_t lost() const { return lost_; }
+
+  private:
+    friend class ChangeFeed;
+    Reader(const ChangeFeed* feed, uint64_t from) : feed_(feed), pos_(from) {}
+    const ChangeFeed* feed_;
+    uint64_t pos_;
+    uint64_t lost_ = 0;
+  };
+
+  // from the next event on, or from the oldest event still held
+  Reader subscribe(bool fromOldest = false) const {
+    uint64_t head = this->head();
+    return Reader(this, fromOldest && head > cap_ ? head - cap_ : fromOldest ? 0 : head);
+  }
+
+private:
+  static constexpr size_t kWords = kPayload / 8;
+  static_assert(kPayload % 8 == 0, "payload is copied as whole words");
+
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> stamp{0};   // 2s+1 while sequence s is written, 2s+2 once published
+    std::atomic<uint8_t> type{0};
+    std::atomic<uint64_t> words[kWords] = {};
+  };
+
+  size_t cap_;
+  std::unique_ptr<Slot[]> slots_;
+  alignas(64) std::atomic<uint64_t> head_{0};
+};
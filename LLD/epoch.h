@@ -0,0 +1,241 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ Epoch-based reclamation and RcuCell: a read path with no atomic RMW.
+
+ Readers publish "I am reading at epoch e" into their own cache-line-padded
+ slot (a plain store plus a fence, never a shared counter), read the current
+ version through one acquire load, and clear the slot on exit. Writers build a
+ new version off to the side, swap it in, and retire the old one; it is freed
+ once every active reader slot has moved past the retire epoch. Nothing a
+ reader touches is written by another core, so read throughput scales with cores.
+
+ RcuCell<T> wraps that for a whole value: read(f) runs f on the current
+ immutable version, update(f) copies it, lets f mutate the copy and publishes.
+ Use it for read-mostly state; every update costs a full copy of T.
+
+ LeftRight<T> is for a value that is too big to copy on every small change:
+ it keeps two copies and edits them in place, one at a time, waiting
+ (synchronize) for readers to leave a copy before editing it. Reads are the
+ same as RcuCell's; an update costs two edits and one wait for the readers in
+ flight, with no allocation of its own.
+*/
+
+class EpochDomain {
+public:
+  // the domain of every RcuCell. A domain of its own keeps synchronize() from
+  // waiting on unrelated readers (LeftRight); there are at most kMaxDomains.
+  static EpochDomain& global() {
+    static EpochDomain d;
+    return d;
+  }
+
+  EpochDomain() : id_(nextId().fetch_add(1)) {
+    if (id_ >= kMaxDomains) std::abort();
+  }
+  EpochDomain(const EpochDomain&) = delete;
+  EpochDomain& operator=(const EpochDomain&) = delete;
+
+  // at static destruction no reader is left; free whatever is still pending
+  ~EpochDomain() {
+    for (auto& r : retired_) r.second();
+  }
+
+  // RAII read-side critical section; nests freely on one thread
+  class Guard {
+  public:
+    explicit Guard(EpochDomain& d = EpochDomain::global()) : d_(d) { d_.enter(); }
+    ~Guard() { d_.exit(); }
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+  private:
+    EpochDomain& d_;
+  };
+
+  // writer side: run deleter once no reader can still hold the old version
+  void retire(std::function<void()> deleter) {
+    std::vector<std::function<void()>> ready;
+    {
+      std::lock_guard lock(retireMtx_);
+      retired_.emplace_back(epoch_.load(), std::move(deleter));
+      epoch_.fetch_add(1);
+      uint64_t oldest = oldestActive();
+      auto keep = retired_.begin();
+      for (auto& r : retired_) {
+        if (r.first < oldest) ready.push_back(std::move(r.second));
+        else {
+          if (&*keep != &r) *keep = std::move(r);
+          ++keep;
+        }
+      }
+      retired_.erase(keep, retired_.end());
+    }
+    for (auto& f : ready) f();
+  }
+
+  // writer side: returns once every read-side section that was open when it
+  // was called has ended. The caller's own section, if it is in one, is not
+  // waited for (it is not reading what the caller is about to change).
+  void synchronize() {
+    uint64_t e = epoch_.fetch_add(1) + 1;
+    const Slot* mine = local().slot;
+    for (size_t i = 0, n = claimed_.load(); i < n; ++i)
+      if (&slots_[i] != mine)
+        while (slots_[i].epoch.load() < e) std::this_thread::yield();
+  }
+
+private:
+  static constexpr size_t kMaxThreads = 256;
+  static constexpr size_t kMaxDomains = 4;
+  static constexpr uint64_t kIdle = UINT64_MAX;
+
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> epoch{kIdle};
+    std::atomic<bool> used{false};
+  };
+
+  // per-thread registration: claimed on first read, returned at thread exit
+  struct Local {
+    Slot* slot = nullptr;
+    int depth = 0;
+    ~Local() { if (slot) slot->used.store(false, std::memory_order_release); }
+  };
+
+  Local& local() {
+    thread_local std::array<Local, kMaxDomains> l;   // by domain id
+    return l[id_];
+  }
+
+  static std::atomic<size_t>& nextId() {
+    static std::atomic<size_t> n{0};
+    return n;
+  }
+
+  void enter() {
+    Local& l = local();
+    if (l.depth++ > 0) return;
+    if (!l.slot) l.slot = claimSlot();
+    l.slot->epoch.store(epoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // pairs with the writer's seq_cst swap: either it sees our slot or we see its new version
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  void exit() {
+    Local& l = local();
+    if (--l.depth == 0) l.slot->epoch.store(kIdle, std::memory_order_release);
+  }
+
+  Slot* claimSlot() {
+    for (;;) {
+      for (auto& s : slots_) {
+        bool expected = false;
+        if (!s.used.load(std::memory_order_relaxed) &&
+            s.used.compare_exchange_strong(expected, true)) {
+          // before the slot's first epoch store, so synchronize() scans it
+          size_t hi = size_t(&s - slots_) + 1, cur = claimed_.load();
+          while (cur < hi && !claimed_.compare_exchange_weak(cur, hi)) {}
+          return &s;
+        }
+      }
+      std::this_thread::yield();   // more than kMaxThreads concurrent readers
+    }
+  }
+
+  uint64_t oldestActive() const {
+    uint64_t oldest = kIdle;
+    for (auto& s : slots_) oldest = std::min(oldest, s.epoch.load());
+    return oldest;
+  }
+
+  const size_t id_;
+  Slot slots_[kMaxThreads];
+  std::atomic<size_t> claimed_{0};   // slots ever claimed are all below this
+  std::atomic<uint64_t> epoch_{1};
+  std::mutex retireMtx_;
+  std::vector<std::pair<uint64_t, std::function<void()>>> retired_;
+};
+
+template <class T>
+class RcuCell {
+public:
+  explicit RcuCell(T init = T{}) : cur_(new T(std::move(init))) {}
+  ~RcuCell() { delete cur_.load(); }
+  RcuCell(const RcuCell&) = delete;
+  RcuCell& operator=(const RcuCell&) = delete;
+
+  // f must not let references into the version escape; its result is returned by value
+  template <class F>
+  auto read(F&& f) const {
+    EpochDomain::Guard g;
+    return f(*cur_.load(std::memory_order_acquire));
+  }
+
+  // copy-on-write; writers are serialised, readers never wait
+  template <class F>
+  void update(F&& mutate) {
+    std::lock_guard lock(writeMtx_);
+    T* next = new T(*cur_.load(std::memory_order_relaxed));
+    mutate(*next);
+    const T* old = cur_.exchange(next, std::memory_order_seq_cst);
+    EpochDomain::global().retire([old] { delete old; });
+  }
+
+private:
+  std::atomic<const T*> cur_;
+  std::mutex writeMtx_;
+};
+
+// Writers are serialised by the caller (e.g. a lock over whatever owns the
+// value) and their mutations must be deterministic, so the copies stay equal.
+template <class T>
+class LeftRight {
+public:
+  LeftRight() = default;
+  LeftRight(const LeftRight&) = delete;
+  LeftRight& operator=(const LeftRight&) = delete;
+
+  // as RcuCell::read: f must not let references into the copy escape. f must
+  // not block on anything a writer may hold while it update()s: the writer
+  // waits for f to return.
+  template <class F>
+  auto read(F&& f) const {
+    EpochDomain::Guard g(domain());
+    return f(copies_[front_.load(std::memory_order_acquire)]);
+  }
+
+  // the current value, for the writer: no other thread changes it meanwhile
+  const T& writerView() const { return copies_[front_.load(std::memory_order_relaxed)]; }
+
+  // mutate runs on the back copy, which then becomes the front, and, once no
+  // reader is left on the old front, on that one too
+  template <class F>
+  void update(F&& mutate) {
+    unsigned back = front_.load(std::memory_order_relaxed) ^ 1;
+    mutate(copies_[back]);
+    front_.store(back, std::memory_order_seq_cst);   // pairs with the fence in enter()
+    domain().synchronize();
+    mutate(copies_[back ^ 1]);
+  }
+
+private:
+  // one per T, apart from RcuCell's: a writer waits only for readers of a
+  // LeftRight<T>, never for one holding an RcuCell version (that reader may be
+  // about to take a lock the writer holds)
+  static EpochDomain& domain() {
+    static EpochDomain d;
+    return d;
+  }
+
+  T copies_[2];
+  std::atomic<unsigned> front_{0};
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ IdGenerator: UUIDv7-style, time-ordered IDs with per-thread state.
+
+ Layout (RFC 9562): 48-bit unix-ms timestamp | ver 7 | 12-bit sequence |
+ variant 10 | 62 random bits. Each thread keeps its own last-ms, sequence and
+ xorshift state seeded once from random_device, so generation never touches a
+ global lock or /dev/urandom after the first call. IDs from one thread are
+ strictly increasing; the sequence borrows the next millisecond on overflow.
+
+ Output is a fixed-size inline buffer (Uuid), with a bulk mode that amortises
+ the clock read across a whole batch.
+*/
+
+struct Uuid {
+  char text[37];   // canonical 8-4-4-4-12 form, NUL-terminated
+
+  std::string_view view() const { return {text, 36}; }
+  std::string str() const { return std::string(text, 36); }
+};
+
+class IdGenerator {
+public:
+  static Uuid next() {
+    Uuid u;
+    auto& st = state();
+    format(st, st.tick(nowMs()), u);
+    return u;
+  }
+
+  // fill out[0..n) with consecutive IDs, reading the clock once
+  static void nextBatch(Uuid* out, size_t n) {
+    auto& st = state();
+    uint64_t ms = nowMs();
+    for (size_t i = 0; i < n; ++i) format(st, st.tick(ms), out[i]);
+  }
+
+  static std::vector<Uuid> nextBatch(size_t n) {
+    std::vector<Uuid> out(n);
+    nextBatch(out.data(), n);
+    return out;
+  }
+
+private:
+  struct State {
+    uint64_t lastMs = 0;
+    uint32_t seq = 0;
+    uint64_t rng;
+
+    State() {
+      std::random_device rd;
+      rng = (uint64_t(rd()) << 32) | rd();
+      if (!rng) rng = 0x9e3779b97f4a7c15ull;
+    }
+
+    // returns the timestamp to stamp; advances seq, borrowing ms on overflow
+    uint64_t tick(uint64_t ms) {
+      if (ms > lastMs) {
+        lastMs = ms;
+        seq = 0;
+      } else if (++seq > 0xfff) {
+        ++lastMs;
+        seq = 0;
+      }
+      return lastMs;
+    }
+
+    uint64_t random() {
+      rng ^= rng << 13;
+      rng ^= rng >> 7;
+      rng ^= rng << 17;
+      return rng;
+    }
+  };
+
+  static State& state() {
+    thread_local State st;
+    return st;
+  }
+
+  static uint64_t nowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+  }
+
+  static void format(State& st, uint64_t ms, Uuid& u) {
+    uint64_t hi = (ms << 16) | 0x7000 | st.seq;
+    uint64_t lo = (st.random() & 0x3fffffffffffffffull) | 0x8000000000000000ull;
+    static const char hex[] = "0123456789abcdef";
+    char* p = u.text;
+    for (int i = 15; i >= 0; --i) {
+      *p++ = hex[(hi >> (i * 4)) & 0xf];
+      if (i == 8 || i == 4) *p++ = '-';
+    }
+    *p++ = '-';
+    for (int i = 15; i >= 0; --i) {
+      *p++ = hex[(lo >> (i * 4)) & 0xf];
+      if (i == 12) *p++ = '-';
+    }
+    *p = '\0';
+  }
+};
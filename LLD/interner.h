@@ -0,0 +1,154 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ Interner: maps external string IDs (UUIDs, plates, emails) to dense 32-bit handles.
+
+ Strings are converted once at the API boundary; repositories and services then
+ index flat vectors by handle instead of walking std::map<string, ...> trees.
+ Lookup is an open-addressing table (linear probing) of handles into names_,
+ so the only string compare is the final equality check on a hash hit.
+ Released handles are recycled, which keeps short-lived IDs (bookings) dense.
+*/
+
+using Handle = uint32_t;
+constexpr Handle kNoHandle = UINT32_MAX;
+
+class Interner {
+public:
+  explicit Interner(size_t expected = 64) { rehash(expected * 2); }
+
+  // handle for key, inserting it if absent
+  Handle intern(std::string_view key) {
+    size_t hash = std::hash<std::string_view>{}(key);
+    {
+      std::shared_lock lock(mtx_);
+      size_t slot = probe(key, hash);
+      if (table_[slot].handle != kNoHandle) return table_[slot].handle;
+    }
+    std::unique_lock lock(mtx_);
+    size_t slot = probe(key, hash);
+    if (table_[slot].handle != kNoHandle) return table_[slot].handle;  // lost the race
+    if ((used_ + 1) * 2 > table_.size()) {
+      rehash(table_.size() * 2);
+      slot = probe(key, hash);
+    }
+    return insertAt(slot, key, hash);
+  }
+
+  // intern() for a whole batch: hashes are computed outside the lock, which is
+  // then taken once, with at most one rehash; returns the handle of each key
+  std::vector<Handle> internAll(const std::vector<std::string_view>& keys) {
+    std::vector<size_t> hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) hashes[i] = std::hash<std::string_view>{}(keys[i]);
+    std::vector<Handle> out(keys.size());
+    std::unique_lock lock(mtx_);
+    if ((used_ + keys.size()) * 2 > table_.size()) rehash((used_ + keys.size()) * 2);
+    names_.reserve(names_.size() + keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      size_t slot = probe(keys[i], hashes[i]);
+      out[i] = table_[slot].handle != kNoHandle ? table_[slot].handle
+                                                : insertAt(slot, keys[i], hashes[i]);
+    }
+    return out;
+  }
+
+  std::optional<Handle> find(std::string_view key) const {
+    std::shared_lock lock(mtx_);
+    size_t slot = probe(key, std::hash<std::string_view>{}(key));
+    if (table_[slot].handle == kNoHandle) return std::nullopt;
+    return table_[slot].handle;
+  }
+
+  std::string name(Handle h) const {
+    std::shared_lock lock(mtx_);
+    return names_[h];
+  }
+
+  // forget the key; its handle may be handed out again by a later intern()
+  void release(Handle h) {
+    std::unique_lock lock(mtx_);
+    size_t slot = probe(names_[h], std::hash<std::string_view>{}(names_[h]));
+    if (table_[slot].handle != h) return;
+    table_[slot] = Slot{kNoHandle, 0, true};
+    names_[h].clear();
+    free_.push_back(h);
+  }
+
+  // one past the largest handle ever issued (size for handle-indexed vectors)
+  size_t size() const {
+    std::shared_lock lock(mtx_);
+    return names_.size();
+  }
+
+  // keys currently interned (released handles excluded)
+  size_t live() const {
+    std::shared_lock lock(mtx_);
+    return names_.size() - free_.size();
+  }
+
+private:
+  // caller holds the unique lock and has checked the load factor
+  Handle insertAt(size_t slot, std::string_view key, size_t hash) {
+    Handle h;
+    if (!free_.empty()) {
+      h = free_.back(); free_.pop_back();
+      names_[h].assign(key.data(), key.size());   // reuses the old capacity
+    } else {
+      h = Handle(names_.size());
+      names_.emplace_back(key);
+    }
+    if (!table_[slot].tombstone) ++used_;
+    table_[slot] = Slot{h, hash, false};
+    return h;
+  }
+
+  struct Slot {
+    Handle handle = kNoHandle;
+    size_t hash = 0;
+    bool tombstone = false;
+  };
+
+  // slot holding key, or the first reusable slot on its probe path
+  size_t probe(std::string_view key, size_t hash) const {
+    size_t mask = table_.size() - 1;
+    size_t reuse = SIZE_MAX;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+      const Slot& s = table_[i];
+      if (s.handle == kNoHandle) {
+        if (!s.tombstone) return reuse != SIZE_MAX ? reuse : i;
+        if (reuse == SIZE_MAX) reuse = i;
+      } else if (s.hash == hash && names_[s.handle] == key) {
+        return i;
+      }
+    }
+  }
+
+  void rehash(size_t minSlots) {
+    size_t n = 16;
+    while (n < minSlots) n *= 2;
+    std::vector<Slot> old(n);
+    old.swap(table_);
+    used_ = 0;
+    for (auto& s : old) {
+      if (s.handle == kNoHandle) continue;
+      size_t i = s.hash & (n - 1);
+      while (table_[i].handle != kNoHandle) i = (i + 1) & (n - 1);
+      table_[i] = s;
+      ++used_;
+    }
+  }
+
+  std::vector<Slot> table_;
+  std::vector<std::string> names_;
+  std::vector<Handle> free_;
+  size_t used_ = 0;   // live + tombstoned slots, drives the 50% load-factor rehash
+  mutable std::shared_mutex mtx_;
+};
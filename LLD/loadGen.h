@@ -0,0 +1,234 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+ LoadGen: open-loop replay of an operation trace against a service, to find
+ contention collapses and correctness bugs under production-shaped load.
+ benchHarness.h times one operation in isolation; this drives a whole mix.
+
+ A trace is a list of ops, each due at an offset from the start and carrying a
+ key (a plate, a booking tag). Ops with the same key always run on the same
+ worker, in trace order, so a park and its leave never race each other while
+ ops with different keys race exactly as they would in production. The same
+ trace and thread count give every worker the same sequence on every run.
+
+ The schedule is open loop: an op is due at offset / speed (or at index / rate
+ with a fixed rate) whether or not earlier ops are done, and its latency runs
+ from when it was due, not from when a worker got to it. A worker that falls
+ behind shows up as latency instead of quietly offering less load
+ (coordinated omission). Completions are bucketed per `interval` into a
+ timeline of offered vs completed ops/sec and latency percentiles; an
+ interval that completes under half of what it was offered is flagged as a
+ collapse.
+
+ Invariant checks are the caller's: typically a thread tailing the service's
+ change feed while run() is going (see the `load` modes of the drivers).
+*/
+
+struct LoadOp {
+  uint64_t atNs;   // due this long after the start (trace time)
+  uint64_t key;    // ops with equal keys run on one worker, in trace order
+};
+
+// stable key for a trace string (FNV-1a): a plate or tag lands on the same
+// worker in every run and on every build
+inline uint64_t loadKey(std::string_view s) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (unsigned char c : s) h = (h ^ c) * 0x100000001b3ull;
+  return h;
+}
+
+// the value of a `name=value` argument among argv[2..] (after the mode)
+inline std::optional<std::string> loadArg(int argc, char** argv, std::string_view name) {
+  for (int i = 2; i < argc; ++i) {
+    std::string_view a = argv[i];
+    if (a.size() > name.size() && a.substr(0, name.size()) == name && a[name.size()] == '=')
+      return std::string(a.substr(name.size() + 1));
+  }
+  return std::nullopt;
+}
+
+// loadArg() as a number: def if absent; nullopt (reported on stderr) if the
+// value is not entirely a T, so a driver can exit with a usage error
+template <class T>
+std::optional<T> loadNum(int argc, char** argv, std::string_view name, T def) {
+  auto s = loadArg(argc, argv, name);
+  if (!s) return def;
+  T v{};
+  auto [end, ec] = std::from_chars(s->data(), s->data() + s->size(), v);
+  if (ec == std::errc() && end == s->data() + s->size()) return v;
+  std::fprintf(stderr, "%.*s=%s is not a valid number\n", int(name.size()), name.data(), s->c_str());
+  return std::nullopt;
+}
+
+struct LoadOptions {
+  size_t threads = 4;
+  double speed = 1.0;   // trace time runs this many times faster
+  double rate = 0;      // ops/sec; > 0 ignores the offsets and spaces ops evenly
+  std::chrono::milliseconds interval{100};
+};
+
+// threads=, rate= and speed= of a `load` command line; nullopt (reported on
+// stderr) if one is malformed or out of range
+inline std::optional<LoadOptions> loadOptions(int argc, char** argv) {
+  LoadOptions o;
+  auto threads = loadNum<size_t>(argc, argv, "threads", o.threads);
+  auto rate = loadNum<double>(argc, argv, "rate", o.rate);
+  auto speed = loadNum<double>(argc, argv, "speed", o.speed);
+  if (!threads || !rate || !speed) return std::nullopt;
+  if (!*threads || !(*rate >= 0) || !(*speed > 0)) {
+    std::fprintf(stderr, "threads= must be at least 1, rate= at least 0, speed= above 0\n");
+    return std::nullopt;
+  }
+  o.threads = *threads;
+  o.rate = *rate;
+  o.speed = *speed;
+  return o;
+}
+
+struct LoadInterval {
+  double at;                      // seconds since the start
+  uint64_t offered, done, failed;
+  double p50us, p99us, maxus;     // latency from due time to completion
+};
+
+struct LoadReport {
+  std::vector<LoadInterval> timeline;
+  uint64_t done = 0, failed = 0;
+  double seconds = 0;
+  double p50us = 0, p99us = 0, p999us = 0, maxus = 0;
+  size_t collapses = 0;           // intervals completing < half of their offered load
+};
+
+class LoadGen {
+public:
+  // f(worker, op index) -> false for an op the service refused (counted, not an error)
+  template <class F>
+  static LoadReport run(const std::vector<LoadOp>& ops, const LoadOptions& o, F&& f) {
+    using clock = std::chrono::steady_clock;
+    size_t threads = std::max<size_t>(1, o.threads);
+    std::vector<std::vector<uint32_t>> work(threads);
+    for (size_t i = 0; i < ops.size(); ++i) work[mix(ops[i].key) % threads].push_back(uint32_t(i));
+    auto due = [&](size_t i) {
+      return std::chrono::nanoseconds(o.rate > 0 ? uint64_t(double(i) * 1e9 / o.rate)
+                                                 : uint64_t(double(ops[i].atNs) / o.speed));
+    };
+
+    struct Sample {
+      uint64_t doneNs, latencyNs;
+      bool ok;
+    };
+    std::vector<std::vector<Sample>> samples(threads);
+    std::atomic<size_t> ready{0};
+    clock::time_point start;
+    std::atomic<bool> go{false};
+    std::vector<std::thread> ts;
+    for (size_t t = 0; t < threads; ++t) {
+      ts.emplace_back([&, t] {
+        auto& s = samples[t];
+        s.reserve(work[t].size());
+        ++ready;
+        while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+        for (uint32_t i : work[t]) {
+          auto when = start + due(i);
+          // sleep for long gaps, spin out the last stretch: sleeps overshoot by ~50us
+          if (when - clock::now() > kSpin) std::this_thread::sleep_until(when - kSpin);
+          while (clock::now() < when) std::this_thread::yield();
+          bool ok = f(t, i);
+          auto done = clock::now();
+          s.push_back(Sample{uint64_t((done - start).count()), uint64_t((done - when).count()), ok});
+        }
+      });
+    }
+    while (ready.load() < threads) std::this_thread::yield();
+    start = clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& th : ts) th.join();
+
+    LoadReport r;
+    uint64_t step = uint64_t(std::chrono::nanoseconds(o.interval).count());
+    uint64_t last = 0;
+    for (auto& s : samples)
+      for (auto& x : s) last = std::max(last, x.doneNs);
+    size_t n = size_t(last / step) + 1;
+    r.timeline.resize(n);
+    std::vector<std::vector<uint64_t>> lat(n);
+    for (size_t i = 0; i < ops.size(); ++i) {
+      size_t b = std::min(n - 1, size_t(uint64_t(due(i).count()) / step));
+      ++r.timeline[b].offered;
+    }
+    std::vector<uint64_t> all;
+    all.reserve(ops.size());
+    for (auto& s : samples) {
+      for (auto& x : s) {
+        auto& iv = r.timeline[x.doneNs / step];
+        ++iv.done;
+        iv.failed += !x.ok;
+        r.failed += !x.ok;
+        lat[x.doneNs / step].push_back(x.latencyNs);
+        all.push_back(x.latencyNs);
+      }
+    }
+    for (size_t b = 0; b < n; ++b) {
+      auto& iv = r.timeline[b];
+      iv.at = double(b * step) / 1e9;
+      iv.p50us = percentile(lat[b], 0.50);
+      iv.p99us = percentile(lat[b], 0.99);
+      iv.maxus = percentile(lat[b], 1.0);
+      r.collapses += collapsed(iv);
+    }
+    r.done = all.size();
+    r.seconds = double(last) / 1e9;
+    r.p50us = percentile(all, 0.50);
+    r.p99us = percentile(all, 0.99);
+    r.p999us = percentile(all, 0.999);
+    r.maxus = percentile(all, 1.0);
+    return r;
+  }
+
+  static void print(const LoadReport& r, std::chrono::milliseconds interval) {
+    double perSec = 1000.0 / double(interval.count());
+    std::printf("%8s %12s %12s %10s %10s %10s %10s\n",
+                "t(s)", "offered/s", "done/s", "failed", "p50(us)", "p99(us)", "max(us)");
+    for (auto& iv : r.timeline)
+      std::printf("%8.2f %12.0f %12.0f %10llu %10.1f %10.1f %10.1f%s\n", iv.at,
+                  double(iv.offered) * perSec, double(iv.done) * perSec,
+                  (unsigned long long)iv.failed, iv.p50us, iv.p99us, iv.maxus,
+                  collapsed(iv) ? "  <- collapse" : "");
+    std::printf("total: %llu ops (%llu refused) in %.2fs = %.0f ops/sec; p50 %.1fus p99 %.1fus "
+                "p99.9 %.1fus max %.1fus; %zu collapsed intervals\n",
+                (unsigned long long)r.done, (unsigned long long)r.failed, r.seconds,
+                r.seconds > 0 ? double(r.done) / r.seconds : 0.0,
+                r.p50us, r.p99us, r.p999us, r.maxus, r.collapses);
+  }
+
+private:
+  static constexpr std::chrono::microseconds kSpin{200};
+
+  static bool collapsed(const LoadInterval& iv) { return iv.offered >= 10 && iv.done * 2 < iv.offered; }
+
+  // keys are often sequential: spread them before taking the worker index
+  static uint64_t mix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    return k ^ (k >> 33);
+  }
+
+  // microseconds at quantile q (reorders v)
+  static double percentile(std::vector<uint64_t>& v, double q) {
+    if (v.empty()) return 0;
+    size_t k = std::min(v.size() - 1, size_t(q * double(v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return double(v[k]) / 1000.0;
+  }
+};
@@ -3,19 +3,56 @@
 #include <string>
 #include <map>
 #include <mutex>
-#include <shared_mutex>
 #include <optional>
 #include <chrono>
-#include <uuid/uuid.h>
+#include <algorithm>
+#include <ctime>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <tuple>
+#include <climits>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include "interner.h"
+#include "idGenerator.h"
+#include "timeline.h"
+#include "stripedLock.h"
+#include "mpscQueue.h"
+#include "epoch.h"
+#include "writeAheadLog.h"
+#include "benchHarness.h"
+#include "metrics.h"
+#include "changeFeed.h"
+#include "timerWheel.h"
+#include "admission.h"
+#include "partition.h"
+#include "loadGen.h"
 using namespace std;
 
 
 /*
  APIs: (All APIs are thread-safe and these APIs can be directly called by the user/user facing function)
-  createBooking(roomId, start, end, cap, emails) -> BookingId, Notifications Sent
-  findAvailableRooms(start, end, cap) -> List of RoomIds
+  createBooking(roomId, start, end, cap, emails, tenant = none) -> BookingId, Notifications Sent
+      (none also when the campus is full then or the tenant is over its admission limits)
+  createBookings(List[booking with roomId]) -> List[BookingId or none]   (bulk import)
+  createSeries(first booking, recurrence) -> List[BookingId] or none    (all-or-nothing)
+  findAvailableRooms(start, end, cap) -> List of Rooms, smallest free first
   cancelBooking(bookingId) -> Notifications Sent
   listCalenderForDay(roomId, day) -> List of Bookings
+  recover() / checkpoint() -> restore from / compact the write-ahead log (see Durability)
+  metrics::scrape() -> Prometheus text for the probes below (see Metrics)
+  subscribe(fromOldest = false) -> ChangeFeed::Reader over Booked/Cancelled/Released events (see Domain Models)
+  checkIn(bookingId) -> bool   (someone is in the room; keeps it from being auto-released)
+  advanceTimers(now) -> sends due reminders, releases unattended rooms (call about once a second)
+  saveRoom(room) -> adds or resizes a room through the log, so recovery and replicas have it
+  MeetingRouter: saveRoom / bookMeeting / cancelMeeting across MeetingNodes (see Partitioning)
 */
 
 /*
@@ -42,35 +79,68 @@ using namespace std;
  Services:
    MeetingService
    - Book()
+   - BookMany() / BookSeries()   (grouped per room: one lock + one merge pass each)
    - Cancel()
-   - ListCalender()
+   - listCalenderForDay()   (visitor over stored records, no copies)
    - findAvailableRooms()
 
-   NotificationService
+   NotificationService (async: enqueue only, background dispatcher batches per recipient)
    - sendInvites()
    - sendCancellations()
+   - sendReminders() / sendReleases()   (from MeetingService's timers)
 
-   CalendarService
+   CalendarService   (read-only view of the booking store's per-room time index)
    - isFree()
-   - addEntry()
-   - removeEntry()
 */
 
 /*
  Flow:
    Book()
+   - saturated()   (O(1) reject when every room is booked through the slot)
+   - admit()       (tenant rate limit, in-flight queue with deadline; admission.h)
    - findAvailableRooms()
    - selectRoom()
    - createBooking()
    - sendInvites()   
+   - armTimers()   (reminder at start - kReminderLead, release at start + kCheckInGrace)
+
+   At the room: checkIn() cancels the release; advanceTimers() sends the reminders
+   and releases (cancels, notifies) what nobody checked in to.
 */
 
 /*
- Wrap DB write(BookingRepository save) + Calendar Update(calenderService.addEntry) in a single ACID Transaction to handle concurrency 
+ DB write + Calendar Update are a single operation: BookingRepository::commit() checks the
+ room's time index, writes the record and indexes it under one lock (remove() undoes both)
 */
 
 
+// ——— Metrics ———
+// metrics.h probes: book/cancel latency (1 call in kSampleEvery per thread is
+// timed), room stripe and repository lock contention, UUID and notification
+// cost. Room and booking gauges come from MeetingService at scrape time.
+// -DLLD_NO_METRICS removes all of it.
+namespace probes {
+constexpr uint32_t kSampleEvery = 64;
+metrics::Histogram book("meeting_book_seconds", "bookMeeting latency");
+metrics::Histogram cancel("meeting_cancel_seconds", "cancelMeeting latency");
+metrics::Histogram uuid("meeting_uuid_seconds", "booking ID generation");
+metrics::Histogram notifyEnqueue("meeting_notify_enqueue_seconds", "handing a notice to the dispatcher");
+metrics::Histogram notifyDeliver("meeting_notify_deliver_seconds", "one dispatcher batch, provider call included");
+metrics::Histogram walWait("meeting_wal_wait_seconds", "wait for the group commit fsync");
+metrics::Counter booked("meeting_book_total", "bookMeeting calls", "result=\"ok\"");
+metrics::Counter rejected("meeting_book_total", "bookMeeting calls", "result=\"rejected\"");
+metrics::Counter full("meeting_book_total", "bookMeeting calls", "result=\"full\"");
+metrics::Counter throttled("meeting_book_total", "bookMeeting calls", "result=\"throttled\"");
+metrics::Counter shed("meeting_book_total", "bookMeeting calls", "result=\"shed\"");
+metrics::Counter retries("meeting_book_retries_total", "candidates lost to a concurrent booking");
+metrics::Counter autoReleased("meeting_auto_release_total", "bookings released for want of a check-in");
+metrics::LockProbe roomLock("meeting_room_lock", "the per-room lock stripes");
+metrics::LockProbe repoLock("meeting_booking_repo_lock", "the booking slab growth lock");
+}  // namespace probes
+
 // ——— Domain Models ———
+// External IDs are strings; internally rooms and bookings are addressed by
+// dense Handles (see interner.h) that index the flat repository vectors.
 struct Room {
     string id;
     int capacity;
@@ -79,83 +149,706 @@ struct Room {
 struct Booking {
     string id;
     string roomId;
+    Handle room = kNoHandle;   // interned roomId, filled in by MeetingService
     chrono::system_clock::time_point start;
     chrono::system_clock::time_point end;
     vector<string> attendees;
 };
 
+// Change feed records (changeFeed.h), one per committed booking and per cancel
+// (Released: cancelled by the check-in timer): fixed-size and trivially
+// copyable, so publishing is a copy into the ring.
+enum class BookingEvent : uint8_t { Booked = 1, Cancelled, Released };
+
+struct BookingChange {
+    int64_t start;        // system_clock ticks
+    int64_t end;
+    uint16_t attendees;   // headcount, saturating
+    uint8_t roomLen, idLen;
+    char room[32];        // room ID, cut at 32 bytes
+    char id[36];          // booking ID
+
+    static BookingChange of(const Booking& b) {
+        BookingChange c{};
+        c.start = b.start.time_since_epoch().count();
+        c.end = b.end.time_since_epoch().count();
+        c.attendees = uint16_t(min<size_t>(b.attendees.size(), UINT16_MAX));
+        c.roomLen = uint8_t(min(b.roomId.size(), sizeof c.room));
+        c.idLen = uint8_t(min(b.id.size(), sizeof c.id));
+        memcpy(c.room, b.roomId.data(), c.roomLen);
+        memcpy(c.id, b.id.data(), c.idLen);
+        return c;
+    }
+    string_view roomId() const { return {room, roomLen}; }
+    string_view bookingId() const { return {id, idLen}; }
+};
+
+// Recurring series, an RRULE subset: FREQ=DAILY|WEEKLY;INTERVAL=n;BYDAY=..;COUNT=n|UNTIL=t.
+// Occurrences keep the first one's local wall-clock start and its duration.
+struct Recurrence {
+    enum class Freq { Daily, Weekly };
+    static constexpr int kMaxOccurrences = 10000;
+    static constexpr int kMaxInterval = 365;   // days or weeks between occurrences
+    static constexpr int kMaxDays = 366 * 100;  // horizon: nothing later than this after first
+
+    Freq freq = Freq::Weekly;
+    int interval = 1;
+    uint8_t byDay = 0;   // Weekly: bit 0 = Sunday .. bit 6 = Saturday; 0 = first's weekday
+    int count = 0;       // 0: bounded by until (and kMaxOccurrences, kMaxDays) only
+    optional<chrono::system_clock::time_point> until;
+
+    // occurrences in start order from `first`'s slot on. `first` itself is one
+    // only if its day matches the rule: always for Daily, for Weekly when byDay
+    // is 0 or has first's weekday. Empty for a rule that is unbounded, names
+    // a day outside bits 0..6 (it could never stop looking for a match) or has
+    // an interval outside 1..kMaxInterval.
+    vector<Booking> expand(const Booking& first) const {
+        vector<Booking> res;
+        if (interval < 1 || interval > kMaxInterval || (count <= 0 && !until) || (byDay & ~0x7f))
+            return res;
+        auto length = first.end - first.start;
+        time_t t0 = chrono::system_clock::to_time_t(first.start);
+        auto subSecond = first.start - chrono::system_clock::from_time_t(t0);
+        tm base;
+        localtime_r(&t0, &base);
+        uint8_t days = byDay ? byDay : uint8_t(1u << base.tm_wday);
+        int limit = count > 0 ? min(count, kMaxOccurrences) : kMaxOccurrences;
+
+        // the occurrence k days after first's; false once past until or the horizon
+        auto emit = [&](int k) {
+            if (k > kMaxDays) return false;
+            tm day = base;
+            day.tm_mday += k;
+            day.tm_isdst = -1;
+            auto start = chrono::system_clock::from_time_t(mktime(&day)) + subSecond;
+            if (until && start > *until) return false;
+            Booking b = first;
+            b.start = start;
+            b.end = start + length;
+            res.push_back(move(b));
+            return true;
+        };
+        // only days that match are visited: every interval-th day, or the byDay
+        // days of every interval-th week (weeks run Sunday to Saturday); every
+        // round calls emit() at least once, so the horizon ends the loop
+        for (int n = 0; int(res.size()) < limit; ++n) {
+            if (freq == Freq::Daily) {
+                if (!emit(n * interval)) break;
+                continue;
+            }
+            int week = n * interval * 7 - base.tm_wday;   // its Sunday, from first's day
+            bool more = true;
+            for (int d = 0; d < 7 && more && int(res.size()) < limit; ++d)
+                if ((days >> d & 1) && week + d >= 0) more = emit(week + d);
+            if (!more) break;
+        }
+        return res;
+    }
+};
+
 // ——— Repositories ———
+// Rooms change rarely and are read on every booking, so the whole catalog is an
+// RCU snapshot (epoch.h): readers take no lock and do no atomic RMW, save()
+// publishes a new copy.
 class RoomRepository {
 public:
-    vector<Room> findByCapacity(int cap);
-    optional<Room> findById(const string&); // std::optional<T> is a smart pointer 
-    // that can be empty returns a valid object if found else returns an empty optional for exception handling
+    Handle save(const Room& r) {
+        Handle h = 0;
+        catalog_.update([&](Catalog& c) {
+            auto [it, fresh] = c.ids.try_emplace(r.id, Handle(c.rooms.size()));
+            h = it->second;
+            if (fresh) c.rooms.push_back(r);
+            else eraseFromCapacityIndex(c, h);
+            c.rooms[h] = r;
+            auto key = make_pair(r.capacity, h);
+            c.byCapacity.insert(upper_bound(c.byCapacity.begin(), c.byCapacity.end(), key), key);
+        });
+        return h;
+    }
+    // rooms with capacity >= cap, smallest first
+    vector<Room> findByCapacity(int cap) {
+        vector<Room> res;
+        forEachByCapacity(cap, [&](Handle, const Room& r) {
+            res.push_back(r);
+            return true;
+        });
+        return res;
+    }
+    // visits rooms with capacity >= cap in ascending capacity until f returns false;
+    // starts at a binary search, so small requests never touch big rooms and vice versa
+    template <class F>
+    void forEachByCapacity(int cap, F&& f) {
+        catalog_.read([&](const Catalog& c) {
+            auto it = lower_bound(c.byCapacity.begin(), c.byCapacity.end(),
+                                  make_pair(cap, Handle(0)));
+            for (; it != c.byCapacity.end(); ++it)
+                if (!f(it->second, c.rooms[it->second])) break;
+            return 0;
+        });
+    }
+    // std::optional<T> is a smart pointer that can be empty returns a valid object
+    // if found else returns an empty optional for exception handling
+    optional<Room> findById(Handle h) {
+        return catalog_.read([&](const Catalog& c) -> optional<Room> {
+            if (h >= c.rooms.size()) return nullopt;
+            return c.rooms[h];
+        });
+    }
+    size_t size() const {
+        return catalog_.read([](const Catalog& c) { return c.rooms.size(); });
+    }
+    // API boundary: external room id -> handle
+    optional<Handle> handleOf(const string& id) {
+        return catalog_.read([&](const Catalog& c) -> optional<Handle> {
+            auto it = c.ids.find(id);
+            if (it == c.ids.end()) return nullopt;
+            return it->second;
+        });
+    }
 private:
-    vector<Room> rooms_;
+    struct Catalog {
+        unordered_map<string, Handle> ids;     // room id -> handle
+        vector<Room> rooms;                    // indexed by room handle
+        vector<pair<int, Handle>> byCapacity;  // sorted (capacity, room)
+    };
+
+    static void eraseFromCapacityIndex(Catalog& c, Handle h) {
+        auto key = make_pair(c.rooms[h].capacity, h);
+        auto it = lower_bound(c.byCapacity.begin(), c.byCapacity.end(), key);
+        if (it != c.byCapacity.end() && *it == key) c.byCapacity.erase(it);
+    }
+
+    RcuCell<Catalog> catalog_;
 };
 
-class BookingRepository {
+// Attendees as interned email handles: up to kInline live in the record itself,
+// bigger meetings spill into a vector whose capacity survives slot reuse.
+class AttendeeList {
 public:
-    void save(const Booking&);
-    optional<Booking> findById(const string&);
-    void remove(const string&);
-    vector<Booking> findByRoomAndDay(const string&, 
-        const tm& date);
+    static constexpr size_t kInline = 8;
+
+    void clear() { size_ = 0; spill_.clear(); }
+    void push_back(Handle h) {
+        if (size_ < kInline) inline_[size_] = h;
+        else spill_.push_back(h);
+        ++size_;
+    }
+    size_t size() const { return size_; }
+    Handle operator[](size_t i) const { return i < kInline ? inline_[i] : spill_[i - kInline]; }
+
 private:
-    map<string, Booking> bookings_;
-    shared_mutex mtx_;
+    array<Handle, kInline> inline_;
+    vector<Handle> spill_;
+    uint32_t size_ = 0;
 };
 
-// ——— Services ———
-class CalendarService {
+// What BookingRepository actually stores; visitors get a const& to one of these.
+struct BookingRecord {
+    string id;
+    string roomId;
+    // set last when the record is written and cleared when it is removed, so
+    // it is read without the room's lock (see BookingRepository::visitById)
+    atomic<Handle> room{kNoHandle};
+    chrono::system_clock::time_point start;
+    chrono::system_clock::time_point end;
+    AttendeeList attendees;   // render with BookingRepository::emailOf()
+    bool live = false;
+};
+
+// Per kSlot-long slot, how many rooms are booked for the whole of it: an O(1)
+// "campus full" answer that never walks the rooms. Only a single booking
+// spanning the slot counts, and a room's bookings never overlap, so each room
+// counts at most once and a slot's count never exceeds the rooms busy in it.
+// The cells are a ring tagged with their slot number, kCells slots from now; a
+// slot beyond that, or whose cell a later slot has taken over, simply goes
+// uncounted, so counts can read low (no fast reject) but never high.
+// Written by BookingRepository from any room's stripe, so a cell is changed
+// with a CAS; read with no lock at all.
+class SlotOccupancy {
 public:
-    // Singleton pattern -> Insures only one instance of the class is every constructed and shared across threads
-    static CalendarService& instance() {
-        static CalendarService inst;
-        return inst;
+    using TimePoint = chrono::system_clock::time_point;
+    static constexpr chrono::minutes kSlot{15};
+    static constexpr int64_t kCells = 1 << 15;   // ~341 days ahead, 256 KiB
+
+    void add(TimePoint start, TimePoint end) { update(start, end, true); }
+    void remove(TimePoint start, TimePoint end) { update(start, end, false); }
+
+    // true if some slot overlapping [start, end) has all `rooms` booked, so no
+    // room can be free for the whole interval
+    bool full(TimePoint start, TimePoint end, size_t rooms) const {
+        if (!rooms || !(start < end)) return false;
+        int64_t first = max<int64_t>(0, slotOf(start));
+        int64_t last = min(slotOf(end - TimePoint::duration(1)), first + kCells - 1);
+        for (int64_t s = first; s <= last; ++s) {
+            uint64_t c = cells_[s % kCells].load(memory_order_relaxed);
+            if (int64_t(c >> kCountBits) == s && (c & kCountMask) >= rooms) return true;
+        }
+        return false;
+    }
+
+private:
+    static constexpr int kCountBits = 20;
+    static constexpr uint64_t kCountMask = (1u << kCountBits) - 1;
+
+    static int64_t slotOf(TimePoint t) {
+        auto d = t.time_since_epoch();
+        return d.count() < 0 ? -1 : int64_t(d / kSlot);
+    }
+
+    // the slots [start, end) covers completely; tags only ever move forward,
+    // so a decrement always matches an increment made under the same tag
+    void update(TimePoint start, TimePoint end, bool add) {
+        int64_t first = max<int64_t>(0, slotOf(start + kSlot - TimePoint::duration(1)));
+        int64_t last = min(slotOf(end), slotOf(chrono::system_clock::now()) + kCells);
+        for (int64_t s = first; s < last; ++s) {
+            auto& cell = cells_[s % kCells];
+            uint64_t c = cell.load(memory_order_relaxed);
+            for (;;) {
+                int64_t tag = int64_t(c >> kCountBits);
+                uint64_t n = c & kCountMask;
+                if (add) {
+                    if (tag > s || n == kCountMask) break;
+                    n = tag == s ? n + 1 : 1;   // a smaller tag is a slot long past
+                } else {
+                    if (tag != s || !n) break;
+                    --n;
+                }
+                if (cell.compare_exchange_weak(c, uint64_t(s) << kCountBits | n,
+                                               memory_order_relaxed))
+                    break;
+            }
+        }
+    }
+
+    array<atomic<uint64_t>, kCells> cells_{};   // slot << kCountBits | rooms booked
+};
+
+// Bookings live in a slab of records indexed by booking handle. remove() only
+// marks the slot dead and the interner recycles its handle, so the next commit()
+// overwrites the record in place: strings and the attendee list keep their
+// buffers and steady-state book/cancel churn does not touch the heap.
+// The store also owns each room's time index, a Timeline of booking handles kept
+// as a LeftRight (epoch.h): edited in place, so a change costs a binary search
+// and a shift of the bookings after it, however long the room's history, and
+// read with no lock. commit()/remove() update record and index together under
+// the room's lock stripe (roomLock(), held by the caller), so a booking is
+// written once, no reader ever sees one without the other, and writers to rooms
+// on different stripes never wait for each other.
+// The slab grows in segments that never move, so a record stays put for as
+// long as a room index can hand out its handle, and forEachOverlapping() reads
+// index and records with no lock at all. The only repository-wide lock guards
+// allocating a new segment.
+// find*() materialise Booking copies; visit*()/forEach*() hand out the stored
+// record in place, under the room's stripe or inside the index read (keep the
+// callback short, and don't call back into the repository from it).
+class BookingRepository {
+public:
+    using TimePoint = chrono::system_clock::time_point;
+
+    BookingRepository() = default;
+    BookingRepository(const BookingRepository&) = delete;
+    BookingRepository& operator=(const BookingRepository&) = delete;
+    ~BookingRepository() {
+        for (auto& s : segments_) delete[] s.load();
+    }
+
+    // Serialises the writers of a room: commit(), commitBatch() and remove()
+    // expect the caller to hold it, so the caller can order its own side
+    // effects (log, feed) with the write. Rooms may share a stripe.
+    mutex& roomLock(Handle room) { return roomLocks_.forKey(room); }
+
+    // the single write path: conflict check, record and room index in one step;
+    // nullopt (nothing written) if [start, end) overlaps a booking of b.room.
+    // Caller holds roomLock(b.room).
+    optional<Handle> commit(const Booking& b) {
+        auto& index = indexFor(b.room);
+        if (!index.writerView().isFree(b.start, b.end)) return nullopt;
+        Handle h = store(b);
+        index.update([&](Timeline<Handle>& t) { t.insert(b.start, b.end, h); });
+        return h;
+    }
+    // commit() for many bookings of one room, sorted by start: one lock, one
+    // merge pass against the timeline and one index update for the whole batch.
+    // A booking that overlaps the calendar or an earlier one in the batch gets
+    // nullopt; with allOrNothing a single conflict commits none of them.
+    // Caller holds roomLock(room).
+    vector<optional<Handle>> commitBatch(Handle room, const vector<const Booking*>& sorted,
+                                         bool allOrNothing) {
+        vector<optional<Handle>> res(sorted.size());
+        vector<pair<TimePoint, TimePoint>> spans;
+        spans.reserve(sorted.size());
+        for (auto* b : sorted) spans.emplace_back(b->start, b->end);
+
+        auto& index = indexFor(room);
+        auto ok = index.writerView().fitSorted(spans);
+        if (allOrNothing && find(ok.begin(), ok.end(), false) != ok.end()) return res;
+        vector<Timeline<Handle>::Interval> added;
+        added.reserve(sorted.size());
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            if (!ok[i]) continue;
+            res[i] = store(*sorted[i]);
+            added.push_back({sorted[i]->start, sorted[i]->end, *res[i]});
+        }
+        if (!added.empty())
+            index.update([&](Timeline<Handle>& t) { t.insertSorted(added); });
+        return res;
+    }
+    // Encapsulates conflict logic: one binary search in the room's timeline,
+    // correct for meetings spanning several days. Lock-free: the room directory
+    // is an RCU snapshot and each index a LeftRight (epoch.h).
+    bool isFree(Handle room, TimePoint start, TimePoint end) const {
+        return rooms_.read([&](const RoomDir& dir) {
+            if (room >= dir.size()) return true;
+            return dir[room]->read([&](const Timeline<Handle>& t) {
+                return t.isFree(start, end);
+            });
+        });
+    }
+    optional<Booking> findById(const string& id) {
+        optional<Booking> res;
+        visitById(id, [&](const BookingRecord& r) { res = toBooking(r); });
+        return res;
+    }
+    // f runs under the booking's room stripe
+    template <class F>
+    bool visitById(const string& id, F&& f) {
+        auto h = ids_.find(id);
+        if (!h) return false;
+        auto& r = record(*h);
+        // the handle may be recycled meanwhile: a record whose room still reads
+        // the same under that room's stripe is a whole booking nobody can change
+        Handle room = r.room.load(memory_order_acquire);
+        if (room == kNoHandle) return false;
+        auto lock = metrics::lock(roomLock(room), probes::roomLock);
+        if (r.room.load(memory_order_relaxed) != room || !r.live || r.id != id)
+            return false;
+        f(r);
+        return true;
+    }
+    // lock-free: true if every one of `rooms` is booked through some slot
+    // overlapping [start, end) (see SlotOccupancy), i.e. no room can take it
+    bool saturated(TimePoint start, TimePoint end, size_t rooms) const {
+        return busy_.full(start, end, rooms);
     }
-    // Encapsulates conflict logic (overlaps) and delegates storage to BookingRepository.
-    bool isFree(const string& roomId,
-                const Booking& b) {
-        auto day = toDate(b.start);
-        for (auto& ex : repo_.findByRoomAndDay(roomId, day)) {
-            if (overlaps(ex, b)) return false;
+    string emailOf(Handle attendee) const { return emails_.name(attendee); }
+    size_t liveCount() const { return ids_.live(); }
+    optional<Handle> handleOf(const string& id) { return ids_.find(id); }
+    // materialises every live booking in turn (snapshots), room by room under
+    // each room's stripe; f gets a const Booking&
+    template <class F>
+    void forEachLive(F&& f) {
+        size_t rooms = rooms_.read([](const RoomDir& dir) { return dir.size(); });
+        for (Handle room = 0; room < rooms; ++room) {
+            auto lock = metrics::lock(roomLock(room), probes::roomLock);
+            for (auto& iv : indexFor(room).writerView().intervals())
+                f(toBooking(record(iv.payload)));
         }
+    }
+    // drops record and index entry together; false if the booking is not live
+    // in that room. Caller holds roomLock(room).
+    bool remove(Handle room, const string& id) {
+        auto h = ids_.find(id);
+        if (!h) return false;
+        auto& r = record(*h);
+        if (r.room.load(memory_order_relaxed) != room) return false;
+        // out of the index first: once update() returns no reader still holds
+        // *h, so the record may be recycled
+        indexFor(room).update([&](Timeline<Handle>& t) { t.erase(r.start, *h); });
+        busy_.remove(r.start, r.end);
+        r.live = false;
+        r.room.store(kNoHandle, memory_order_relaxed);
+        ids_.release(*h);   // booking handles are recycled
         return true;
     }
-    // Encapsulates storage logic and delegates to BookingRepository.
-    void addEntry(const Booking& b) {
-        repo_.save(b);
+    // every booking overlapping the local calendar day, including ones
+    // that started on an earlier day
+    vector<Booking> findByRoomAndDay(Handle room, 
+        const tm& date) {
+        vector<Booking> res;
+        forEachInRoomAndDay(room, date, [&](const BookingRecord& r) { res.push_back(toBooking(r)); });
+        return res;
     }
-    // Encapsulates storage logic and delegates to BookingRepository.
-    void removeEntry(const string& bookingId) {
-        repo_.remove(bookingId);
+    template <class F>
+    void forEachInRoomAndDay(Handle room, const tm& date, F&& f) {
+        tm midnight = date;
+        midnight.tm_hour = midnight.tm_min = midnight.tm_sec = 0;
+        midnight.tm_isdst = -1;
+        auto dayStart = chrono::system_clock::from_time_t(mktime(&midnight));
+        ++midnight.tm_mday;
+        midnight.tm_isdst = -1;
+        auto dayEnd = chrono::system_clock::from_time_t(mktime(&midnight));
+        forEachOverlapping(room, dayStart, dayEnd, f);
+    }
+    // bookings of the room overlapping [start, end), in start order. Lock-free
+    // like isFree(); a writer on this room waits for f to return, so f must not
+    // take a lock or call into the repository (emailOf() aside).
+    template <class F>
+    void forEachOverlapping(Handle room, TimePoint start, TimePoint end, F&& f) const {
+        rooms_.read([&](const RoomDir& dir) {
+            if (room >= dir.size()) return 0;
+            return dir[room]->read([&](const Timeline<Handle>& t) {
+                t.forEachOverlapping(start, end, [&](auto& iv) { f(record(iv.payload)); });
+                return 0;
+            });
+        });
     }
 private:
-    BookingRepository repo_;
-    bool overlaps(const Booking&a, const Booking&b) {
-        return !(b.end <= a.start || b.start >= a.end);
+    using RoomIndex = LeftRight<Timeline<Handle>>;
+    using RoomDir = vector<shared_ptr<RoomIndex>>;   // room handle -> index
+
+    // Segment k holds kFirstSegment << k records and is never moved or freed
+    // before the repository, so a handle read from an index reaches its record
+    // without a lock while the slab grows.
+    static constexpr size_t kFirstSegment = 64;
+    static constexpr size_t kSegments = 27;   // room for every 32-bit handle
+
+    static pair<size_t, size_t> locate(Handle h) {
+        size_t k = 63 - __builtin_clzll(uint64_t(h) / kFirstSegment + 1);   // floor(log2)
+        return {k, h - kFirstSegment * ((size_t(1) << k) - 1)};
+    }
+    BookingRecord& record(Handle h) const {
+        auto [k, i] = locate(h);
+        return segments_[k].load(memory_order_acquire)[i];
+    }
+
+    // writes the slab record (caller holds the room's stripe and indexes it
+    // afterwards, which publishes the record to lock-free readers)
+    Handle store(const Booking& b) {
+        Handle h = ids_.intern(b.id);
+        auto k = locate(h).first;
+        if (!segments_[k].load(memory_order_acquire)) {
+            auto lock = metrics::lock(growMtx_, probes::repoLock);
+            if (!segments_[k].load(memory_order_relaxed))
+                segments_[k].store(new BookingRecord[kFirstSegment << k], memory_order_release);
+        }
+        auto& r = record(h);
+        r.id.assign(b.id);
+        r.roomId.assign(b.roomId);
+        r.start = b.start;
+        r.end = b.end;
+        r.attendees.clear();
+        for (auto& e : b.attendees) r.attendees.push_back(emails_.intern(e));
+        r.live = true;
+        // last: visitById() trusts a record once its room is set
+        r.room.store(b.room, memory_order_release);
+        busy_.add(b.start, b.end);
+        return h;
+    }
+
+    Booking toBooking(const BookingRecord& r) const {
+        Booking b{r.id, r.roomId, r.room.load(memory_order_relaxed), r.start, r.end, {}};
+        b.attendees.reserve(r.attendees.size());
+        for (size_t i = 0; i < r.attendees.size(); ++i)
+            b.attendees.push_back(emails_.name(r.attendees[i]));
+        return b;
+    }
+
+    // writers only (under a room stripe); the directory only grows, a new room
+    // costs one copy of the pointer vector
+    RoomIndex& indexFor(Handle room) {
+        auto* t = rooms_.read([&](const RoomDir& dir) {
+            return room < dir.size() ? dir[room].get() : nullptr;
+        });
+        if (t) return *t;
+        rooms_.update([&](RoomDir& dir) {
+            while (dir.size() <= room) dir.push_back(make_shared<RoomIndex>());
+        });
+        return *rooms_.read([&](const RoomDir& dir) { return dir[room].get(); });
     }
-    tm toDate(const chrono::system_clock::time_point&);
+
+    Interner ids_;
+    Interner emails_;                  // attendee email -> handle, shared by all bookings
+    array<atomic<BookingRecord*>, kSegments> segments_{};   // slab indexed by booking handle
+    RcuCell<RoomDir> rooms_;           // per-room time index over the slab
+    SlotOccupancy busy_;               // rooms fully booked per slot, for saturated()
+    StripedLock roomLocks_;            // room handle -> padded mutex, fixed size, no inserts
+    mutex growMtx_;                    // allocating a slab segment
+};
+
+// ——— Services ———
+// Read-side view of the booking store's room index for the selection logic;
+// all writes go through BookingRepository::commit()/remove().
+class CalendarService {
+public:
+    explicit CalendarService(const BookingRepository& br) : br_(br) {}
+
+    bool isFree(Handle room,
+                const Booking& b) const {
+        return br_.isFree(room, b.start, b.end);
+    }
+private:
+    const BookingRepository& br_;
 };
 
-// A simple façade over whatever email/SMS system you choose.
+// An asynchronous façade over whatever email/SMS system you choose.
+// Callers only enqueue into a bounded lock-free queue; one background dispatcher
+// drains it, coalesces notices per recipient and hands each batch to the provider.
+// A full queue drops the notice and counts it rather than stalling a booking.
 class NotificationService {
 public:
+    enum class Kind { Invite, Cancellation, Reminder, Release };
+    struct Notice {
+        Kind kind;
+        Booking booking;   // booking.attendees are the recipients
+    };
+    // everything one recipient gets in this batch: one email instead of many
+    struct Digest {
+        string recipient;
+        vector<const Notice*> notices;
+    };
+    using Provider = function<void(const vector<Digest>&)>;
+    struct Stats {
+        uint64_t enqueued, dropped, delivered, batches;
+    };
+
     static NotificationService& instance() {
         static NotificationService inst;
         return inst;
     }
     void sendInvites(const vector<string>& users,
                      const Booking& b) {
-        // fire off email/SMS...
+        enqueue(Kind::Invite, users, b);
     }
     void sendCancellations(const vector<string>& users,
                            const Booking& b) {
-        // ...
+        enqueue(Kind::Cancellation, users, b);
+    }
+    void sendReminders(const vector<string>& users,
+                       const Booking& b) {
+        enqueue(Kind::Reminder, users, b);
+    }
+    void sendReleases(const vector<string>& users,
+                      const Booking& b) {
+        enqueue(Kind::Release, users, b);
+    }
+
+    void setProvider(Provider p) {
+        lock_guard lock(providerMtx_);
+        provider_ = move(p);
+    }
+    Stats stats() const {
+        return {enqueued_.load(), dropped_.load(), delivered_.load(), batches_.load()};
+    }
+
+    ~NotificationService() {
+        stop_ = true;
+        dispatcher_.join();
+    }
+
+private:
+    static constexpr size_t kQueueCapacity = 1 << 14;
+    static constexpr size_t kMaxBatch = 256;
+    static constexpr chrono::milliseconds kLinger{2};
+
+    NotificationService() : dispatcher_([this] { run(); }) {}
+
+    void enqueue(Kind k, const vector<string>& users, const Booking& b) {
+        metrics::Timer t(probes::notifyEnqueue, probes::kSampleEvery);
+        Notice n{k, b};
+        if (&users != &b.attendees) n.booking.attendees = users;
+        if (queue_.tryPush(move(n))) ++enqueued_;
+        else ++dropped_;
+    }
+
+    void run() {
+        vector<Notice> batch;
+        batch.reserve(kMaxBatch);
+        for (;;) {
+            while (batch.size() < kMaxBatch) {
+                auto n = queue_.tryPop();
+                if (!n) break;
+                batch.push_back(move(*n));
+            }
+            if (!batch.empty()) {
+                deliver(batch);
+                batch.clear();
+            } else if (stop_) {
+                return;   // drained
+            } else {
+                this_thread::sleep_for(kLinger);
+            }
+        }
+    }
+
+    void deliver(const vector<Notice>& batch) {
+        metrics::Timer t(probes::notifyDeliver);
+        map<string, size_t> slot;
+        vector<Digest> digests;
+        for (auto& n : batch) {
+            for (auto& r : n.booking.attendees) {
+                auto [it, fresh] = slot.try_emplace(r, digests.size());
+                if (fresh) digests.push_back(Digest{r, {}});
+                digests[it->second].notices.push_back(&n);
+            }
+        }
+        {
+            lock_guard lock(providerMtx_);
+            if (provider_) provider_(digests);   // fire off email/SMS...
+        }
+        delivered_ += batch.size();
+        ++batches_;
     }
+
+    MpscQueue<Notice> queue_{kQueueCapacity};
+    atomic<uint64_t> enqueued_{0}, dropped_{0}, delivered_{0}, batches_{0};
+    mutex providerMtx_;
+    Provider provider_;
+    atomic<bool> stop_{false};
+    // the existing Stats, exported as counters
+    metrics::Collector counters_{[this](metrics::Exposition& e) {
+        Stats s = stats();
+        e.family("meeting_notices_total", "counter", "notices by outcome");
+        e.sample("meeting_notices_total", "outcome=\"enqueued\"", double(s.enqueued));
+        e.sample("meeting_notices_total", "outcome=\"dropped\"", double(s.dropped));
+        e.sample("meeting_notices_total", "outcome=\"delivered\"", double(s.delivered));
+    }};
+    thread dispatcher_;   // last member: starts after everything it touches exists
 };
 
+// ——— Durability ———
+// With a WriteAheadLog (writeAheadLog.h) every book/cancel is appended after it is
+// applied, under the room's lock, and is durable before the call returns. Rooms
+// are configuration: save them before recover(), which replays bookings by roomId,
+// or save them through MeetingService::saveRoom(), which logs them (RoomSaved);
+// snapshots carry the whole room catalog either way.
+// A batch commit is one BookedBatch record, so it is durable all-or-nothing too.
+// A check-in is a CheckedIn record (the booking, for its ID), so a restart does
+// not release an attended room; an auto-release is logged as a Cancelled.
+enum class LogRecord : uint8_t { Booked = 1, Cancelled, BookedBatch, CheckedIn, RoomSaved };
+
+void encodeBooking(BinWriter& w, const Booking& b) {
+    w.putStr(b.id);
+    w.putStr(b.roomId);
+    w.put(int64_t(b.start.time_since_epoch().count()));
+    w.put(int64_t(b.end.time_since_epoch().count()));
+    w.put(uint32_t(b.attendees.size()));
+    for (auto& a : b.attendees) w.putStr(a);
+}
+
+Booking decodeBooking(BinReader& r) {
+    using Clock = chrono::system_clock;
+    Booking b;
+    b.id = r.getStr();
+    b.roomId = r.getStr();
+    b.start = Clock::time_point(Clock::duration(r.get<int64_t>()));
+    b.end = Clock::time_point(Clock::duration(r.get<int64_t>()));
+    uint32_t n = r.get<uint32_t>();
+    for (uint32_t i = 0; i < n && r.ok(); ++i) b.attendees.emplace_back(r.getStr());
+    return b;
+}
+
+void encodeRoom(BinWriter& w, const Room& r) {
+    w.putStr(r.id);
+    w.put(int32_t(r.capacity));
+}
+
+Room decodeRoom(BinReader& r) {
+    Room room;
+    room.id = r.getStr();
+    room.capacity = r.get<int32_t>();
+    return room;
+}
+
 // ——— Room Allocation Strategy. This is in an interface to allow for different strategies to be used like FirstFit and BestFit ———
 class IRoomStrategy {
 public:
@@ -179,69 +872,1175 @@ class SmallestFitStrategy : public IRoomStrategy {
 // ——— Meeting Service ———
 class MeetingService {
 public:
+    // admission: per-tenant rate and in-flight limits for bookMeeting (off by default)
     MeetingService(RoomRepository& rr,
                    BookingRepository& br,
-                   IRoomStrategy& strat)
-     : rr_(rr), br_(br), strat_(strat) {}
+                   IRoomStrategy& strat,
+                   WriteAheadLog* log = nullptr,
+                   AdmissionPolicy admission = {})
+     : rr_(rr), br_(br), strat_(strat), log_(log), cal_(br), admission_(admission) {}
+
+    // reminders go out this long before a meeting; a booking nobody has checked
+    // in to this long after its start is released
+    static constexpr chrono::minutes kReminderLead{10}, kCheckInGrace{10};
+
+    // adds the room or changes its capacity; with a log the change is durable
+    // before it returns and comes back from recover() (or a replica's log)
+    void saveRoom(const Room& room) {
+        uint64_t lsn = 0;
+        {
+            lock_guard lock(roomMtx_);
+            if (auto h = rr_.handleOf(room.id); h && rr_.findById(*h)->capacity == room.capacity)
+                return;
+            rr_.save(room);
+            if (log_) {
+                BinWriter w;
+                encodeRoom(w, room);
+                lsn = log_->append(uint8_t(LogRecord::RoomSaved), w.data());
+            }
+        }
+        waitDurable(lsn);
+    }
+
+    // Free rooms for [start, end) with capacity >= cap, smallest first. Walks the
+    // capacity index from the first big-enough room and asks each room's timeline,
+    // stopping after limit hits instead of scanning the whole campus.
+    vector<Room> findAvailableRooms(chrono::system_clock::time_point start,
+                                    chrono::system_clock::time_point end,
+                                    int cap, size_t limit = SIZE_MAX) {
+        Booking probe;
+        probe.start = start;
+        probe.end = end;
+        vector<Room> res;
+        rr_.forEachByCapacity(cap, [&](Handle h, const Room& r) {
+            if (cal_.isFree(h, probe)) res.push_back(r);
+            return res.size() < limit;
+        });
+        return res;
+    }
 
+    // A request naming a room (roomId) gets that room or nullopt if it is taken
+    // or too small, like bookMeetings() and bookSeries(); otherwise the strategy
+    // picks one.
+    // tenant: whose rate limit and queue the call counts against (see Admission)
     optional<string> bookMeeting(
-        const Booking& req) 
+        const Booking& req, string_view tenant = {}) 
     {
-        auto rooms = rr_.findByCapacity(req.attendees.size());
-        auto room = strat_.select(rooms, req.attendees.size());
-        if (!room) return nullopt;
-
-        Booking b = req;
-        b.roomId = room->id;
-        b.id = newUUID();
-
-        auto& cal = CalendarService::instance();
-        // Locks the mutex associated with a specific room ID, preventing two threads from booking the same room at once.
-        unique_lock lock(mutexes_[b.roomId]);
-        if (!cal.isFree(b.roomId, b)) return nullopt;
-
-        // Atomic-ish sequence: save booking + update calendar
-        br_.save(b);
-        cal.addEntry(b);
-        NotificationService::instance()
-            .sendInvites(b.attendees, b);
-        return b.id;
+        metrics::Timer timer(probes::book, probes::kSampleEvery);
+        // at peak most calls fail; a slot with every room booked fails this one
+        // before it takes a ticket, a lock or a copy of any room
+        if (br_.saturated(req.start, req.end, rr_.size())) {
+            probes::full.inc();
+            return nullopt;
+        }
+        auto ticket = admission_.admit(tenant);
+        if (!ticket) {
+            (ticket.verdict() == Admission::Verdict::Throttled ? probes::throttled : probes::shed).inc();
+            return nullopt;
+        }
+        int cap = req.attendees.size();
+        auto rooms = req.roomId.empty() ? findAvailableRooms(req.start, req.end, cap, kMaxCandidates)
+                                        : namedRoom(req, cap);
+
+        // Another thread may take a candidate between the search and the commit;
+        // drop it and let the strategy pick again instead of failing the request.
+        while (auto room = strat_.select(rooms, cap)) {
+            Booking b = req;
+            b.roomId = room->id;
+            b.room = rr_.handleOf(room->id).value();
+            {
+                metrics::Timer t(probes::uuid, probes::kSampleEvery);
+                b.id = IdGenerator::next().str();
+            }
+
+            // Locks the stripe owning this room, so the log sees this room's
+            // commits and cancels in the order they were applied.
+            auto lock = metrics::lock(br_.roomLock(b.room), probes::roomLock);
+            // one commit: conflict check, booking record and room index together
+            if (!br_.commit(b)) {
+                probes::retries.inc();
+                rooms.erase(find_if(rooms.begin(), rooms.end(),
+                    [&](const Room& r) { return r.id == room->id; }));
+                continue;
+            }
+            feed_.publish(uint8_t(BookingEvent::Booked), BookingChange::of(b));
+            uint64_t lsn = log_ ? logRecord(LogRecord::Booked, b) : 0;
+            lock.unlock();   // the fsync and notifications happen outside the room lock
+            armTimers({&b});
+            waitDurable(lsn);
+            NotificationService::instance()
+                .sendInvites(b.attendees, b);
+            probes::booked.inc();
+            return b.id;
+        }
+        probes::rejected.inc();
+        return nullopt;
+    }
+
+    // Bulk import. Requests naming a room (roomId) are grouped by room and sorted by
+    // start; each room is locked and committed once, checked against its timeline in
+    // one merge pass, and IDs come from one IdGenerator batch. A request that
+    // conflicts with the calendar or with an earlier request of the batch, or
+    // whose room cannot seat its attendees, gets nullopt. Requests without a
+    // roomId go through bookMeeting() one by one.
+    vector<optional<string>> bookMeetings(const vector<Booking>& reqs) {
+        vector<optional<string>> res(reqs.size());
+        vector<tuple<Handle, chrono::system_clock::time_point, size_t>> order;
+        order.reserve(reqs.size());
+        for (size_t i = 0; i < reqs.size(); ++i) {
+            if (reqs[i].roomId.empty()) { res[i] = bookMeeting(reqs[i]); continue; }
+            auto room = rr_.handleOf(reqs[i].roomId);
+            if (room && seats(*room, int(reqs[i].attendees.size())) && reqs[i].start < reqs[i].end)
+                order.emplace_back(*room, reqs[i].start, i);
+        }
+        sort(order.begin(), order.end());
+
+        auto ids = IdGenerator::nextBatch(order.size());
+        vector<Booking> staged;
+        staged.reserve(order.size());
+        for (size_t k = 0; k < order.size(); ++k) {
+            staged.push_back(reqs[get<2>(order[k])]);
+            staged.back().room = get<0>(order[k]);
+            staged.back().id = ids[k].str();
+        }
+
+        uint64_t lsn = 0;
+        vector<bool> done(staged.size());
+        for (size_t g = 0; g < staged.size();) {
+            size_t end = g;
+            vector<const Booking*> group;
+            for (; end < staged.size() && staged[end].room == staged[g].room; ++end)
+                group.push_back(&staged[end]);
+            auto ok = commitRoom(staged[g].room, group, false, lsn);
+            for (size_t k = g; k < end; ++k) done[k] = ok[k - g];
+            g = end;
+        }
+        vector<const Booking*> booked;
+        for (size_t k = 0; k < staged.size(); ++k)
+            if (done[k]) booked.push_back(&staged[k]);
+        armTimers(booked);
+        waitDurable(lsn);   // one wait for the whole import
+
+        for (size_t k = 0; k < staged.size(); ++k) {
+            if (!done[k]) continue;
+            res[get<2>(order[k])] = staged[k].id;
+            NotificationService::instance().sendInvites(staged[k].attendees, staged[k]);
+        }
+        return res;
+    }
+
+    // Books every occurrence of the series in one room or none at all: first.roomId
+    // if given (and it seats the attendees), else the smallest room free for the
+    // whole series.
+    optional<vector<string>> bookSeries(const Booking& first, const Recurrence& rule) {
+        auto occ = rule.expand(first);
+        if (occ.empty() || first.start >= first.end) return nullopt;
+        auto ids = IdGenerator::nextBatch(occ.size());
+        vector<const Booking*> group;
+        for (size_t i = 0; i < occ.size(); ++i) {
+            occ[i].id = ids[i].str();
+            group.push_back(&occ[i]);
+        }
+
+        uint64_t lsn = 0;
+        auto tryRoom = [&](Handle h, const Room& r) {
+            if (!cal_.isFree(h, occ[0])) return false;   // cheap lock-free pre-filter
+            for (auto& b : occ) {
+                b.roomId = r.id;
+                b.room = h;
+            }
+            return bool(commitRoom(h, group, true, lsn)[0]);
+        };
+        bool booked = false;
+        if (!first.roomId.empty()) {
+            auto h = rr_.handleOf(first.roomId);
+            booked = h && seats(*h, int(first.attendees.size())) && tryRoom(*h, *rr_.findById(*h));
+        } else {
+            rr_.forEachByCapacity(int(first.attendees.size()), [&](Handle h, const Room& r) {
+                booked = tryRoom(h, r);
+                return !booked;
+            });
+        }
+        if (!booked) return nullopt;
+        armTimers(group);
+        waitDurable(lsn);
+
+        vector<string> res;
+        res.reserve(occ.size());
+        for (auto& b : occ) {
+            res.push_back(b.id);
+            NotificationService::instance().sendInvites(b.attendees, b);
+        }
+        return res;
+    }
+
+    // visits the room's bookings for that day in place; f gets a const BookingRecord&
+    template <class F>
+    bool listCalenderForDay(const string& roomId, const tm& day, F&& f) {
+        auto room = rr_.handleOf(roomId);
+        if (!room) return false;
+        br_.forEachInRoomAndDay(*room, day, f);
+        return true;
     }
 
     bool cancelMeeting(const string& id) {
-        auto opt = br_.findById(id);
-        if (!opt) return false;
-        auto b = *opt;
-        br_.remove(id);
-        CalendarService::instance().removeEntry(id);
+        metrics::Timer timer(probes::cancel, probes::kSampleEvery);
+        uint64_t lsn = 0;
+        auto b = removeBooking(id, BookingEvent::Cancelled, lsn);
+        if (!b) return false;
+        {
+            lock_guard lock(timerMtx_);
+            if (auto it = armed_.find(id); it != armed_.end()) {
+                timers_.cancel(it->second.reminder);
+                timers_.cancel(it->second.release);
+                armed_.erase(it);
+            }
+        }
+        waitDurable(lsn);
         NotificationService::instance()
-            .sendCancellations(b.attendees, b);
+            .sendCancellations(b->attendees, *b);
+        return true;
+    }
+
+    // Someone is in the room: stops the auto-release. False if the booking does
+    // not exist (any more) or is over.
+    bool checkIn(const string& id) {
+        auto b = br_.findById(id);
+        if (!b || chrono::system_clock::now() >= b->end) return false;
+        uint64_t lsn = 0;
+        {
+            lock_guard lock(timerMtx_);
+            auto it = armed_.find(id);
+            if (it == armed_.end()) return true;   // already checked in
+            timers_.cancel(it->second.release);
+            armed_.erase(it);
+            attended_.insert(id);
+            if (log_) lsn = logRecord(LogRecord::CheckedIn, *b);
+        }
+        waitDurable(lsn);
+        return true;
+    }
+
+    // fires what is due by `now`: reminders kReminderLead before a meeting,
+    // releases of bookings nobody checked in to within kCheckInGrace of the
+    // start (or of booking, for one made late). Runs on the caller's thread,
+    // e.g. a TimerDriver's.
+    void advanceTimers(chrono::system_clock::time_point now = chrono::system_clock::now()) {
+        vector<MeetingTimer> due;
+        vector<Booking> released;
+        uint64_t lsn = 0;
+        {
+            // releases happen under the timer lock, so a check-in either wins
+            // (and cancels the timer) or finds the booking gone
+            lock_guard lock(timerMtx_);
+            timers_.advance(now, [&](MeetingTimer t) { due.push_back(move(t)); });
+            for (auto& t : due) {
+                if (!t.release) continue;
+                armed_.erase(t.bookingId);
+                if (auto b = removeBooking(t.bookingId, BookingEvent::Released, lsn))
+                    released.push_back(move(*b));
+            }
+        }
+        waitDurable(lsn);
+        for (auto& t : due) {
+            if (t.release) continue;
+            if (auto b = br_.findById(t.bookingId))
+                NotificationService::instance().sendReminders(b->attendees, *b);
+        }
+        for (auto& b : released) {
+            probes::autoReleased.inc();
+            NotificationService::instance().sendReleases(b.attendees, b);
+        }
+    }
+
+    // startup only, after the rooms are saved and before any traffic:
+    // load the latest snapshot, replay the log tail
+    bool recover() {
+        if (!log_) return false;
+        lock_guard lock(timerMtx_);
+        auto from = loadSnapshot(log_->dir(), [&](BinReader& r) {
+            vector<Booking> live;
+            uint32_t n = r.get<uint32_t>();
+            for (uint32_t i = 0; i < n && r.ok(); ++i) {
+                live.push_back(decodeBooking(r));
+                if (!r.ok()) live.pop_back();
+            }
+            n = r.get<uint32_t>();
+            for (uint32_t i = 0; i < n && r.ok(); ++i) attended_.emplace(r.getStr());
+            // the catalog comes last (older snapshots lack it) but is needed first
+            n = r.get<uint32_t>();
+            for (uint32_t i = 0; i < n && r.ok(); ++i) {
+                Room room = decodeRoom(r);
+                if (r.ok()) rr_.save(room);
+            }
+            for (auto& b : live) restoreBooking(b);
+        });
+        WriteAheadLog::replay(log_->dir(), from.value_or(0), [&](uint8_t type, string_view payload) {
+            BinReader r(payload.data(), payload.size());
+            if (LogRecord(type) == LogRecord::BookedBatch) {
+                uint32_t n = r.get<uint32_t>();
+                for (uint32_t i = 0; i < n && r.ok(); ++i) {
+                    Booking b = decodeBooking(r);
+                    if (r.ok()) restoreBooking(b);
+                }
+                return;
+            }
+            if (LogRecord(type) == LogRecord::RoomSaved) {
+                Room room = decodeRoom(r);
+                if (r.ok()) rr_.save(room);
+                return;
+            }
+            Booking b = decodeBooking(r);
+            if (!r.ok()) return;
+            if (LogRecord(type) == LogRecord::Booked) restoreBooking(b);
+            else if (LogRecord(type) == LogRecord::Cancelled) {
+                if (auto room = rr_.handleOf(b.roomId)) {
+                    lock_guard lock(br_.roomLock(*room));
+                    br_.remove(*room, b.id);
+                }
+            }
+            else if (LogRecord(type) == LogRecord::CheckedIn) attended_.insert(b.id);
+        });
+        // timers are not logged: arm them again for what is still ahead; a
+        // release that fell due while down fires on the first advanceTimers()
+        auto now = chrono::system_clock::now();
+        br_.forEachLive([&](const Booking& b) {
+            if (b.end <= now || attended_.count(b.id)) return;
+            Armed& a = armed_[b.id];
+            if (b.start - kReminderLead > now)
+                a.reminder = timers_.schedule(b.start - kReminderLead, MeetingTimer{false, b.id});
+            a.release = timers_.schedule(b.start + kCheckInGrace, MeetingTimer{true, b.id});
+        });
+        return true;
+    }
+
+    // fuzzy checkpoint: booking and cancelling keep running while it copies
+    bool checkpoint() {
+        if (!log_) return false;
+        uint64_t from = log_->rotate();
+        BinWriter body;
+        uint32_t n = 0;
+        br_.forEachLive([&](const Booking& b) { encodeBooking(body, b); ++n; });
+        BinWriter w;
+        w.put(n);
+        // then the checked-in bookings still live, pruning the ones that are gone
+        BinWriter tail;
+        {
+            lock_guard lock(timerMtx_);
+            for (auto it = attended_.begin(); it != attended_.end();)
+                it = br_.handleOf(*it) ? next(it) : attended_.erase(it);
+            tail.put(uint32_t(attended_.size()));
+            for (auto& id : attended_) tail.putStr(id);
+        }
+        {
+            lock_guard lock(roomMtx_);
+            vector<Room> rooms = rr_.findByCapacity(INT_MIN);
+            tail.put(uint32_t(rooms.size()));
+            for (auto& room : rooms) encodeRoom(tail, room);
+        }
+        writeSnapshot(log_->dir(), from, w.data() + body.data() + tail.data());
+        log_->dropBefore(from);
         return true;
     }
 
+    // Tail the Booked/Cancelled stream: poll() hands out Events whose payload is a
+    // BookingChange (event.as<BookingChange>()), typed by BookingEvent. Events are
+    // published under the room's stripe lock, so per room they come in commit
+    // order; publishing never waits for readers, and a reader more than kFeedSlots
+    // events behind skips ahead and counts the gap in lost(). Recovery does not
+    // publish: seed from listCalenderForDay() and then apply the feed.
+    ChangeFeed::Reader subscribe(bool fromOldest = false) const {
+        return feed_.subscribe(fromOldest);
+    }
+
 private:
+    static constexpr size_t kMaxCandidates = 8;
+
+    // bookMeeting()'s only candidate for a request naming its room: that room,
+    // if it exists, seats cap and is free
+    vector<Room> namedRoom(const Booking& req, int cap) {
+        auto h = rr_.handleOf(req.roomId);
+        if (!h || !seats(*h, cap) || !cal_.isFree(*h, req)) return {};
+        return {*rr_.findById(*h)};
+    }
+
+    // a named room is only booked if it seats cap, whichever path names it
+    bool seats(Handle room, int cap) {
+        auto r = rr_.findById(room);
+        return r && r->capacity >= cap;
+    }
+
+    struct MeetingTimer {
+        bool release = false;   // else a reminder
+        string bookingId;
+    };
+    struct Armed {
+        TimerWheel<MeetingTimer>::Id reminder = 0, release = 0;
+    };
+
+    // after a commit, outside the room lock. A cancel that slips in between
+    // only leaves timers that find the booking gone when they fire.
+    void armTimers(const vector<const Booking*>& booked) {
+        if (booked.empty()) return;
+        auto now = chrono::system_clock::now();
+        lock_guard lock(timerMtx_);
+        for (auto* b : booked) {
+            Armed& a = armed_[b->id];
+            if (b->start - kReminderLead > now)
+                a.reminder = timers_.schedule(b->start - kReminderLead, MeetingTimer{false, b->id});
+            a.release = timers_.schedule(max(b->start, now) + kCheckInGrace, MeetingTimer{true, b->id});
+        }
+    }
+
+    // cancelMeeting and the auto-release: the booking as it was, nullopt if gone
+    optional<Booking> removeBooking(const string& id, BookingEvent event, uint64_t& lsn) {
+        auto b = br_.findById(id);
+        if (!b) return nullopt;
+        // same stripe as bookMeeting, so a booking is logged before its cancel
+        auto lock = metrics::lock(br_.roomLock(b->room), probes::roomLock);
+        if (!br_.remove(b->room, id)) return nullopt;   // cancelled concurrently
+        feed_.publish(uint8_t(event), BookingChange::of(*b));
+        if (log_) lsn = max(lsn, logRecord(LogRecord::Cancelled, *b));
+        return b;
+    }
+    static constexpr size_t kFeedSlots = 16384;   // 128 bytes each: 2 MB
+
+    // one room's share of a batch, sorted by start: one stripe lock, one repository
+    // commit and one BookedBatch record; lsn is raised to that record's LSN
+    vector<bool> commitRoom(Handle room, const vector<const Booking*>& sorted,
+                            bool allOrNothing, uint64_t& lsn) {
+        vector<bool> done(sorted.size());
+        auto lock = metrics::lock(br_.roomLock(room), probes::roomLock);
+        auto handles = br_.commitBatch(room, sorted, allOrNothing);
+        BinWriter w;
+        uint32_t n = 0;
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            if (!handles[i]) continue;
+            done[i] = true;
+            feed_.publish(uint8_t(BookingEvent::Booked), BookingChange::of(*sorted[i]));
+            if (log_) encodeBooking(w, *sorted[i]);
+            ++n;
+        }
+        if (log_ && n) {
+            BinWriter rec;
+            rec.put(n);
+            lsn = max(lsn, log_->append(uint8_t(LogRecord::BookedBatch), rec.data() + w.data()));
+        }
+        return done;
+    }
+
+    void waitDurable(uint64_t lsn) {
+        if (!lsn) return;
+        metrics::Timer t(probes::walWait);
+        log_->waitDurable(lsn);
+    }
+
+    uint64_t logRecord(LogRecord type, const Booking& b) {
+        BinWriter w;
+        encodeBooking(w, b);
+        return log_->append(uint8_t(type), w.data());
+    }
+
+    // recovery: last writer wins, so whatever overlaps the booking in its room
+    // was cancelled later in the log and is dropped until the tail re-adds it
+    void restoreBooking(Booking b) {
+        auto room = rr_.handleOf(b.roomId);
+        if (!room || br_.handleOf(b.id)) return;
+        b.room = *room;
+        lock_guard lock(br_.roomLock(b.room));
+        vector<string> overlaps;
+        br_.forEachOverlapping(b.room, b.start, b.end,
+            [&](const BookingRecord& r) { overlaps.push_back(r.id); });
+        for (auto& id : overlaps) br_.remove(b.room, id);
+        br_.commit(b);
+    }
+
     RoomRepository& rr_;
     BookingRepository& br_;
     IRoomStrategy& strat_;
-    map<string, mutex> mutexes_;
+    WriteAheadLog* const log_;
+    CalendarService cal_;
+    mutex roomMtx_;           // saveRoom(): catalog and RoomSaved records in one order
+    Admission admission_;     // before the room locks: overload never reaches them
+    ChangeFeed feed_{kFeedSlots};
 
-    string newUUID() {
-        uuid_t u; uuid_generate(u);
-        char s[37]; uuid_unparse(u, s);
-        return string{s};
-    }
+    // check-in timers (1 s resolution): lock order is timerMtx_ before a room stripe
+    mutex timerMtx_;
+    TimerWheel<MeetingTimer> timers_{chrono::seconds(1)};
+    unordered_map<string, Armed> armed_;   // bookings not checked in to yet
+    unordered_set<string> attended_;       // checked in; pruned at checkpoint()
+
+    // scrape-time gauges; last member, so it is unregistered first
+    metrics::Collector gauges_{[this](metrics::Exposition& e) {
+        e.family("meeting_rooms", "gauge", "rooms in the catalog");
+        e.sample("meeting_rooms", "", double(rr_.size()));
+        e.family("meeting_live_bookings", "gauge", "bookings not cancelled");
+        e.sample("meeting_live_bookings", "", double(br_.liveCount()));
+    }};
 };
 
 /*
 Thread safety:
 
-    You pick a per-room mutex so two threads can still book different rooms in parallel.
+    You pick a per-room lock stripe so two threads can still book different rooms in parallel;
+    the stripe table is fixed-size, so finding a room's lock never inserts or allocates.
+    BookingRepository owns the table (roomLock()) and takes no lock of its own around a
+    write: the stripe is the only lock a booking or cancel holds.
+
+    The “check + write” itself is BookingRepository::commit(): conflict check, record and
+    room index in one step, so the stored booking and the calendar never disagree.
+    The stripe lock around it keeps each room's commits and cancels in log order.
 
-    You wrap the critical “check + write” section under that lock.
+    The change feed event is published inside that section too. Publishing claims a
+    ring slot with one fetch_add and never blocks on subscribers, so the feed adds
+    no lock and no wait to the booking path.
+
+    With a WAL, the record is appended inside that section but the fsync is awaited
+    after it, so concurrent bookings share one fsync (group commit).
+
+    Reminder and check-in timers sit in one hierarchical TimerWheel (timerWheel.h)
+    under its own mutex: a commit arms them after releasing the room lock, O(1)
+    each however far ahead the meeting is, and nothing ever scans the bookings for
+    what is due. advanceTimers() releases under that mutex, taking the room stripe
+    inside it, so checkIn() and a release cannot both win. Drive it from your own
+    loop or from a TimerDriver thread shared with the parking service.
 
 Failure modes:
 
     If no room is available or it’s already booked, you return std::nullopt.
+    When every room is booked through some 15-minute slot the request touches, that
+    is known from SlotOccupancy's counters before any room is looked at.
+
+    With an AdmissionPolicy, a tenant over its rate, or a call that finds the
+    in-flight limit reached and the queue full (or waits past maxWait), also gets
+    std::nullopt, before it takes a room lock: overload costs the callers turned
+    away a bounded wait, not the ones already inside.
 
     Caller sees “no booking ID,” so they know it failed.
-*/
\ No newline at end of file
+*/
+
+
+/*
+Partitioning: `partition.h`
+
+    Past one process, rooms are spread over nodes by room ID. Each partition is one
+    MeetingService with its own WAL on its leader node, shipped to a follower node;
+    rooms are saved through saveRoom(), so they travel with the log. MeetingRouter
+    sends a call naming a room to the room's partition. Without a room it asks the
+    partitions that have rooms one after another, starting from one picked by the
+    organiser, until one books it: smallest-fit holds within a partition, and a
+    full partition answers from its SlotOccupancy counters before any room lock.
+    cancelMeeting() asks the same partitions until one had the booking.
+
+    When a leader stops answering, the router makes each of its partitions' follower
+    the leader; that node replays the partition's shipped snapshot and log tail and
+    nothing else. Notifications and timers run on whichever node leads the booking's
+    partition, from that process's NotificationService and its own timer loop
+    (forEachLed()). Replication is asynchronous, so a failover can lose the last
+    bookings that had not been shipped.
+*/
+
+enum class MeetingRpc : uint8_t { SaveRoom = 1, Book, Cancel };
+
+// one partition of a node: its own repositories, log and service
+struct MeetingPartition {
+    RoomRepository rooms;
+    BookingRepository bookings;
+    SmallestFitStrategy strat;
+    WriteAheadLog wal;
+    MeetingService svc{rooms, bookings, strat, &wal};
+
+    explicit MeetingPartition(const string& dir) : wal(dir) { svc.recover(); }
+    WriteAheadLog& log() { return wal; }
+};
+
+// replies carry an optional ID as [u8 present][str id]
+string encodeId(const optional<string>& id) {
+    BinWriter w;
+    w.put(uint8_t(id.has_value()));
+    w.putStr(id.value_or(string()));
+    return w.data();
+}
+
+optional<string> decodeId(const optional<string>& reply) {
+    if (!reply) return nullopt;
+    BinReader r(reply->data(), reply->size());
+    bool present = r.get<uint8_t>();
+    string id(r.getStr());
+    if (!r.ok() || !present) return nullopt;
+    return id;
+}
+
+// the service side of MeetingRpc, run by PartitionNode on the partition's leader
+optional<string> meetingDispatch(MeetingPartition& part, uint8_t method, BinReader& r) {
+    switch (MeetingRpc(method)) {
+        case MeetingRpc::SaveRoom: {
+            Room room = decodeRoom(r);
+            if (!r.ok() || room.id.empty() || room.capacity <= 0) return nullopt;
+            part.svc.saveRoom(room);
+            return string(1, 1);
+        }
+        case MeetingRpc::Book: {
+            Booking req = decodeBooking(r);
+            string tenant(r.getStr());
+            if (!r.ok() || req.start >= req.end) return nullopt;
+            return encodeId(part.svc.bookMeeting(req, tenant));
+        }
+        case MeetingRpc::Cancel: {
+            string id(r.getStr());
+            if (!r.ok()) return nullopt;
+            return string(1, char(part.svc.cancelMeeting(id)));
+        }
+    }
+    return nullopt;
+}
+
+// a process serving its share of the partitions: MeetingNode(root, port, meetingDispatch)
+using MeetingNode = PartitionNode<MeetingPartition>;
+
+// MeetingService's calls across the nodes. It learns which partitions have rooms
+// from saveRoom(), which is idempotent: a router started over a running cluster
+// is given the room catalog again.
+class MeetingRouter {
+public:
+    explicit MeetingRouter(const vector<Peer>& nodes) : router_(nodes) {}
+
+    bool saveRoom(const Room& room) {
+        uint32_t p = partitionOf(room.id);
+        BinWriter w;
+        encodeRoom(w, room);
+        auto r = router_.call(p, uint8_t(MeetingRpc::SaveRoom), w.data());
+        if (!r || r->size() != 1 || !(*r)[0]) return false;
+        hasRooms_[p].store(true, memory_order_relaxed);
+        return true;
+    }
+
+    optional<string> bookMeeting(const Booking& req, string_view tenant = {}) {
+        BinWriter w;
+        encodeBooking(w, req);
+        w.putStr(tenant);
+        if (!req.roomId.empty())
+            return decodeId(router_.call(partitionOf(req.roomId), uint8_t(MeetingRpc::Book), w.data()));
+        optional<string> id;
+        forEachWithRooms(req.attendees.empty() ? tenant : string_view(req.attendees[0]), [&](uint32_t p) {
+            id = decodeId(router_.call(p, uint8_t(MeetingRpc::Book), w.data()));
+            return !id;
+        });
+        return id;
+    }
+
+    bool cancelMeeting(const string& id) {
+        BinWriter w;
+        w.putStr(id);
+        bool done = false;
+        forEachWithRooms(id, [&](uint32_t p) {
+            auto r = router_.call(p, uint8_t(MeetingRpc::Cancel), w.data());
+            done = r && r->size() == 1 && (*r)[0];
+            return !done;
+        });
+        return done;
+    }
+
+    NodeId leaderOf(const string& roomId) const { return router_.leaderOf(partitionOf(roomId)); }
+
+    // takes node n back after it failed over, as a follower (PartitionRouter::rejoin)
+    bool rejoin(NodeId n) { return router_.rejoin(n); }
+
+private:
+    // partitions that have rooms, from the one `key` picks on, until f returns false
+    template <class F>
+    void forEachWithRooms(string_view key, F&& f) {
+        uint32_t first = partitionOf(key);
+        for (uint32_t k = 0; k < kPartitions; ++k) {
+            uint32_t p = (first + k) % kPartitions;
+            if (hasRooms_[p].load(memory_order_relaxed) && !f(p)) return;
+        }
+    }
+
+    PartitionRouter router_;
+    array<atomic<bool>, kPartitions> hasRooms_{};
+};
+
+
+/*
+Benchmarks: `./meetingScheduler bench` (see benchHarness.h)
+
+    Sweeps room count × occupancy × threads over an 8-slot working day. Every config
+    gets a fresh fixture, so calendars start empty.
+    `./meetingScheduler load` replays a calendar trace instead, under a concurrency
+    checker (see Load replay).
+*/
+
+struct MeetingFixture {
+    static constexpr int kSlots = 8;   // one-hour slots per day
+
+    RoomRepository rr;
+    BookingRepository br;
+    SmallestFitStrategy strat;
+    MeetingService svc{rr, br, strat};
+    chrono::system_clock::time_point day0 = chrono::system_clock::from_time_t(1800000000);
+
+    MeetingFixture(int rooms, double occupancy) {
+        for (int i = 0; i < rooms; ++i)
+            rr.save(Room{"room-" + to_string(i), 2 + i % 19});
+        for (int i = 0; i < int(rooms * kSlots * occupancy); ++i)
+            svc.bookMeeting(request(i % kSlots, 2));
+    }
+
+    Booking request(int slot, int people) const {
+        Booking b;
+        b.start = day0 + chrono::hours(slot);
+        b.end = b.start + chrono::hours(1);
+        for (int p = 0; p < people; ++p) b.attendees.push_back("user" + to_string(p) + "@corp");
+        return b;
+    }
+};
+
+void runBenchmarks() {
+    Bench::printHeader();
+    for (int rooms : {100, 1000, 10000}) {
+        for (double occ : {0.0, 0.5, 0.9}) {
+            for (size_t threads : {1, 2, 4, 8}) {
+                MeetingFixture fx(rooms, occ);
+                vector<Booking> reqs;
+                for (int slot = 0; slot < MeetingFixture::kSlots; ++slot)
+                    reqs.push_back(fx.request(slot, 4));
+                auto req = [&](size_t t, size_t i) -> const Booking& {
+                    return reqs[(t * 7 + i) % reqs.size()];
+                };
+                vector<optional<string>> last(threads);
+                string params = "rooms=" + to_string(rooms) + " occ=" + to_string(int(occ * 100)) + "%";
+
+                Bench::print(Bench::run("bookMeeting", params, threads, 5000,
+                    [](size_t, size_t) {},
+                    [&](size_t t, size_t i) { last[t] = fx.svc.bookMeeting(req(t, i)); },
+                    [&](size_t t, size_t) { if (last[t]) fx.svc.cancelMeeting(*last[t]); }));
+                Bench::print(Bench::run("cancelMeeting", params, threads, 5000,
+                    [&](size_t t, size_t i) { last[t] = fx.svc.bookMeeting(req(t, i)); },
+                    [&](size_t t, size_t) { if (last[t]) fx.svc.cancelMeeting(*last[t]); },
+                    [](size_t, size_t) {}));
+                CalendarService cal(fx.br);
+                Bench::print(Bench::run("isFree", params, threads, 20000,
+                    [&](size_t t, size_t i) { cal.isFree(Handle((t * 131 + i) % rooms), req(t, i)); }));
+            }
+        }
+    }
+
+    // the book/cancel cycle again while a subscriber thread tails the change feed
+    for (size_t threads : {1, 4}) {
+        MeetingFixture fx(1000, 0.5);
+        vector<Booking> reqs;
+        for (int slot = 0; slot < MeetingFixture::kSlots; ++slot)
+            reqs.push_back(fx.request(slot, 4));
+        vector<optional<string>> last(threads);
+        auto reader = fx.svc.subscribe();
+        atomic<bool> done{false};
+        thread tail([&] {
+            while (!done.load(memory_order_relaxed))
+                if (!reader.poll([](const ChangeFeed::Event&) {})) this_thread::yield();
+        });
+        Bench::print(Bench::run("bookMeeting/tailed", "rooms=1000 occ=50%", threads, 5000,
+            [](size_t, size_t) {},
+            [&](size_t t, size_t i) { last[t] = fx.svc.bookMeeting(reqs[(t * 7 + i) % reqs.size()]); },
+            [&](size_t t, size_t) { if (last[t]) fx.svc.cancelMeeting(*last[t]); }));
+        done = true;
+        tail.join();
+    }
+}
+
+// imports: 100k explicit-room events (1000 rooms x 100 hourly slots) one call at a
+// time vs one bookMeetings() batch, and 52-week series through bookSeries()
+void runImportBenchmarks() {
+    constexpr int kRooms = 1000, kPerRoom = 100;
+    auto events = [](const MeetingFixture& fx) {
+        vector<Booking> res;
+        res.reserve(kRooms * kPerRoom);
+        for (int slot = 0; slot < kPerRoom; ++slot)
+            for (int room = 0; room < kRooms; ++room) {
+                Booking b = fx.request(0, 4);
+                b.roomId = "room-" + to_string(room);
+                b.start += chrono::hours(slot);
+                b.end += chrono::hours(slot);
+                res.push_back(move(b));
+            }
+        return res;
+    };
+    string params = "events=" + to_string(kRooms * kPerRoom) + " rooms=" + to_string(kRooms);
+    unique_ptr<MeetingFixture> fx;
+    vector<Booking> reqs;
+    auto fresh = [&](size_t, size_t) {
+        fx = make_unique<MeetingFixture>(kRooms, 0.0);
+        reqs = events(*fx);
+    };
+    Bench::print(Bench::run("import/bookMeeting", params, 1, 1, fresh,
+        [&](size_t, size_t) { for (auto& r : reqs) fx->svc.bookMeeting(r); },
+        [](size_t, size_t) {}));
+    Bench::print(Bench::run("import/bookMeetings", params, 1, 1, fresh,
+        [&](size_t, size_t) { fx->svc.bookMeetings(reqs); },
+        [](size_t, size_t) {}));
+
+    fx = make_unique<MeetingFixture>(kRooms, 0.0);
+    Recurrence weekly;
+    weekly.count = 52;
+    Bench::print(Bench::run("bookSeries", "weeks=52 rooms=1000", 1, 500,
+        [&](size_t, size_t i) { fx->svc.bookSeries(fx->request(int(i % 8), 2 + int(i % 11)), weekly); }));
+}
+
+// durable mode: every book (timed) and cancel (untimed) waits for its fsync,
+// so throughput across threads shows how far group commit amortises it
+void runDurabilityBenchmarks() {
+    const string dir = (filesystem::temp_directory_path() / "meetingScheduler-bench-wal").string();
+    filesystem::remove_all(dir);
+    {
+        WriteAheadLog log(dir);
+        RoomRepository rr;
+        BookingRepository br;
+        SmallestFitStrategy strat;
+        MeetingService svc(rr, br, strat, &log);
+        for (int i = 0; i < 1000; ++i) rr.save(Room{"room-" + to_string(i), 2 + i % 19});
+        auto day0 = chrono::system_clock::from_time_t(1800000000);
+        for (size_t threads : {1, 2, 4, 8}) {
+            vector<optional<string>> last(threads);
+            Bench::print(Bench::run("bookMeeting+wal", "rooms=1000 occ=0%", threads, 2000,
+                [](size_t, size_t) {},
+                [&](size_t t, size_t i) {
+                    Booking b;
+                    b.start = day0 + chrono::hours((t * 7 + i) % 8);
+                    b.end = b.start + chrono::hours(1);
+                    b.attendees = {"a@corp", "b@corp", "c@corp", "d@corp"};
+                    last[t] = svc.bookMeeting(b);
+                },
+                [&](size_t t, size_t) { if (last[t]) svc.cancelMeeting(*last[t]); }));
+        }
+    }
+    filesystem::remove_all(dir);
+}
+
+// `./meetingScheduler cluster`: three nodes in this process, a router in front,
+// and the leader of a booked room's partition going away
+void runClusterDemo() {
+    const string root = (filesystem::temp_directory_path() / "meetingScheduler-cluster").string();
+    filesystem::remove_all(root);
+    vector<unique_ptr<MeetingNode>> nodes;
+    vector<Peer> peers;
+    for (int i = 0; i < 3; ++i) {
+        nodes.push_back(make_unique<MeetingNode>(root + "/node" + to_string(i), 0, meetingDispatch));
+        peers.push_back(Peer{"localhost", nodes.back()->port()});
+    }
+    MeetingRouter router(peers);
+    for (int i = 0; i < 6; ++i) router.saveRoom(Room{"room-" + to_string(i), 4 + 2 * i});
+
+    Booking req;
+    req.roomId = "room-3";
+    req.start = chrono::system_clock::now() + chrono::hours(1);
+    req.end = req.start + chrono::minutes(30);
+    req.attendees = {"a@corp", "b@corp"};
+    auto id = router.bookMeeting(req);
+    if (!id) {
+        cout << "Cluster did not take the booking\n";
+        return;
+    }
+    NodeId leader = router.leaderOf(req.roomId);
+    cout << "Booked meeting " << *id << " in room-3, led by node " << leader << "\n";
+
+    // replication is asynchronous: let the follower catch up before pulling the plug
+    for (int i = 0; i < 200 && nodes[leader]->lag(partitionOf(req.roomId)); ++i)
+        this_thread::sleep_for(chrono::milliseconds(10));
+    nodes[leader].reset();
+
+    bool cancelled = router.cancelMeeting(*id);
+    cout << "Node " << leader << " down; room-3 now led by node " << router.leaderOf(req.roomId)
+         << ", meeting " << (cancelled ? "cancelled" : "lost") << "\n";
+    req.roomId.clear();
+    auto any = router.bookMeeting(req);
+    cout << (any ? "Booked meeting " + *any + " in some room" : string("No room free!")) << "\n";
+    nodes.clear();
+    filesystem::remove_all(root);
+}
+
+/*
+Load replay: `./meetingScheduler load [trace=<file>] [threads=4] [rate=<ops/s>]
+    [speed=1] [ops=100000] [seed=1] [emit=<file>]` (see loadGen.h)
+
+    Replays a calendar trace against one MeetingService and checks, while it runs,
+    that no room is ever booked twice over. Without trace= it generates a seeded
+    ten-second burst of a week's bookings, half of them piling onto four popular
+    hours a day, with about one in seven cancelled later (emit= writes it out).
+    Trace format, one entry per line, `#` comments:
+        room <id> <capacity>
+        <ms> book <tag> <startMinute> <minutes> <attendees>   minutes from the trace's day 0
+        <ms> cancel <tag>                                     the booking `tag` made, if any
+    The checker tails the change feed: events are published under the room's
+    stripe lock, so per room feed order is commit order and a Booked event
+    overlapping a live booking of its room is a double booking. At the end the
+    live set must match the bookings the workers still hold. Exit status 1 on
+    any violation.
+*/
+
+struct MeetingTrace {
+    struct Op {
+        bool book;
+        uint32_t tag;          // index into tags
+        int32_t startMinute;
+        uint16_t minutes, attendees;
+    };
+    vector<Room> rooms;
+    vector<string> tags;
+    vector<Op> ops;
+    vector<LoadOp> schedule;   // parallel to ops, keyed by tag
+};
+
+optional<MeetingTrace> readMeetingTrace(istream& in) {
+    MeetingTrace t;
+    unordered_map<string, uint32_t> tagIdx;
+    string line;
+    for (size_t n = 1; getline(in, line); ++n) {
+        istringstream ls(line.substr(0, line.find('#')));
+        string first, verb, tag;
+        if (!(ls >> first)) continue;
+        bool ok = false;
+        if (first == "room") {
+            Room r;
+            ok = bool(ls >> r.id >> r.capacity) && r.capacity > 0;
+            if (ok) t.rooms.push_back(r);
+        } else {
+            uint64_t ms = 0;
+            MeetingTrace::Op op{};
+            ok = bool(istringstream(first) >> ms) && bool(ls >> verb >> tag);
+            op.book = verb == "book";
+            if (ok && op.book) ok = bool(ls >> op.startMinute >> op.minutes >> op.attendees) && op.minutes > 0;
+            else if (ok) ok = verb == "cancel";
+            if (ok) {
+                auto [it, fresh] = tagIdx.try_emplace(tag, uint32_t(t.tags.size()));
+                if (fresh) t.tags.push_back(tag);
+                op.tag = it->second;
+                t.ops.push_back(op);
+                t.schedule.push_back({ms * 1000000, loadKey(tag)});
+            }
+        }
+        if (!ok) {
+            cerr << "trace line " << n << ": cannot parse '" << line << "'\n";
+            return nullopt;
+        }
+    }
+    return t;
+}
+
+void writeMeetingTrace(ostream& out, const MeetingTrace& t) {
+    for (auto& r : t.rooms) out << "room " << r.id << ' ' << r.capacity << '\n';
+    for (size_t i = 0; i < t.ops.size(); ++i) {
+        auto& op = t.ops[i];
+        out << t.schedule[i].atNs / 1000000 << (op.book ? " book " : " cancel ") << t.tags[op.tag];
+        if (op.book) out << ' ' << op.startMinute << ' ' << op.minutes << ' ' << op.attendees;
+        out << '\n';
+    }
+}
+
+// 1000 rooms of 2..20 seats and five 9:00-19:00 days in half-hour starts; half
+// the bookings want 10, 11, 14 or 15 o'clock, so those slots fill and most
+// later requests for them are refused by saturated() without a lock
+MeetingTrace syntheticMeetingTrace(size_t ops, uint64_t seed) {
+    constexpr double kTraceMs = 10000;
+    mt19937_64 rng(seed);
+    MeetingTrace t;
+    for (int i = 0; i < 1000; ++i) t.rooms.push_back(Room{"room-" + to_string(i), 2 + i % 19});
+    uniform_real_distribution<double> when(0, kTraceMs), coin(0, 1);
+    exponential_distribution<double> extra(1.0 / 3);
+    const int hot[] = {10, 11, 14, 15};
+    vector<pair<double, MeetingTrace::Op>> timed;
+    while (timed.size() < ops) {
+        int day = int(rng() % 5);
+        int hour = coin(rng) < 0.5 ? hot[rng() % 4] : 9 + int(rng() % 10);
+        int half = coin(rng) < 0.5 ? 30 : 0;
+        MeetingTrace::Op op{true, uint32_t(t.tags.size()), day * 24 * 60 + hour * 60 + half,
+                            uint16_t(coin(rng) < 0.7 ? 30 : 60),
+                            uint16_t(min(2 + int(extra(rng)), 18))};
+        t.tags.push_back("m" + to_string(op.tag));
+        double at = when(rng);
+        timed.push_back({at, op});
+        if (coin(rng) < 0.15 && timed.size() < ops) {
+            op.book = false;
+            timed.push_back({at + coin(rng) * (kTraceMs - at), op});
+        }
+    }
+    stable_sort(timed.begin(), timed.end(), [](auto& a, auto& b) { return a.first < b.first; });
+    for (auto& [at, op] : timed) {
+        t.ops.push_back(op);
+        t.schedule.push_back({uint64_t(at * 1e6), loadKey(t.tags[op.tag])});
+    }
+    return t;
+}
+
+// tails the service's feed on its own thread and keeps a shadow calendar per
+// room; a booking overlapping a live one in its room is a violation
+class MeetingChecker {
+public:
+    explicit MeetingChecker(MeetingService& svc) : reader_(svc.subscribe()) {
+        thread_ = thread([this] {
+            while (!stop_.load(memory_order_acquire))
+                if (!drain()) this_thread::yield();
+            drain();
+        });
+    }
+
+    // stops tailing and compares the shadow with the bookings the workers hold
+    void finish(const vector<string>& held) {
+        stop_.store(true, memory_order_release);
+        thread_.join();
+        if (reader_.lost()) return;   // shadow incomplete: reported by print()
+        size_t n = 0;
+        for (auto& id : held) {
+            if (id.empty()) continue;
+            ++n;
+            if (!roomOf_.count(id)) violation("booking " + id + " held but not live in the feed");
+        }
+        if (n != roomOf_.size())
+            violation("feed shows " + to_string(roomOf_.size()) + " live bookings, workers " + to_string(n));
+    }
+
+    // prints the verdict; true when nothing was violated
+    bool print() const {
+        printf("checker: %llu feed events, %zu violations", (unsigned long long)events_, violations_);
+        if (reader_.lost())
+            printf(", %llu events lost (checker fell behind; unchecked after the gap)",
+                   (unsigned long long)reader_.lost());
+        printf("\n");
+        for (auto& v : firstViolations_) printf("  %s\n", v.c_str());
+        return violations_ == 0;
+    }
+
+private:
+    size_t drain() {
+        size_t n = reader_.poll([&](const ChangeFeed::Event& e) {
+            if (!reader_.lost()) apply(BookingEvent(e.type), e.as<BookingChange>());
+        });
+        events_ += n;
+        return n;
+    }
+
+    void apply(BookingEvent ev, const BookingChange& c) {
+        string id(c.bookingId()), room(c.roomId());
+        auto& cal = calendar_[room];   // start -> (end, id)
+        if (ev == BookingEvent::Booked) {
+            auto next = cal.lower_bound(c.start);
+            if (next != cal.end() && next->first < c.end)
+                violation(room + ": " + id + " overlaps " + next->second.second);
+            if (next != cal.begin() && prev(next)->second.first > c.start)
+                violation(room + ": " + id + " overlaps " + prev(next)->second.second);
+            if (!roomOf_.emplace(id, room).second) violation("booking " + id + " booked twice");
+            cal[c.start] = {c.end, id};
+            return;
+        }
+        auto it = cal.find(c.start);
+        if (it == cal.end() || it->second.second != id) violation(room + ": " + id + " cancelled but not live");
+        else cal.erase(it);
+        roomOf_.erase(id);
+    }
+
+    void violation(string what) {
+        if (violations_++ < 10) firstViolations_.push_back(move(what));
+    }
+
+    ChangeFeed::Reader reader_;
+    unordered_map<string, map<int64_t, pair<int64_t, string>>> calendar_;
+    unordered_map<string, string> roomOf_;   // live booking -> room
+    uint64_t events_ = 0;
+    size_t violations_ = 0;
+    vector<string> firstViolations_;
+    atomic<bool> stop_{false};
+    thread thread_;
+};
+
+int runLoad(int argc, char** argv) {
+    auto opts = loadOptions(argc, argv);
+    if (!opts) return 2;
+    optional<MeetingTrace> trace;
+    if (auto file = loadArg(argc, argv, "trace")) {
+        ifstream in(*file);
+        if (!in) {
+            cerr << "cannot open " << *file << "\n";
+            return 2;
+        }
+        trace = readMeetingTrace(in);
+        if (!trace) return 2;
+    } else {
+        auto ops = loadNum<size_t>(argc, argv, "ops", 100000);
+        auto seed = loadNum<uint64_t>(argc, argv, "seed", 1);
+        if (!ops || !seed) return 2;
+        trace = syntheticMeetingTrace(*ops, *seed);
+    }
+    if (auto file = loadArg(argc, argv, "emit")) {
+        ofstream out(*file);
+        writeMeetingTrace(out, *trace);
+    }
+
+    RoomRepository rooms;
+    BookingRepository bookings;
+    SmallestFitStrategy strat;
+    MeetingService svc(rooms, bookings, strat);
+    for (auto& r : trace->rooms) rooms.save(r);
+    vector<string> people;
+    for (int i = 0; i < 64; ++i) people.push_back("user" + to_string(i) + "@corp");
+    auto day0 = chrono::system_clock::from_time_t(1800000000);
+    printf("replaying %zu ops over %zu rooms on %zu threads\n", trace->ops.size(), trace->rooms.size(), opts->threads);
+
+    // a tag's ops all run on one worker, so its slot here is only ever touched by that worker
+    vector<string> held(trace->tags.size());
+    MeetingChecker checker(svc);
+    auto report = LoadGen::run(trace->schedule, *opts, [&](size_t, size_t i) {
+        auto& op = trace->ops[i];
+        string& id = held[op.tag];
+        if (!op.book) {
+            if (id.empty() || !svc.cancelMeeting(id)) return false;
+            id.clear();
+            return true;
+        }
+        Booking req;
+        req.start = day0 + chrono::minutes(op.startMinute);
+        req.end = req.start + chrono::minutes(op.minutes);
+        for (size_t p = 0; p < op.attendees; ++p) req.attendees.push_back(people[(op.tag + p) % people.size()]);
+        auto booked = svc.bookMeeting(req);
+        if (!booked) return false;
+        id = *booked;
+        return true;
+    });
+    checker.finish(held);
+    LoadGen::print(report, opts->interval);
+    return checker.print() ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        runBenchmarks();
+        runImportBenchmarks();
+        runDurabilityBenchmarks();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "cluster") {
+        runClusterDemo();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "load") return runLoad(argc, argv);
+
+    // example usage
+    RoomRepository rooms;
+    BookingRepository bookings;
+    SmallestFitStrategy strat;
+    MeetingService svc(rooms, bookings, strat);
+    rooms.save(Room{"focus-1", 4});
+    rooms.save(Room{"board-1", 12});
+
+    auto start = chrono::system_clock::now() + chrono::hours(1);
+    Booking req;
+    req.start = start;
+    req.end = start + chrono::minutes(30);
+    req.attendees = {"a@corp", "b@corp"};
+    auto id = svc.bookMeeting(req);
+    if (id) cout << "Booked meeting " << *id << "\n";
+    else    cout << "No room free!\n";
+    if (id) svc.cancelMeeting(*id);
+
+    // `./meetingScheduler metrics`: what a Prometheus scrape of this process would see
+    if (argc > 1 && string(argv[1]) == "metrics") cout << metrics::scrape();
+    return 0;
+}
@@ -0,0 +1,409 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+/*
+ Metrics: per-thread latency histograms and counters, scrape-time gauges, and
+ a Prometheus text exposition of all of it (metrics::scrape()).
+
+ Every thread records into its own block of cells with a relaxed load + store
+ (one writer per cell, no RMW, no shared cache line); scrape() sums the blocks
+ of all threads. When a thread exits its block is handed to the next new
+ thread, so totals survive and memory is bounded by the peak thread count.
+
+ Histograms are HDR-style log-linear over nanoseconds: 16 sub-buckets per power
+ of two, exact below 32ns and within 6.25% above, up to ~9 min. A Timer can
+ sample one call in `every` per thread and weight it by `every`: the path pays
+ for two clock reads only that often and the counts stay unbiased.
+
+ lock(m, probe) tries the lock first; only a failed try counts a contention and
+ times the wait, so an uncontended acquire costs what it did before.
+
+ Build with -DLLD_NO_METRICS and every probe compiles to nothing; scrape() is empty.
+*/
+
+namespace metrics {
+
+// Prometheus text builder handed to collectors; HELP/TYPE once per family
+class Exposition {
+public:
+  void family(const std::string& name, const char* type, const std::string& help) {
+    if (std::find(seen_.begin(), seen_.end(), name) != seen_.end()) return;
+    seen_.push_back(name);
+    out_ += "# HELP " + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+  }
+  // labels without braces, e.g. lot="a",type="Compact"
+  void sample(const std::string& name, const std::string& labels, double v) {
+    char num[32];
+    if (v == double(uint64_t(v)) && v < 9007199254740992.0) std::snprintf(num, sizeof num, "%.0f", v);
+    else std::snprintf(num, sizeof num, "%.9g", v);
+    out_ += name;
+    if (!labels.empty()) out_ += "{" + labels + "}";
+    out_ += " ";
+    out_ += num;
+    out_ += "\n";
+  }
+  const std::string& str() const { return out_; }
+
+private:
+  std::string out_;
+  std::vector<std::string> seen_;
+};
+
+#ifndef LLD_NO_METRICS
+
+class Registry {
+public:
+  enum class Kind { Counter, Histogram };
+
+  static Registry& global() {
+    static Registry r;
+    return r;
+  }
+
+  // reserves `cells` consecutive per-thread cells for one metric
+  size_t add(Kind kind, std::string name, std::string help, std::string labels, size_t cells) {
+    std::lock_guard lock(mtx_);
+    size_t base = next_;
+    next_ += cells;
+    families_.push_back(Family{kind, std::move(name), std::move(help), std::move(labels), base});
+    return base;
+  }
+
+  // owner side: this thread's cell i (allocated on first touch)
+  std::atomic<uint64_t>& cell(size_t i) {
+    thread_local Block* b = nullptr;
+    if (!b) b = attach();
+    return b->at(i);
+  }
+
+  // single writer per cell, so a plain load + store is an exact add
+  void bump(size_t i, uint64_t n) {
+    auto& c = cell(i);
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  // scrape side: cell i summed over every thread's block
+  uint64_t sum(size_t i) const {
+    std::lock_guard lock(mtx_);
+    return sumLocked(i);
+  }
+
+  void addCollector(const std::function<void(Exposition&)>* f) {
+    std::lock_guard lock(collectorsMtx_);
+    collectors_.push_back(f);
+  }
+  // blocks until a scrape in progress is done with f
+  void removeCollector(const std::function<void(Exposition&)>* f) {
+    std::lock_guard lock(collectorsMtx_);
+    collectors_.erase(std::find(collectors_.begin(), collectors_.end(), f));
+  }
+
+  std::string scrape();
+
+  static constexpr size_t kHistogramBuckets = (39 - 2) * 16;   // see Histogram::bucketOf
+
+private:
+  static constexpr size_t kPageCells = 1024, kMaxPages = 256;   // 256k cells per thread
+
+  struct Block {
+    std::atomic<std::atomic<uint64_t>*> pages[kMaxPages] = {};
+    std::atomic<bool> used{true};
+
+    ~Block() {
+      for (auto& p : pages) delete[] p.load();
+    }
+    std::atomic<uint64_t>& at(size_t i) {
+      auto* p = pages[i / kPageCells].load(std::memory_order_acquire);
+      if (!p) {   // only the owner allocates; scrapers read a missing page as zeros
+        p = new std::atomic<uint64_t>[kPageCells]();
+        pages[i / kPageCells].store(p, std::memory_order_release);
+      }
+      return p[i % kPageCells];
+    }
+    uint64_t read(size_t i) const {
+      auto* p = pages[i / kPageCells].load(std::memory_order_acquire);
+      return p ? p[i % kPageCells].load(std::memory_order_relaxed) : 0;
+    }
+  };
+
+  struct Family {
+    Kind kind;
+    std::string name, help, labels;
+    size_t base;
+  };
+
+  // returns the block at thread exit; its counts stay in the totals
+  struct Guard {
+    Block* b = nullptr;
+    ~Guard() { if (b) b->used.store(false, std::memory_order_release); }
+  };
+
+  Block* attach() {
+    thread_local Guard g;
+    std::lock_guard lock(mtx_);
+    for (auto& b : blocks_) {
+      bool expected = false;
+      if (b->used.compare_exchange_strong(expected, true)) return g.b = b.get();
+    }
+    blocks_.push_back(std::make_unique<Block>());
+    return g.b = blocks_.back().get();
+  }
+
+  uint64_t sumLocked(size_t i) const {
+    uint64_t n = 0;
+    for (auto& b : blocks_) n += b->read(i);
+    return n;
+  }
+
+  void exposeHistogram(Exposition& e, const Family& f) const;
+
+  mutable std::mutex mtx_;   // families_, blocks_ (the list, not the cells)
+  size_t next_ = 0;
+  std::vector<Family> families_;
+  std::vector<std::unique_ptr<Block>> blocks_;
+
+  std::mutex collectorsMtx_;   // separate: collectors may read metrics
+  std::vector<const std::function<void(Exposition&)>*> collectors_;
+};
+
+class Counter {
+public:
+  Counter(std::string name, std::string help, std::string labels = "")
+    : cell_(Registry::global().add(Registry::Kind::Counter, std::move(name), std::move(help),
+                                   std::move(labels), 1)) {}
+  void inc(uint64_t n = 1) { Registry::global().bump(cell_, n); }
+  uint64_t value() const { return Registry::global().sum(cell_); }
+
+private:
+  size_t cell_;
+};
+
+class Histogram {
+public:
+  static constexpr size_t kSubBits = 4, kSub = 1 << kSubBits;
+  static constexpr unsigned kMaxExp = 39;   // 2^39 ns ~ 9 min; larger values clamp
+  static constexpr size_t kBuckets = Registry::kHistogramBuckets;
+  static_assert(kBuckets == (kMaxExp - 2) * kSub, "bucket layout");
+
+  // cells: kBuckets counts, then the sum in ns, then this thread's sample countdown
+  Histogram(std::string name, std::string help, std::string labels = "")
+    : base_(Registry::global().add(Registry::Kind::Histogram, std::move(name), std::move(help),
+                                   std::move(labels), kBuckets + 2)) {}
+
+  static size_t bucketOf(uint64_t ns) {
+    if (ns < kSub) return ns;
+    unsigned e = 63 - __builtin_clzll(ns);
+    if (e > kMaxExp) return kBuckets - 1;
+    return (e - kSubBits + 1) * kSub + ((ns >> (e - kSubBits)) & (kSub - 1));
+  }
+  static uint64_t lowerBound(size_t b) {
+    if (b < kSub) return b;
+    unsigned e = unsigned(b / kSub) + kSubBits - 1;
+    return uint64_t(kSub + b % kSub) << (e - kSubBits);
+  }
+
+  void record(uint64_t ns, uint64_t weight = 1) {
+    auto& r = Registry::global();
+    r.bump(base_ + bucketOf(ns), weight);
+    r.bump(base_ + kBuckets, ns * weight);
+  }
+
+  // true once every `every` calls on this thread
+  bool sample(uint32_t every) {
+    if (every <= 1) return true;
+    auto& c = Registry::global().cell(base_ + kBuckets + 1);
+    uint64_t left = c.load(std::memory_order_relaxed);
+    c.store(left ? left - 1 : every - 1, std::memory_order_relaxed);
+    return left == 0;
+  }
+
+  struct Snapshot {
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0, sumNs = 0;
+
+    // lower bound of the bucket holding the q-quantile (0 when empty)
+    uint64_t quantile(double q) const {
+      uint64_t rank = uint64_t(q * double(count)), seen = 0;
+      for (size_t b = 0; b < buckets.size(); ++b)
+        if ((seen += buckets[b]) > rank) return lowerBound(b);
+      return count ? lowerBound(buckets.size() - 1) : 0;
+    }
+  };
+
+  Snapshot snapshot() const {
+    Snapshot s;
+    s.buckets.resize(kBuckets);
+    auto& r = Registry::global();
+    for (size_t b = 0; b < kBuckets; ++b) s.count += s.buckets[b] = r.sum(base_ + b);
+    s.sumNs = r.sum(base_ + kBuckets);
+    return s;
+  }
+
+private:
+  size_t base_;
+};
+
+// times its scope into h, sampling one scope in `every` per thread
+class Timer {
+public:
+  explicit Timer(Histogram& h, uint32_t every = 1)
+    : h_(h), every_(every), on_(h.sample(every)) {
+    if (on_) t0_ = std::chrono::steady_clock::now();
+  }
+  ~Timer() {
+    if (on_)
+      h_.record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - t0_).count()), every_);
+  }
+  Timer(const Timer&) = delete;
+  Timer& operator=(const Timer&) = delete;
+
+private:
+  Histogram& h_;
+  uint32_t every_;
+  bool on_;
+  std::chrono::steady_clock::time_point t0_;
+};
+
+// contention of one lock (or lock family, e.g. a StripedLock): how often a
+// thread had to wait, and for how long
+struct LockProbe {
+  explicit LockProbe(const std::string& name, const std::string& what)
+    : contended(name + "_contended_total", "acquisitions of " + what + " that had to wait"),
+      wait(name + "_wait_seconds", "time spent waiting for " + what) {}
+  Counter contended;
+  Histogram wait;
+};
+
+template <class Mutex>
+std::unique_lock<Mutex> lock(Mutex& m, LockProbe& p) {
+  std::unique_lock<Mutex> l(m, std::try_to_lock);
+  if (!l.owns_lock()) {
+    p.contended.inc();
+    Timer t(p.wait);
+    l.lock();
+  }
+  return l;
+}
+
+template <class Mutex>
+std::shared_lock<Mutex> lockShared(Mutex& m, LockProbe& p) {
+  std::shared_lock<Mutex> l(m, std::try_to_lock);
+  if (!l.owns_lock()) {
+    p.contended.inc();
+    Timer t(p.wait);
+    l.lock();
+  }
+  return l;
+}
+
+// scrape-time hook for gauges (occupancy, queue depth): registered for the
+// lifetime of the object, so make it the last member of whatever it reads
+class Collector {
+public:
+  explicit Collector(std::function<void(Exposition&)> f) : f_(std::move(f)) {
+    Registry::global().addCollector(&f_);
+  }
+  ~Collector() { Registry::global().removeCollector(&f_); }
+  Collector(const Collector&) = delete;
+  Collector& operator=(const Collector&) = delete;
+
+private:
+  std::function<void(Exposition&)> f_;
+};
+
+inline void Registry::exposeHistogram(Exposition& e, const Family& f) const {
+  e.family(f.name, "histogram", f.help);
+  std::string pre = f.labels.empty() ? "" : f.labels + ",";
+  // one line per power of two from 32ns: those are exact bucket boundaries
+  uint64_t cum = 0;
+  size_t b = 0;
+  for (unsigned k = 5; k <= Histogram::kMaxExp; ++k) {
+    size_t edge = Histogram::bucketOf(uint64_t(1) << k);
+    for (; b < edge; ++b) cum += sumLocked(f.base + b);
+    char le[32];
+    std::snprintf(le, sizeof le, "%.9g", double(uint64_t(1) << k) * 1e-9);
+    e.sample(f.name + "_bucket", pre + "le=\"" + le + "\"", double(cum));
+  }
+  for (; b < Histogram::kBuckets; ++b) cum += sumLocked(f.base + b);
+  e.sample(f.name + "_bucket", pre + "le=\"+Inf\"", double(cum));
+  e.sample(f.name + "_sum", f.labels, double(sumLocked(f.base + Histogram::kBuckets)) * 1e-9);
+  e.sample(f.name + "_count", f.labels, double(cum));
+}
+
+inline std::string Registry::scrape() {
+  Exposition e;
+  {
+    std::lock_guard lock(mtx_);
+    for (auto& f : families_) {
+      if (f.kind == Kind::Histogram) {
+        exposeHistogram(e, f);
+      } else {
+        e.family(f.name, "counter", f.help);
+        e.sample(f.name, f.labels, double(sumLocked(f.base)));
+      }
+    }
+  }
+  std::lock_guard lock(collectorsMtx_);
+  for (auto* c : collectors_) (*c)(e);
+  return e.str();
+}
+
+inline std::string scrape() { return Registry::global().scrape(); }
+
+#else   // LLD_NO_METRICS: same API, nothing recorded
+
+class Counter {
+public:
+  Counter(const char*, const char*, const char* = "") {}
+  void inc(uint64_t = 1) {}
+  uint64_t value() const { return 0; }
+};
+
+class Histogram {
+public:
+  Histogram(const char*, const char*, const char* = "") {}
+  void record(uint64_t, uint64_t = 1) {}
+  struct Snapshot {
+    uint64_t count = 0, sumNs = 0;
+    uint64_t quantile(double) const { return 0; }
+  };
+  Snapshot snapshot() const { return {}; }
+};
+
+class Timer {
+public:
+  explicit Timer(Histogram&, uint32_t = 1) {}
+};
+
+struct LockProbe {
+  LockProbe(const char*, const char*) {}
+};
+
+template <class Mutex>
+std::unique_lock<Mutex> lock(Mutex& m, LockProbe&) { return std::unique_lock<Mutex>(m); }
+
+template <class Mutex>
+std::shared_lock<Mutex> lockShared(Mutex& m, LockProbe&) { return std::shared_lock<Mutex>(m); }
+
+class Collector {
+public:
+  template <class F>
+  explicit Collector(F&&) {}
+};
+
+inline std::string scrape() { return ""; }
+
+#endif
+
+}  // namespace metrics
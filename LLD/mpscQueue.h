@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+/*
+ MpscQueue: bounded lock-free queue, many producers / one consumer.
+
+ Ring of cells, each tagged with a sequence number (Vyukov's bounded queue).
+ A producer claims a slot with one CAS on tail_ and publishes by bumping the
+ cell's sequence; the single consumer needs no RMW at all. tryPush() fails
+ instead of blocking when the ring is full, so callers choose their own
+ backpressure policy (drop and count, retry, or shed load upstream).
+*/
+
+template <class T>
+class MpscQueue {
+public:
+  explicit MpscQueue(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity) n *= 2;
+    mask_ = n - 1;
+    cells_ = std::make_unique<Cell[]>(n);
+    for (size_t i = 0; i < n; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  bool tryPush(T v) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& c = cells_[pos & mask_];
+      size_t seq = c.seq.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          c.value = std::move(v);
+          c.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;   // full
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // consumer side only
+  std::optional<T> tryPop() {
+    Cell& c = cells_[head_ & mask_];
+    if (c.seq.load(std::memory_order_acquire) != head_ + 1) return std::nullopt;
+    std::optional<T> v(std::move(c.value));
+    c.seq.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+    return v;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> tail_{0};
+  alignas(64) size_t head_ = 0;
+};
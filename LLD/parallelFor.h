@@ -0,0 +1,36 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/*
+ parallelFor: fork-join over [0, n) for bulk construction work.
+
+ Splits the range into one contiguous chunk per hardware thread, runs chunk 0
+ on the caller and the rest on short-lived std::threads, and joins before
+ returning, so everything f wrote is visible afterwards. Meant for rare bulk
+ jobs (building a lot), not hot paths: thread start-up is ~10us, so small
+ ranges (< minPerThread items per thread) simply run inline. f(i) must only
+ touch state owned by index i or be internally synchronised.
+*/
+
+template <class F>
+void parallelFor(size_t n, F&& f, size_t minPerThread = 1) {
+  size_t hw = std::max<size_t>(1, std::thread::hardware_concurrency());
+  size_t workers = std::min(hw, std::max<size_t>(1, n / std::max<size_t>(1, minPerThread)));
+  if (workers <= 1) {
+    for (size_t i = 0; i < n; ++i) f(i);
+    return;
+  }
+  size_t chunk = (n + workers - 1) / workers;
+  auto run = [&](size_t w) {
+    size_t end = std::min(n, (w + 1) * chunk);
+    for (size_t i = w * chunk; i < end; ++i) f(i);
+  };
+  std::vector<std::thread> ts;
+  ts.reserve(workers - 1);
+  for (size_t w = 1; w < workers; ++w) ts.emplace_back(run, w);
+  run(0);
+  for (auto& t : ts) t.join();
+}
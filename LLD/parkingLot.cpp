@@ -2,299 +2,2807 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <mutex>
 #include <shared_mutex>
 #include <optional>
 #include <chrono>
-#include <uuid/uuid.h>
+#include <atomic>
+#include <memory>
+#include <array>
+#include <filesystem>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <unordered_set>
+#include "interner.h"
+#include "idGenerator.h"
+#include "stripedHashMap.h"
+#include "epoch.h"
+#include "writeAheadLog.h"
+#include "benchHarness.h"
+#include "parallelFor.h"
+#include "metrics.h"
+#include "changeFeed.h"
+#include "sessionArchive.h"
+#include "timeline.h"
+#include "timerWheel.h"
+#include "admission.h"
+#include "partition.h"
+#include "loadGen.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 using namespace std;
 
 /*
  1) APIs: (All APIs are thread-safe and can be called directly by clients)
-    - createParkingLot(levels, spotsPerLevel, spotTypeCounts) -> ParkingLotId
-    - parkVehicle(vehicleId, vehicleType) -> optional<ParkingSpotId>
-    - leaveVehicle(vehicleId) -> bool
-    - getAvailableSpots(vehicleType) -> List<ParkingSpotId>
+    - createParkingLot(levels, spotsPerLevel, spotTypeCounts, mode = Pooled, fees = {}, lotId = new) -> optional<ParkingLotId>
+    - parkVehicle(lotId, vehicleId, vehicleType, entranceLevel = 1) -> optional<BookingId>
+      (none when full, already parked, or turned away by the gate's admission policy)
+    - leaveVehicle(lotId, vehicleId) -> bool
+    - checkout(lotId, vehicleId) -> optional<Receipt> (leaveVehicle, handing back the priced stay)
+    - getAvailableSpots(lotId, vehicleType) -> List<ParkingSpotId>
+    - getAvailableSpots(lotId, vehicleType, cursor, limit) -> SpotPage (one page of IDs + next cursor)
+    - getAvailabilityCounts(lotId) -> optional<AvailabilityCounts> (free spots per floor and SpotType)
+    - reserveSpot(lotId, vehicleId, vehicleType, start, end) -> optional<ReservationId>
+    - parkReserved(lotId, reservationId) -> optional<BookingId> (arrival on a pre-booked spot)
+    - cancelReservation(lotId, reservationId) -> bool
+    - advanceTimers(now) -> fires due reservation holds, no-shows and overstay alerts (about once a second)
+    - quoteFee(lotId, vehicleId) -> optional<cents> (what leaving now would cost)
+    - billingReport(lotId, from, to) -> optional<BillingReport> (sessions, revenue, occupancy per SpotType)
+    - flushBilling(dir) -> bool: append every lot's unflushed billing history to <dir>/<lotId>.billing
+      (with a WAL, only into the log's own directory)
+    - recover(dir) / checkpoint(dir) -> restore from / compact the write-ahead log (section 3c)
+    - metrics::scrape() -> Prometheus text for every probe below (section 2b)
+    - subscribe(lotId, fromOldest = false) -> optional<ChangeFeed::Reader> (Parked/Left/Overstay events of one lot)
+    - spotIdAt(lotId, spot) -> optional<ParkingSpotId> (a SpotChange's spot index as an ID)
+    - ParkingRouter: createParkingLot / parkVehicle / leaveVehicle across ParkingNodes (section 4b)
 */
 
 /*
  2) Data Models: how things are stored
+    External IDs are strings; internally every entity is addressed by a dense
+    Handle (see interner.h) that indexes the flat repository vectors below.
+*/
+
+// static descriptions
+struct ParkingFloor {
+  string id;
+  Handle lot;
+  int level;
+};
+
+enum class VehicleType { Motorcycle, Car, Truck };
+constexpr int kNumVehicleTypes = 3;
+
+enum class SpotType { Motorcycle, Compact, Large };
+constexpr int kNumSpotTypes = 3;
+
+// a lot's tariff, fixed at creation and logged with the lot. A stay is billed
+// per started step at the SpotType's hourly rate, free within the grace
+// period, and each started 24h costs at most dailyCapCents (0: no cap).
+struct FeeSchedule {
+  array<int64_t, kNumSpotTypes> centsPerHour{100, 200, 400};
+  int64_t graceMinutes = 10;
+  int64_t stepMinutes = 15;
+  int64_t dailyCapCents = 0;
+
+  int64_t fee(SpotType t, chrono::nanoseconds stay) const {
+    if (stay <= chrono::minutes(graceMinutes)) return 0;
+    int64_t step = max<int64_t>(1, stepMinutes);
+    auto charge = [&](int64_t ns) {
+      constexpr int64_t kMinute = 60'000'000'000;
+      int64_t steps = (ns + step * kMinute - 1) / (step * kMinute);
+      return (steps * step * centsPerHour[int(t)] + 59) / 60;
+    };
+    if (!dailyCapCents) return charge(stay.count());
+    constexpr int64_t kDay = 86'400'000'000'000;
+    return stay.count() / kDay * dailyCapCents + min(dailyCapCents, charge(stay.count() % kDay));
+  }
+};
+
+struct ParkingLot {
+  string id;
+  int numLevels;
+  FeeSchedule fees;
+};
+
+// how a lot picks among its free spots; fixed when the lot is created and
+// logged with it. Each mode is one compile-time strategy in section 3e.
+enum class AllocationMode : uint8_t {
+  Pooled,           // O(1) pop of the most recently freed spot, smallest fitting type first
+  FirstFit,         // lowest spot index that fits (level 1 first, then layout order)
+  NearestEntrance,  // floor closest to the caller's entrance level, then layout order
+  LowestFloor,      // fill level 1 before level 2..., smallest fitting type first per floor
+  BestFitType       // smallest fitting type anywhere in the lot, so Large stays free for trucks
+};
+
+struct ParkingSpot {
+  string id;
+  Handle floor;
+  SpotType type;
+};
+
+// which spots take which vehicles, one pair per allowed combination. This list
+// is the only place compatibility is spelt out: kFitMask is generated from it
+// at compile time, and the fit tests, counter sums and scan planes (3d) all
+// derive from kFitMask. A new type (EV charging, Handicap, Bus) is an enum
+// value and its pairs here, plus a tariff and a free pool for a SpotType; no
+// allocation loop gains a branch.
+constexpr pair<VehicleType, SpotType> kCompatible[] = {
+  {VehicleType::Motorcycle, SpotType::Motorcycle},   // motorcycles fit anywhere
+  {VehicleType::Motorcycle, SpotType::Compact},
+  {VehicleType::Motorcycle, SpotType::Large},
+  {VehicleType::Car, SpotType::Compact},
+  {VehicleType::Car, SpotType::Large},
+  {VehicleType::Truck, SpotType::Large},
+};
+
+static_assert(kNumSpotTypes <= 8, "fit masks are uint8_t");
+
+constexpr array<uint8_t, kNumVehicleTypes> makeFitMasks() {
+  array<uint8_t, kNumVehicleTypes> m{};
+  for (const auto& c : kCompatible) m[int(c.first)] |= uint8_t(1u << int(c.second));
+  return m;
+}
+
+// bit t of kFitMask[v] set <=> a VehicleType v fits a SpotType t
+constexpr array<uint8_t, kNumVehicleTypes> kFitMask = makeFitMasks();
+
+constexpr uint8_t fitMask(VehicleType v) { return kFitMask[int(v)]; }
+constexpr bool fits(VehicleType v, SpotType s) { return fitMask(v) >> int(s) & 1; }
+
+static_assert([] {
+  for (uint8_t m : kFitMask) if (!m) return false;
+  return true;
+}(), "every VehicleType needs a SpotType it fits");
+
+// calls f(integral_constant<VehicleType, vt>{}), so a runtime type selects a
+// compile-time instantiation; one compare per type, no case to add for new ones
+template <int V = 0, class F>
+decltype(auto) withVehicleType(VehicleType vt, F&& f) {
+  if constexpr (V + 1 < kNumVehicleTypes)
+    if (int(vt) != V) return withVehicleType<V + 1>(vt, forward<F>(f));
+  return f(integral_constant<VehicleType, VehicleType(V)>{});
+}
+
+// read-side views returned by the dashboard APIs
+struct AvailabilityCounts {
+  array<uint32_t, kNumSpotTypes> byType{};           // whole lot, indexed by SpotType
+  vector<array<uint32_t, kNumSpotTypes>> byFloor;    // [level - 1][SpotType]
+
+  // free spots a vehicle of this type could be given
+  uint32_t fitting(VehicleType vt) const {
+    uint32_t n = 0;
+    for (int t = 0; t < kNumSpotTypes; ++t)
+      if (fits(vt, SpotType(t))) n += byType[t];
+    return n;
+  }
+};
+
+struct SpotPage {
+  vector<string> ids;
+  optional<size_t> next;   // cursor for the following page, nullopt at the end
+};
+
+// completed sessions of one lot over a time window, indexed by SpotType
+struct BillingReport {
+  array<uint64_t, kNumSpotTypes> sessions{};      // ended in the window
+  array<int64_t, kNumSpotTypes> revenueCents{};   // their fees
+  array<double, kNumSpotTypes> occupancy{};       // share of spot time they held
+};
+
+// what checkout() hands back for a closed stay
+struct Receipt {
+  string bookingId;
+  string spotId;
+  SpotType spotType;
+  chrono::system_clock::time_point start, end;
+  int64_t feeCents;
+};
+
+// dynamic assignments
+struct Booking {
+  Uuid id;        // inline, no heap string per booking
+  uint32_t spot;  // index of the spot within its lot's shard
+  VehicleType vehicleType;
+  chrono::system_clock::time_point start;
+  // end == leave time
+  optional<chrono::system_clock::time_point> end;
+};
+
+// change feed records (changeFeed.h), one per park and leave (and overstay
+// alert): fixed-size and trivially copyable, so publishing is a copy into the
+// lot's ring
+enum class SpotEvent : uint8_t { Parked = 1, Left, Overstay };
+
+struct SpotChange {
+  int64_t start;         // booking start, system_clock ticks
+  int64_t end;           // leave time for Left, reservation end for Overstay, 0 for Parked
+  int64_t fee;           // cents charged, Left only
+  uint32_t spot;         // index within the lot; ParkingService::spotIdAt() names it
+  uint32_t level;        // 1-based
+  uint8_t spotType;      // SpotType
+  uint8_t vehicleType;   // VehicleType
+  uint8_t plateLen;
+  char plate[32];        // vehicle ID, cut at 32 bytes
+  char booking[36];      // booking ID (Uuid text)
+
+  string_view vehicleId() const { return {plate, plateLen}; }
+  string_view bookingId() const { return {booking, sizeof booking}; }
+};
 
-   // static descriptions
-   struct ParkingLot {
-     string id;
-     int numLevels;
-     // fee rules, etc.
-   };
-
-   struct ParkingFloor {
-     string id;
-     string lotId;
-     int level;
-   };
-
-   enum class VehicleType { Motorcycle, Car, Truck };
-
-   enum class SpotType { Motorcycle, Compact, Large };
-
-   struct ParkingSpot {
-     string id;
-     string floorId;
-     SpotType type;
-   };
-
-   // dynamic assignments
-   struct Booking {
-     string id;
-     string spotId;
-     string vehicleId;
-     VehicleType vehicleType;
-     chrono::system_clock::time_point start;
-     // end == leave time
-     optional<chrono::system_clock::time_point> end;
-   };
+/*
+ 2b) Metrics (metrics.h): latency histograms, lock contention, occupancy gauges.
+     Per-call timers sample 1 call in kSampleEvery per thread, so the clock is
+     read on ~3% of parks; -DLLD_NO_METRICS removes all of it.
 */
 
+namespace probes {
+constexpr uint32_t kSampleEvery = 64;
+metrics::Histogram park("parking_park_seconds", "parkVehicle latency");
+metrics::Histogram leave("parking_leave_seconds", "leaveVehicle latency");
+metrics::Histogram createLot("parking_create_lot_seconds", "createParkingLot latency");
+metrics::Histogram uuid("parking_uuid_seconds", "booking ID generation");
+metrics::Histogram walWait("parking_wal_wait_seconds", "wait for the group commit fsync");
+metrics::Counter parked("parking_park_total", "parkVehicle calls", "result=\"ok\"");
+metrics::Counter rejected("parking_park_total", "parkVehicle calls", "result=\"rejected\"");
+metrics::Counter full("parking_park_total", "parkVehicle calls", "result=\"full\"");
+metrics::Counter throttled("parking_park_total", "parkVehicle calls", "result=\"throttled\"");
+metrics::Counter shed("parking_park_total", "parkVehicle calls", "result=\"shed\"");
+metrics::Counter noShows("parking_reservation_noshow_total", "reservations released unclaimed");
+metrics::Counter overstays("parking_overstay_total", "reserved stays still parked when their window closed");
+metrics::Counter reseated("parking_reservation_reseated_total", "holds moved off a spot still taken by a walk-in");
+metrics::LockProbe vehicleLock("parking_vehicle_lock", "a lot's plate index segments (the per-vehicle lock)");
+}  // namespace probes
+
 /*
  3) Repositories: handle all data access (no business logic here)
+    All keyed by Handle, callers intern external IDs first; active bookings are
+    also reached by plate.
+    find*() return copies; visit*()/forEach*() hand the caller a const reference
+    to the stored record instead, valid only inside the callback.
+
+    The static layout (lots, floors, spots) is written once per createParkingLot
+    and then only read, so those repositories are RCU-versioned (epoch.h): readers
+    walk an immutable snapshot with no lock and no atomic RMW, and saveAll()
+    publishes a whole lot's floors or spots as one new version.
 */
 
 class ParkingLotRepository {
 public:
-  void save(const ParkingLot& lot) {
-    unique_lock lock(mtx_);
-    lots_[lot.id] = lot;
+  void save(Handle h, const ParkingLot& lot) {
+    table_.update([&](vector<ParkingLot>& lots) {
+      if (h >= lots.size()) lots.resize(h + 1);
+      lots[h] = lot;
+    });
   }
-  optional<ParkingLot> findById(const string& id) {
-    shared_lock lock(mtx_);
-    auto it = lots_.find(id);
-    if (it == lots_.end()) return nullopt;
-    return it->second;
+  optional<ParkingLot> findById(Handle h) {
+    optional<ParkingLot> res;
+    visit(h, [&](const ParkingLot& l) { res = l; });
+    return res;
+  }
+  template <class F>
+  bool visit(Handle h, F&& f) {
+    return table_.read([&](const vector<ParkingLot>& lots) {
+      if (h >= lots.size()) return false;
+      f(lots[h]);
+      return true;
+    });
   }
 private:
-  map<string, ParkingLot> lots_;
-  shared_mutex mtx_;
+  RcuCell<vector<ParkingLot>> table_;
 };
 
 class ParkingFloorRepository {
 public:
-  void save(const ParkingFloor& f) {
-    unique_lock lock(mtx_);
-    floors_[f.id] = f;
+  void save(Handle h, const ParkingFloor& f) {
+    saveAll({{h, f}});
+  }
+  void saveAll(const vector<pair<Handle, ParkingFloor>>& floors) {
+    table_.update([&](Table& t) {
+      for (auto& [h, f] : floors) {
+        if (h >= t.floors.size()) t.floors.resize(h + 1);
+        t.floors[h] = f;
+        if (f.lot >= t.byLot.size()) t.byLot.resize(f.lot + 1);
+        t.byLot[f.lot].push_back(h);
+      }
+    });
   }
-  vector<ParkingFloor> findByLot(const string& lotId) {
-    shared_lock lock(mtx_);
+  vector<ParkingFloor> findByLot(Handle lot) {
     vector<ParkingFloor> res;
-    for (auto& [_, f]: floors_)
-      if (f.lotId == lotId) res.push_back(f);
+    forEachInLot(lot, [&](Handle, const ParkingFloor& f) { res.push_back(f); });
     return res;
   }
+  template <class F>
+  void forEachInLot(Handle lot, F&& f) {
+    table_.read([&](const Table& t) {
+      if (lot >= t.byLot.size()) return 0;
+      for (Handle h : t.byLot[lot]) f(h, t.floors[h]);
+      return 0;
+    });
+  }
 private:
-  map<string, ParkingFloor> floors_;
-  shared_mutex mtx_;
+  struct Table {
+    vector<ParkingFloor> floors;
+    vector<vector<Handle>> byLot;
+  };
+  RcuCell<Table> table_;
 };
 
+// Spots live in fixed-size pages shared between RCU versions: an update copies
+// the page table (one pointer per kPage spots) plus only the pages and floor
+// lists it touches, so adding a lot costs O(its spots) rather than O(all spots).
 class ParkingSpotRepository {
 public:
-  void save(const ParkingSpot& s) {
-    unique_lock lock(mtx_);
-    spots_[s.id] = s;
+  void save(Handle h, const ParkingSpot& s) {
+    saveAll({{h, s}});
+  }
+  void saveAll(const vector<pair<Handle, ParkingSpot>>& spots) {
+    Handle maxH = 0;
+    for (auto& [h, _] : spots) maxH = max(maxH, h);
+    table_.update([&](Table& t) {
+      if (maxH / kPage >= t.pages.size()) t.pages.resize(maxH / kPage + 1);
+      unordered_map<size_t, Page*> pages;           // cloned in this update
+      unordered_map<Handle, vector<Handle>*> floors;
+      for (auto& [h, s] : spots) {
+        auto [pg, fresh] = pages.try_emplace(h / kPage);
+        if (fresh) {
+          auto& cur = t.pages[h / kPage];
+          auto copy = make_shared<Page>(cur ? *cur : Page(kPage));
+          pg->second = copy.get();
+          cur = move(copy);
+        }
+        (*pg->second)[h % kPage] = s;
+
+        auto [fl, clone] = floors.try_emplace(s.floor);
+        if (clone) {
+          if (s.floor >= t.byFloor.size()) t.byFloor.resize(s.floor + 1);
+          auto& cur = t.byFloor[s.floor];
+          auto copy = make_shared<vector<Handle>>(cur ? *cur : vector<Handle>{});
+          fl->second = copy.get();
+          cur = move(copy);
+        }
+        fl->second->push_back(h);
+      }
+    });
   }
-  vector<ParkingSpot> findByFloor(const string& floorId) {
-    shared_lock lock(mtx_);
+  vector<ParkingSpot> findByFloor(Handle floor) {
     vector<ParkingSpot> res;
-    for (auto& [_, s]: spots_)
-      if (s.floorId == floorId) res.push_back(s);
+    forEachOnFloor(floor, [&](Handle, const ParkingSpot& s) { res.push_back(s); });
+    return res;
+  }
+  template <class F>
+  void forEachOnFloor(Handle floor, F&& f) {
+    table_.read([&](const Table& t) {
+      if (floor >= t.byFloor.size() || !t.byFloor[floor]) return 0;
+      for (Handle h : *t.byFloor[floor]) f(h, (*t.pages[h / kPage])[h % kPage]);
+      return 0;
+    });
+  }
+  optional<ParkingSpot> findById(Handle h) {
+    optional<ParkingSpot> res;
+    visit(h, [&](const ParkingSpot& s) { res = s; });
     return res;
   }
-  optional<ParkingSpot> findById(const string& id) {
-    shared_lock lock(mtx_);
-    auto it = spots_.find(id);
-    if (it==spots_.end()) return nullopt;
-    return it->second;
+  template <class F>
+  bool visit(Handle h, F&& f) {
+    return table_.read([&](const Table& t) {
+      if (h / kPage >= t.pages.size() || !t.pages[h / kPage]) return false;
+      f((*t.pages[h / kPage])[h % kPage]);
+      return true;
+    });
   }
 private:
-  map<string, ParkingSpot> spots_;
-  shared_mutex mtx_;
+  static constexpr size_t kPage = 1024;
+  using Page = vector<ParkingSpot>;   // always kPage entries
+  struct Table {
+    vector<shared_ptr<const Page>> pages;
+    vector<shared_ptr<const vector<Handle>>> byFloor;
+  };
+  RcuCell<Table> table_;
 };
 
+// Active bookings of one lot (each LotShard owns one). A booking's handle is the
+// spot it holds, so records live in a spot-indexed array; plates reach them
+// through a StripedHashMap (stripedHashMap.h) whose segment lock is also the
+// vehicle's lock. withVehicle() runs a whole park or checkout as one step under
+// that single lock: the segment guards the plate's entry and the record of the
+// spot it holds. A spot only changes hands through a release by one owner and a
+// claim by the next, which orders their two sections.
 class BookingRepository {
 public:
-  void save(const Booking& b) {
-    unique_lock lock(mtx_);
-    bookings_[b.id] = b;
-    vehicleIndex_[b.vehicleId] = b.id;
+  // sized to the lot up front so parking never grows the spot table
+  explicit BookingRepository(size_t spots = 0) : bySpot_(spots), byPlate_(spots / 2 + 64) {}
+
+  // one plate, inside its locked segment
+  class Vehicle {
+  public:
+    // the active booking, nullptr when not parked here
+    const Booking* booking() const {
+      const uint32_t* spot = ref_.get();
+      return spot ? &*repo_.bySpot_[*spot] : nullptr;
+    }
+    void save(const Booking& b) {
+      repo_.bySpot_[b.spot] = b;
+      ref_.put(b.spot);
+    }
+    // removes the active booking (there must be one) and hands it back
+    Booking close() {
+      uint32_t spot = *ref_.get();
+      Booking b = *repo_.bySpot_[spot];
+      repo_.bySpot_[spot].reset();
+      ref_.erase();
+      return b;
+    }
+
+  private:
+    friend class BookingRepository;
+    Vehicle(BookingRepository& repo, StripedHashMap<uint32_t>::Ref& ref) : repo_(repo), ref_(ref) {}
+    BookingRepository& repo_;
+    StripedHashMap<uint32_t>::Ref& ref_;
+  };
+
+  // f(Vehicle&) under the plate's segment lock; returns what f returns.
+  // f must not call back into the repository.
+  template <class F>
+  decltype(auto) withVehicle(string_view plate, F&& f) {
+    return byPlate_.with(plate,
+      [](mutex& m) { return metrics::lock(m, probes::vehicleLock); },
+      [&](StripedHashMap<uint32_t>::Ref& ref) {
+        Vehicle v(*this, ref);
+        return f(v);
+      });
+  }
+
+  // f(plate, booking) for every active booking, one segment lock at a time
+  template <class F>
+  void forEach(F&& f) {
+    byPlate_.forEach([&](string_view plate, uint32_t spot) { f(plate, *bySpot_[spot]); });
+  }
+
+  // recovery only (single-threaded): the plate holding this spot, if any. A
+  // scan of the plate map, for the rare log that parks onto a taken spot.
+  optional<string> plateAt(uint32_t spot) {
+    optional<string> res;
+    if (spot < bySpot_.size() && bySpot_[spot])
+      byPlate_.forEach([&](string_view plate, uint32_t s) { if (s == spot) res.emplace(plate); });
+    return res;
   }
-  optional<Booking> findByVehicle(const string& vehicleId) {
-    shared_lock lock(mtx_);
-    auto it = vehicleIndex_.find(vehicleId);
-    if (it==vehicleIndex_.end()) return nullopt;
-    return bookings_[it->second];
+
+private:
+  vector<optional<Booking>> bySpot_;
+  StripedHashMap<uint32_t> byPlate_;   // plate -> spot of its active booking
+};
+
+/*
+ 3b) Free-spot pools: one lock-free stack of dense spot indices per SpotType
+*/
+
+// Treiber stack over a fixed array of next-links. The head packs a 32-bit ABA tag
+// with the top index, so a pop racing with pop+push of the same spot fails its CAS.
+class FreeSpotPool {
+public:
+  static constexpr uint32_t kEmpty = UINT32_MAX;
+
+  explicit FreeSpotPool(size_t capacity)
+    : next_(make_unique<atomic<uint32_t>[]>(capacity)) {}
+
+  void push(uint32_t idx) {
+    uint64_t h = head_.load(memory_order_relaxed);
+    do {
+      next_[idx].store(index(h), memory_order_relaxed);
+    } while (!head_.compare_exchange_weak(h, pack(tag(h) + 1, idx),
+                                          memory_order_release,
+                                          memory_order_relaxed));
   }
-  void remove(const string& bookingId) {
-    unique_lock lock(mtx_);
-    auto it = bookings_.find(bookingId);
-    if (it!=bookings_.end()) {
-      vehicleIndex_.erase(it->second.vehicleId);
-      bookings_.erase(it);
+
+  optional<uint32_t> pop() {
+    uint64_t h = head_.load(memory_order_acquire);
+    while (index(h) != kEmpty) {
+      uint32_t nxt = next_[index(h)].load(memory_order_relaxed);
+      if (head_.compare_exchange_weak(h, pack(tag(h) + 1, nxt),
+                                      memory_order_acquire,
+                                      memory_order_acquire))
+        return index(h);
     }
+    return nullopt;
   }
+
 private:
-  map<string, Booking> bookings_;
-  map<string, string> vehicleIndex_;
-  shared_mutex mtx_;
+  static uint64_t pack(uint32_t tag, uint32_t idx) { return (uint64_t(tag) << 32) | idx; }
+  static uint32_t tag(uint64_t h)   { return uint32_t(h >> 32); }
+  static uint32_t index(uint64_t h) { return uint32_t(h); }
+
+  unique_ptr<atomic<uint32_t>[]> next_;
+  atomic<uint64_t> head_{pack(0, kEmpty)};
 };
 
 /*
- 4) Services: implement business logic, delegate persistence to Repos, use per-spot locks
+ 3c) Durability: every state change is a WAL record (writeAheadLog.h), appended
+     after the change is applied and, per vehicle, under the same lock, so log
+     order matches apply order. Replay is last-writer-wins per vehicle and spot.
+     A snapshot is the lot layouts plus their active bookings and open
+     reservations. Holds and timers are not logged: recover() re-arms them and
+     the first advanceTimers() re-takes every hold that is due.
+
+     Billing history lives next to the log: each lot's SessionArchive
+     (sessionArchive.h) is flushed to <dir>/<lotId>.billing by checkpoint(),
+     which rotates the log first. A leave archives its row before it logs
+     Left, and the record carries the priced stay and the row's number, so a
+     flush after the cut holds every row logged before it, and replay appends
+     just the rows past the end of the file: a checked-out stay is in the
+     billing history once its receipt is handed back. recover() ends with a
+     checkpoint, so row numbers in the log never refer to an older run.
 */
 
-class ParkingService {
+enum class LogRecord : uint8_t { LotCreated = 1, Parked, Left, Reserved, Unreserved };
+
+// static shape of one lot as it is logged and snapshotted; floors in level order
+struct LotLayout {
+  struct Floor {
+    string id;
+    vector<pair<string, SpotType>> spots;
+  };
+  string id;
+  vector<Floor> floors;
+  AllocationMode mode = AllocationMode::Pooled;
+  FeeSchedule fees;
+
+  void encode(BinWriter& w) const {
+    w.putStr(id);
+    w.put(uint8_t(mode));
+    w.put(fees);
+    w.put(uint32_t(floors.size()));
+    for (auto& f : floors) {
+      w.putStr(f.id);
+      w.put(uint32_t(f.spots.size()));
+      for (auto& [spotId, type] : f.spots) {
+        w.putStr(spotId);
+        w.put(uint8_t(type));
+      }
+    }
+  }
+  static LotLayout decode(BinReader& r) {
+    LotLayout l;
+    l.id = r.getStr();
+    l.mode = AllocationMode(r.get<uint8_t>());
+    l.fees = r.get<FeeSchedule>();
+    l.floors.resize(r.get<uint32_t>());
+    for (auto& f : l.floors) {
+      f.id = r.getStr();
+      uint32_t n = r.get<uint32_t>();
+      if (!r.ok()) return {};
+      f.spots.reserve(n);
+      for (uint32_t i = 0; i < n && r.ok(); ++i) {
+        string spotId(r.getStr());
+        f.spots.emplace_back(move(spotId), SpotType(r.get<uint8_t>()));
+      }
+    }
+    return l;
+  }
+};
+
+// one active booking as logged (Parked) and snapshotted
+struct BookingEntry {
+  uint32_t spot;
+  string vehicleId;
+  VehicleType vehicleType;
+  Uuid id;
+  chrono::system_clock::time_point start;
+
+  void encode(BinWriter& w) const {
+    w.put(spot);
+    w.putStr(vehicleId);
+    w.put(uint8_t(vehicleType));
+    w.putStr(id.view());
+    w.put(int64_t(start.time_since_epoch().count()));
+  }
+  static BookingEntry decode(BinReader& r) {
+    BookingEntry e;
+    e.spot = r.get<uint32_t>();
+    e.vehicleId = r.getStr();
+    e.vehicleType = VehicleType(r.get<uint8_t>());
+    auto id = r.getStr();
+    memset(e.id.text, 0, sizeof e.id.text);
+    memcpy(e.id.text, id.data(), min(id.size(), size_t(36)));
+    e.start = chrono::system_clock::time_point(
+        chrono::system_clock::duration(r.get<int64_t>()));
+    return e;
+  }
+};
+
+// a Left record: the plate, and the stay as its billing row (the row's number
+// in the lot's SessionArchive decides whether replay re-appends it)
+struct LeftEntry {
+  string vehicleId;
+  uint64_t row;
+  uint32_t spot;
+  uint8_t spotType;
+  int64_t start, end, fee;
+
+  void encode(BinWriter& w) const {
+    w.putStr(vehicleId);
+    w.put(row);
+    w.put(spot);
+    w.put(spotType);
+    w.put(start);
+    w.put(end);
+    w.put(fee);
+  }
+  static LeftEntry decode(BinReader& r) {
+    LeftEntry e;
+    e.vehicleId = r.getStr();
+    e.row = r.get<uint64_t>();
+    e.spot = r.get<uint32_t>();
+    e.spotType = r.get<uint8_t>();
+    e.start = r.get<int64_t>();
+    e.end = r.get<int64_t>();
+    e.fee = r.get<int64_t>();
+    return e;
+  }
+};
+
+// one open reservation as logged (Reserved) and snapshotted; ended by an
+// Unreserved record on arrival, cancel or no-show
+struct ReservationEntry {
+  Uuid id;
+  string vehicleId;
+  VehicleType vehicleType;
+  uint32_t spot;
+  chrono::system_clock::time_point start, end;
+
+  void encode(BinWriter& w) const {
+    w.putStr(id.view());
+    w.putStr(vehicleId);
+    w.put(uint8_t(vehicleType));
+    w.put(spot);
+    w.put(int64_t(start.time_since_epoch().count()));
+    w.put(int64_t(end.time_since_epoch().count()));
+  }
+  static ReservationEntry decode(BinReader& r) {
+    ReservationEntry e;
+    auto id = r.getStr();
+    memset(e.id.text, 0, sizeof e.id.text);
+    memcpy(e.id.text, id.data(), min(id.size(), size_t(36)));
+    e.vehicleId = r.getStr();
+    e.vehicleType = VehicleType(r.get<uint8_t>());
+    e.spot = r.get<uint32_t>();
+    using Tp = chrono::system_clock::time_point;
+    e.start = Tp(Tp::duration(r.get<int64_t>()));
+    e.end = Tp(Tp::duration(r.get<int64_t>()));
+    return e;
+  }
+};
+
+/*
+ 3d) Lot shards: all mutable state of one lot (spot slots, free pools, occupancy,
+     active bookings, vehicle IDs). Lots share nothing, so traffic at one lot never
+     contends with another, and a shard is self-contained enough to pin or move.
+
+     Each shard also owns its lot's change feed. A park or leave publishes its
+     SpotChange under the vehicle lock, like its WAL record, and a leave does so
+     before releasing the spot, so per vehicle and per spot the feed order is the
+     apply order. Publishing claims a slot with one fetch_add and never waits for
+     subscribers; recovery replays state without publishing.
+
+     A leave prices the stay with the lot's FeeSchedule and, once the vehicle
+     lock is released, appends it to the shard's columnar billing archive.
+
+     Reservations pin a spot for a window, kept per spot in a Timeline
+     (timeline.h). kHoldAhead before the window opens a timer takes the spot
+     exactly as a park would (occupancy bit, free counter), so walk-in scans and
+     pools simply never see it; a walk-in still on it gets the reservation moved
+     to a free spot. An unclaimed hold is released kNoShowAfter past the start
+     by a second timer, and a stay that began on a reservation gets a third at
+     the window's end that publishes an Overstay event if the vehicle is still
+     parked. All live in the shard's hierarchical TimerWheel (timerWheel.h)
+     under the reservation mutex, which is taken after a vehicle lock, never
+     before one; overstay checks run after it is released. Overstay timers are
+     not re-armed by recover().
+*/
+
+class LotShard {
 public:
-  ParkingService(ParkingLotRepository& lr,
-                 ParkingFloorRepository& fr,
-                 ParkingSpotRepository& sr,
-                 BookingRepository& br)
-    : lotRepo_(lr), floorRepo_(fr), spotRepo_(sr), bookingRepo_(br) {}
+  LotShard(size_t spots, size_t floors, Handle lot = kNoHandle, WriteAheadLog* log = nullptr,
+           AllocationMode mode = AllocationMode::Pooled, FeeSchedule fees = {})
+    : numSpots_(spots), numFloors_(floors), numWords_((spots + 63) / 64),
+      mode_(mode), fees_(fees), lot_(lot), log_(log),
+      ids_(make_unique<string[]>(spots)),
+      types_(make_unique<uint8_t[]>(spots)),
+      floors_(make_unique<uint32_t[]>(spots)),
+      floorBegin_(make_unique<uint32_t[]>(floors + 1)),
+      typeBits_(make_unique<uint64_t[]>(kNumSpotTypes * numWords_)),
+      fitBits_(make_unique<uint64_t[]>(kNumVehicleTypes * numWords_)),
+      occupied_(make_unique<atomic<uint64_t>[]>(numWords_)),
+      freeCounts_(make_unique<FloorCounts[]>(floors)),
+      pools_{FreeSpotPool(poolSize()), FreeSpotPool(poolSize()), FreeSpotPool(poolSize())},
+      pooled_(make_unique<atomic<uint64_t>[]>(mode == AllocationMode::Pooled ? numWords_ : 0)),
+      bookings_(spots) {}
 
-  // create the lot structure
-  string createParkingLot(int levels, int spotsPerLevel,
-                          map<SpotType,int> spotTypeCounts) 
-  {
-    string lotId = newUUID();
-    ParkingLot lot{lotId, levels};
-    lotRepo_.save(lot);
-
-    // for each level...
-    for (int lvl=1; lvl<=levels; ++lvl) {
-      string floorId = newUUID();
-      floorRepo_.save(ParkingFloor{floorId, lotId, lvl});
-      // create spots of each type
-      for (auto& [type,count]: spotTypeCounts) {
-        for (int i=0; i<count; ++i) {
-          string spotId = newUUID();
-          spotRepo_.save(ParkingSpot{spotId, floorId, type});
-          // initialize lock for this spot
-          mutexes_[spotId];
-        }
+  // construction only, before the shard is published; floor is 0-based within
+  // the lot, and each floor's spots occupy one contiguous index range in level order
+  void initSpot(uint32_t idx, string id, SpotType type, uint32_t floor) {
+    ids_[idx] = move(id);
+    types_[idx] = uint8_t(type);
+    floors_[idx] = floor;
+    uint64_t bit = 1ull << (idx % 64);
+    typeBits_[int(type) * numWords_ + idx / 64] |= bit;
+    for (int v = 0; v < kNumVehicleTypes; ++v)
+      if (fits(VehicleType(v), type)) fitBits_[v * numWords_ + idx / 64] |= bit;
+  }
+
+  // construction only: after initSpot()/restore*(), set the floor ranges, and fill
+  // the counters (and pools, when pooled) with every spot that is not occupied
+  void seal() {
+    for (uint32_t i = 0; i < numSpots_; ++i) floorBegin_[floors_[i] + 1] = i + 1;
+    for (size_t f = 1; f <= numFloors_; ++f) floorBegin_[f] = max(floorBegin_[f], floorBegin_[f - 1]);
+    for (uint32_t i = 0; i < numSpots_; ++i) {
+      ++capacity_[types_[i]];
+      if (isOccupied(i)) continue;
+      freeCounts_[floors_[i]].byType[types_[i]].fetch_add(1, memory_order_relaxed);
+      if (mode_ == AllocationMode::Pooled) pushFree(i);
+    }
+  }
+
+  // what an allocation strategy (3e) gets to work with: floor ranges, the free
+  // counters and the two ways to take ownership of a spot
+  class Claims {
+  public:
+    size_t floors() const { return lot_.numFloors_; }
+
+    // lowest-index free spot on `floor` that a V fits; returns at once when
+    // the floor's fitting counters read zero (they never undercount)
+    template <VehicleType V>
+    optional<uint32_t> first(size_t floor) {
+      if (!lot_.hasFree<V>(floor)) return nullopt;
+      return lot_.claimFirst(lot_.fitPlane(V), lot_.floorBegin_[floor], lot_.floorBegin_[floor + 1]);
+    }
+
+    // same, restricted to one SpotType
+    optional<uint32_t> firstOfType(int spotType, size_t floor) {
+      if (!lot_.freeCounts_[floor].byType[spotType].load(memory_order_relaxed)) return nullopt;
+      return lot_.claimFirst(lot_.typePlane(spotType), lot_.floorBegin_[floor], lot_.floorBegin_[floor + 1]);
+    }
+
+    // Pooled lots only: O(1), most recently freed spot of this type. An entry
+    // whose spot a reservation holds is dropped; the hold pushes it back.
+    optional<uint32_t> pop(int spotType) {
+      while (auto idx = lot_.pools_[spotType].pop()) {
+        uint64_t bit = 1ull << (*idx % 64);
+        lot_.pooled_[*idx / 64].fetch_and(~bit, memory_order_acq_rel);
+        if (!(lot_.occupied_[*idx / 64].fetch_or(bit, memory_order_acq_rel) & bit)) return idx;
       }
+      return nullopt;
+    }
+
+  private:
+    friend class LotShard;
+    explicit Claims(LotShard& lot) : lot_(lot) {}
+    LotShard& lot_;
+  };
+
+  // Strategy must be the policy of this lot's mode (see withStrategy()), V
+  // the vehicle's type (see withVehicleType()); entrance: 0-based floor the
+  // vehicle arrives on
+  template <class Strategy, VehicleType V>
+  optional<string> park(const string& vehicleId, uint32_t entrance = 0) {
+    uint64_t lsn = 0;
+    // the plate's segment lock serialises park/checkout per vehicle, so a plate
+    // can hold at most one spot
+    optional<string> res = bookings_.withVehicle(vehicleId, [&](BookingRepository::Vehicle& v) -> optional<string> {
+      if (v.booking()) return nullopt;
+      Claims claims(*this);
+      auto idx = Strategy::template claim<V>(claims, entrance);
+      if (!idx) return nullopt;
+      freeCounts_[floors_[*idx]].byType[types_[*idx]].fetch_sub(1, memory_order_relaxed);
+      return openStay(v, *idx, vehicleId, V, lsn);
+    });
+    // the fsync is shared with every other commit in flight; no lock held meanwhile
+    if (lsn) {
+      metrics::Timer t(probes::walWait);
+      log_->waitDurable(lsn);
     }
-    return lotId;
+    return res; // nullopt: full (or already parked)
   }
 
-  optional<string> parkVehicle(const string& vehicleId,
-                               VehicleType vt) 
-  {
-    // simple first-fit: scan all spots, pick first free that matches
-    // In production, you’d index by type for O(1) lookup
-    for (auto& [spotId, mtx] : mutexes_) {
-      // lock per-spot to avoid races
-      unique_lock lock(mtx, try_to_lock);
-      if (!lock || isOccupied(spotId)) continue;
-      // check spot type fits vehicle
-      auto spOpt = spotRepo_.findById(spotId);
-      if (!spOpt) continue;
-      if (!fits(vt, spOpt->type)) continue;
-
-      // allocate
-      auto now = chrono::system_clock::now();
-      Booking b{newUUID(), spotId, vehicleId, vt, now, nullopt};
-      bookingRepo_.save(b);
-      return b.id;
-    }
-    return nullopt; // full
-  }
-
-  bool leaveVehicle(const string& vehicleId) {
-    auto bop = bookingRepo_.findByVehicle(vehicleId);
-    if (!bop) return false;
-    Booking b = *bop;
-    // mark end time (optional if you want history)
-    b.end = chrono::system_clock::now();
-    bookingRepo_.remove(b.id);
+  // arrival on a reservation: parks its vehicle on the held spot, or, when a
+  // walk-in is still on it, wherever Strategy finds room. Fails (keeping the
+  // reservation) if the vehicle is already parked or nothing fits.
+  template <class Strategy>
+  optional<string> parkReserved(const string& reservationId) {
+    auto r = reservation(reservationId);
+    if (!r) return nullopt;
+    uint64_t lsn = 0;
+    optional<string> res = bookings_.withVehicle(r->vehicleId, [&](BookingRepository::Vehicle& v) -> optional<string> {
+      if (v.booking()) return nullopt;
+      lock_guard lock(resMtx_);
+      auto h = resIds_.find(reservationId);
+      if (!h) return nullopt;   // cancelled or expired since the lookup
+      Pending& p = *reservations_[*h];
+      optional<uint32_t> idx;
+      if (p.held || holdSpot(p.entry.spot)) {
+        idx = p.entry.spot;
+      } else {
+        Claims claims(*this);
+        idx = withVehicleType(p.entry.vehicleType, [&](auto vt) {
+          return Strategy::template claim<decltype(vt)::value>(claims, 0);
+        });
+        if (!idx) return nullopt;
+        freeCounts_[floors_[*idx]].byType[types_[*idx]].fetch_sub(1, memory_order_relaxed);
+      }
+      p.held = false;   // the booking owns the spot from here on
+      dropReservation(*h);
+      if (log_) logUnreserved(r->id);
+      string id = openStay(v, *idx, r->vehicleId, r->vehicleType, lsn);
+      // an alert if the vehicle is still here when its window closes
+      timers_.schedule(r->end, {ReservationTimer::Overstay, kNoHandle, r->vehicleId, v.booking()->id});
+      return id;
+    });
+    if (lsn) {
+      metrics::Timer t(probes::walWait);
+      log_->waitDurable(lsn);
+    }
+    return res;
+  }
+
+  bool leave(const string& vehicleId) { return closeStay(vehicleId).has_value(); }
+
+  // leave() that also hands back what was charged
+  optional<Receipt> checkout(const string& vehicleId) {
+    auto c = closeStay(vehicleId);
+    if (!c) return nullopt;
+    using Tp = chrono::system_clock::time_point;
+    return Receipt{string(c->bookingId()), ids_[c->spot], SpotType(c->spotType),
+                   Tp(Tp::duration(c->start)), Tp(Tp::duration(c->end)), c->fee};
+  }
+
+  // what leave() would charge if the vehicle left now
+  optional<int64_t> quote(const string& vehicleId) {
+    return bookings_.withVehicle(vehicleId, [&](BookingRepository::Vehicle& v) -> optional<int64_t> {
+      const Booking* b = v.booking();
+      if (!b) return nullopt;
+      return fees_.fee(SpotType(types_[b->spot]), chrono::system_clock::now() - b->start);
+    });
+  }
+
+  // a reserved spot leaves walk-in allocation this long before its window
+  // opens, and goes back to them if its vehicle has not come this long after
+  static constexpr chrono::minutes kHoldAhead{30}, kNoShowAfter{15};
+
+  // pre-books [start, end) on the first spot of the smallest fitting SpotType
+  // whose reserved windows leave it free: O(spots) under the reservation mutex,
+  // which walk-in parks never take
+  optional<string> reserve(const string& vehicleId, VehicleType vt,
+                           chrono::system_clock::time_point start,
+                           chrono::system_clock::time_point end) {
+    if (!(start < end) || end <= chrono::system_clock::now()) return nullopt;
+    uint64_t lsn = 0;
+    optional<string> res;
+    {
+      lock_guard lock(resMtx_);
+      auto spot = reservable(fitMask(vt), start, end);
+      if (!spot) return nullopt;
+      ReservationEntry e{IdGenerator::next(), vehicleId, vt, *spot, start, end};
+      Handle h = addReservation(e);
+      armTimers(h);
+      if (log_) lsn = logReserved(e);
+      res = e.id.str();
+    }
+    if (lsn) {
+      metrics::Timer t(probes::walWait);
+      log_->waitDurable(lsn);
+    }
+    return res;
+  }
+
+  bool cancelReservation(const string& reservationId) {
+    uint64_t lsn = 0;
+    {
+      lock_guard lock(resMtx_);
+      auto h = resIds_.find(reservationId);
+      if (!h) return false;
+      Uuid id = reservations_[*h]->entry.id;
+      dropReservation(*h);
+      if (log_) lsn = logUnreserved(id);
+    }
+    if (lsn) {
+      metrics::Timer t(probes::walWait);
+      log_->waitDurable(lsn);
+    }
     return true;
   }
 
-  vector<string> getAvailableSpots(VehicleType vt) {
-    vector<string> res;
-    for (auto& [spotId, _] : mutexes_) {
-      if (isOccupied(spotId)) continue;
-      auto sp = spotRepo_.findById(spotId).value();
-      if (fits(vt, sp.type)) res.push_back(spotId);
+  // fires the holds, no-shows and overstay alerts due by `now`
+  void advanceTimers(chrono::system_clock::time_point now) {
+    uint64_t lsn = 0;
+    vector<ReservationTimer> overstays;
+    {
+      lock_guard lock(resMtx_);
+      timers_.advance(now, [&](ReservationTimer t) {
+        if (t.kind == ReservationTimer::Overstay) {
+          overstays.push_back(move(t));   // needs the vehicle lock, taken below
+          return;
+        }
+        Pending& p = *reservations_[t.res];
+        if (t.kind == ReservationTimer::Hold) {
+          p.holdTimer = 0;
+          hold(t.res);
+          return;
+        }
+        p.noShowTimer = 0;
+        probes::noShows.inc();
+        Uuid id = p.entry.id;
+        dropReservation(t.res);
+        if (log_) lsn = logUnreserved(id);
+      });
+    }
+    // not cancelled on leave: a stay that has ended, or a later stay of the
+    // same plate, simply fails the booking ID check
+    for (auto& t : overstays) {
+      bookings_.withVehicle(t.plate, [&](BookingRepository::Vehicle& v) {
+        const Booking* b = v.booking();
+        if (!b || b->id.view() != t.booking.view()) return;
+        SpotChange c = changeOf(*b, t.plate, 0);
+        c.end = now.time_since_epoch().count();
+        feed_.publish(uint8_t(SpotEvent::Overstay), c);
+        probes::overstays.inc();
+      });
+    }
+    if (lsn) {
+      metrics::Timer t(probes::walWait);
+      log_->waitDurable(lsn);
     }
+  }
+
+  // recovery only: the open reservations come back without holds or timers
+  void restoreReserve(const ReservationEntry& e) {
+    lock_guard lock(resMtx_);
+    if (e.spot >= numSpots_ || resIds_.find(e.id.view())) return;
+    addReservation(e);
+  }
+
+  void restoreUnreserve(string_view reservationId) {
+    lock_guard lock(resMtx_);
+    if (auto h = resIds_.find(reservationId)) dropReservation(*h);
+  }
+
+  // recovery only, after seal(): schedules every open reservation's timers
+  void armReservations() {
+    lock_guard lock(resMtx_);
+    for (Handle h = 0; h < reservations_.size(); ++h)
+      if (reservations_[h]) armTimers(h);
+  }
+
+  // snapshot side
+  vector<ReservationEntry> reservations() {
+    lock_guard lock(resMtx_);
+    vector<ReservationEntry> res;
+    for (auto& p : reservations_)
+      if (p) res.push_back(p->entry);
     return res;
   }
 
-private:
-  bool isOccupied(const string& spotId) {
-    // simple check: any booking for this spot without end?
-    // For brevity, we assume one active booking per spot
-    // In production, index bookings by spotId
-    auto all = bookingRepo_.findByVehicle(""); // not ideal
-    // … implement proper lookup …
+  // recovery only, before seal(): last writer wins, so whatever the vehicle
+  // or the spot held before is dropped
+  void restorePark(const BookingEntry& e) {
+    if (e.spot >= numSpots_) return;
+    restoreLeave(e.vehicleId);
+    if (auto old = bookings_.plateAt(e.spot)) restoreLeave(*old);
+    bookings_.withVehicle(e.vehicleId, [&](BookingRepository::Vehicle& v) {
+      v.save(Booking{e.id, e.spot, e.vehicleType, e.start, nullopt});
+    });
+    setOccupied(e.spot, true);
+  }
+
+  void restoreLeave(const string& vehicleId) {
+    bookings_.withVehicle(vehicleId, [&](BookingRepository::Vehicle& v) {
+      if (v.booking()) setOccupied(v.close().spot, false);
+    });
+  }
+
+  // recovery only: a Left record; its billing row unless the file has it
+  void restoreLeft(const LeftEntry& e) {
+    restoreLeave(e.vehicleId);
+    if (e.row >= archivedRows_ && e.spotType < kNumSpotTypes && e.start <= e.end)
+      archive_.append({archiveWho(e.vehicleId), e.spot, e.spotType, e.start, e.end, e.fee});
+  }
+
+  // recovery only, before the log tail: the lot's billing file
+  void loadArchive(const string& path) { archivedRows_ = archive_.load(path); }
+
+  // snapshot side: the active bookings, each one consistent on its own
+  vector<BookingEntry> bookings() {
+    vector<BookingEntry> res;
+    bookings_.forEach([&](string_view plate, const Booking& b) {
+      res.push_back(BookingEntry{b.spot, string(plate), b.vehicleType, b.id, b.start});
+    });
+    return res;
+  }
+
+  // calls f(spotId, type, floor) in spot index order
+  template <class F>
+  void forEachSpot(F&& f) const {
+    for (uint32_t i = 0; i < numSpots_; ++i) f(ids_[i], SpotType(types_[i]), floors_[i]);
+  }
+
+  // O(floors): each counter is exact on its own, the set is not one snapshot
+  AvailabilityCounts counts() const {
+    AvailabilityCounts c;
+    c.byFloor.resize(numFloors_);
+    for (size_t f = 0; f < numFloors_; ++f) {
+      for (int t = 0; t < kNumSpotTypes; ++t) {
+        uint32_t n = freeCounts_[f].byType[t].load(memory_order_relaxed);
+        c.byFloor[f][t] = n;
+        c.byType[t] += n;
+      }
+    }
+    return c;
+  }
+
+  // false only if no spot a V fits is free: the free counters never read below
+  // the truth, so this is exact for "full". Takes no lock and reads floors x
+  // fitting types relaxed counters, whatever the lot's size.
+  template <VehicleType V>
+  bool anyFree() const {
+    for (size_t f = 0; f < numFloors_; ++f)
+      if (hasFree<V>(f)) return true;
     return false;
   }
 
-  bool fits(VehicleType v, SpotType s) {
-    switch(v) {
-      case VehicleType::Motorcycle:
-        return true;              // motorcycles fit anywhere
-      case VehicleType::Car:
-        return s==SpotType::Compact || s==SpotType::Large;
-      case VehicleType::Truck:
-        return s==SpotType::Large;
+  // calls f(spotId) for each free fitting spot from index `from` on, until f
+  // returns false; returns the index to resume from (numSpots_ when done)
+  template <VehicleType V, class F>
+  size_t forEachAvailable(size_t from, F&& f) const {
+    if (!anyFree<V>()) return numSpots_;
+    const uint64_t* plane = fitPlane(V);
+    for (size_t i = nextFree(plane, from, numSpots_); i < numSpots_;
+         i = nextFree(plane, i + 1, numSpots_))
+      if (!f(ids_[i])) return i + 1;
+    return numSpots_;
+  }
+
+  // completed sessions in [from, to): counted and billed by end time, spot
+  // time clipped to the window; stays still in progress are not included
+  BillingReport report(chrono::system_clock::time_point from,
+                       chrono::system_clock::time_point to) const {
+    int64_t f = from.time_since_epoch().count(), t = to.time_since_epoch().count();
+    auto ended = archive_.ended(f, t);
+    auto busy = archive_.busy(f, t);
+    BillingReport r;
+    for (int k = 0; k < kNumSpotTypes; ++k) {
+      r.sessions[k] = ended[k].sessions;
+      r.revenueCents[k] = ended[k].amount;
+      if (capacity_[k] && t > f) r.occupancy[k] = double(busy[k]) / (double(capacity_[k]) * double(t - f));
     }
+    return r;
+  }
+
+  // one row per completed stay: plate hash (archiveWho), spot index, SpotType, start, end, fee
+  SessionArchive& archive() { return archive_; }
+  const FeeSchedule& fees() const { return fees_; }
+
+  // Parked/Left/Overstay events with SpotChange payloads
+  const ChangeFeed& feed() const { return feed_; }
+  const string& spotId(uint32_t idx) const { return ids_[idx]; }
+
+  size_t numSpots() const { return numSpots_; }
+  AllocationMode mode() const { return mode_; }
+  const array<uint32_t, kNumSpotTypes>& capacity() const { return capacity_; }
+
+private:
+  size_t poolSize() const { return mode_ == AllocationMode::Pooled ? numSpots_ : 0; }
+
+  // fits() is a constant here, so the loop unrolls to the fitting types' loads
+  template <VehicleType V>
+  bool hasFree(size_t floor) const {
+    for (int t = 0; t < kNumSpotTypes; ++t)
+      if (fits(V, SpotType(t)) && freeCounts_[floor].byType[t].load(memory_order_relaxed)) return true;
     return false;
   }
 
-  string newUUID() {
-    uuid_t u; uuid_generate(u);
-    char buf[37]; uuid_unparse(u, buf);
-    return string{buf};
+  // scan planes: one per SpotType, and one per VehicleType holding every spot
+  // it fits, so a scan for a vehicle reads a single plane
+  const uint64_t* typePlane(int spotType) const { return &typeBits_[spotType * numWords_]; }
+  const uint64_t* fitPlane(VehicleType v) const { return &fitBits_[int(v) * numWords_]; }
+
+  // the scan only proposes a spot; fetch_or on its word is the claim, so a
+  // spot another thread took in between is simply skipped on the rescan
+  optional<uint32_t> claimFirst(const uint64_t* plane, size_t from, size_t to) {
+    for (size_t i = nextFree(plane, from, to); i < to; i = nextFree(plane, i, to)) {
+      uint64_t bit = 1ull << (i % 64);
+      if (!(occupied_[i / 64].fetch_or(bit, memory_order_acq_rel) & bit)) return uint32_t(i);
+    }
+    return nullopt;
+  }
+
+  // lowest index in [from, to) of a free spot set in `plane`, else `to`.
+  // Candidates are (plane & ~occupied) per 64-spot word; with AVX2 (NEON) a
+  // block of 256 (128) spots without any candidate costs one load and one test.
+  size_t nextFree(const uint64_t* plane, size_t from, size_t to) const {
+    if (from >= to) return to;
+    size_t w = from / 64, end = (to + 63) / 64;
+    uint64_t head = ~0ull << (from % 64);   // masks the spots before `from`
+    while (w < end) {
+#if defined(__AVX2__) || defined(__ARM_NEON)
+      if (w + kBlockWords <= end && !blockHasCandidate(plane, w)) {
+        w += kBlockWords;
+        head = ~0ull;
+        continue;
+      }
+#endif
+      uint64_t bits = plane[w] & ~occupied_[w].load(memory_order_acquire) & head;
+      if (bits) return min(to, w * 64 + __builtin_ctzll(bits));
+      head = ~0ull;
+      ++w;
+    }
+    return to;
   }
 
-  ParkingLotRepository& lotRepo_;
-  ParkingFloorRepository& floorRepo_;
-  ParkingSpotRepository& spotRepo_;
-  BookingRepository& bookingRepo_;
+  // occupancy words are read with relaxed loads (plain movs) and packed into a
+  // vector; the block test is only a filter, claimFirst() decides with fetch_or
+#if defined(__AVX2__)
+  static constexpr size_t kBlockWords = 4;
+  bool blockHasCandidate(const uint64_t* plane, size_t w) const {
+    __m256i fit = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(plane + w));
+    __m256i occ = _mm256_set_epi64x(occupied_[w + 3].load(memory_order_relaxed),
+                                    occupied_[w + 2].load(memory_order_relaxed),
+                                    occupied_[w + 1].load(memory_order_relaxed),
+                                    occupied_[w].load(memory_order_relaxed));
+    return !_mm256_testc_si256(occ, fit);   // testc: (fit & ~occ) == 0
+  }
+#elif defined(__ARM_NEON)
+  static constexpr size_t kBlockWords = 2;
+  bool blockHasCandidate(const uint64_t* plane, size_t w) const {
+    uint64x2_t fit = vld1q_u64(plane + w);
+    uint64_t occ[2] = {occupied_[w].load(memory_order_relaxed),
+                       occupied_[w + 1].load(memory_order_relaxed)};
+    uint64x2_t c = vbicq_u64(fit, vld1q_u64(occ));
+    return (vgetq_lane_u64(c, 0) | vgetq_lane_u64(c, 1)) != 0;
+  }
+#endif
 
-  // per-spot locks
-  map<string, mutex> mutexes_;
-};
+  // free spots per SpotType on one floor; a line per floor keeps parks on
+  // different floors from bouncing the same cache line
+  struct alignas(64) FloorCounts {
+    atomic<uint32_t> byType[kNumSpotTypes] = {};
+  };
 
-/*
- 5) Flow:
-    - client calls createParkingLot(...) once
-    - on entry: parkVehicle(id, type) → assigns first-fit free spot or returns none
-    - on exit: leaveVehicle(id) → frees the spot
-    - optionally: getAvailableSpots(type) for a dashboard
-*/
+  // one bit per spot index; the authoritative record is
+  // bookings_.findBySpot(), this is the cheap hot-path view of it
+  bool isOccupied(uint32_t idx) const {
+    return occupied_[idx / 64].load(memory_order_acquire) & (1ull << (idx % 64));
+  }
 
-/* Thread-safety & scaling notes:
-   - We use one mutex per spot so two cars can park in different spots concurrently.
-   - The “check + allocate” is done under that spot’s lock.
-   - Repositories use shared_mutex to allow concurrent reads.
-   - For high throughput, index free-spot lists by type and maintain a concurrent free-list.
-*/
+  void setOccupied(uint32_t idx, bool on) {
+    uint64_t bit = 1ull << (idx % 64);
+    if (on) occupied_[idx / 64].fetch_or(bit, memory_order_release);
+    else    occupied_[idx / 64].fetch_and(~bit, memory_order_release);
+  }
 
-int main() {
-  // example usage
-  ParkingLotRepository lotRepo;
-  ParkingFloorRepository floorRepo;
-  ParkingSpotRepository spotRepo;
-  BookingRepository bookingRepo;
-  ParkingService svc(lotRepo, floorRepo, spotRepo, bookingRepo);
+  // a stay's `who` in the billing archive: a hash of the plate, the same in
+  // every process and on every node, so no plate table grows with traffic.
+  // It picks out a plate's stays, give or take a rare collision.
+  static uint32_t archiveWho(string_view plate) { return uint32_t(ringHash(plate)); }
 
-  // create a 3-level lot, 10 spots each: 2 motorcycle, 6 compact, 2 large per level
-  map<SpotType,int> counts{{SpotType::Motorcycle,2},
-                           {SpotType::Compact,6},
-                           {SpotType::Large,2}};
-  string lotId = svc.createParkingLot(3, 10, counts);
+  // leave/checkout: find, close, free and log under the plate's one segment
+  // lock, then archive and wait for durability without it
+  optional<SpotChange> closeStay(const string& vehicleId) {
+    uint64_t lsn = 0;
+    uint32_t who = archiveWho(vehicleId);
+    auto change = bookings_.withVehicle(vehicleId, [&](BookingRepository::Vehicle& v) -> optional<SpotChange> {
+      if (!v.booking()) return nullopt;
+      Booking b = v.close();
+      SpotChange c = changeOf(b, vehicleId, chrono::system_clock::now().time_since_epoch().count());
+      feed_.publish(uint8_t(SpotEvent::Left), c);
+      releaseSpot(b.spot);
+      if (log_) {
+        // archived before it is logged, so the row is in any flush that
+        // follows the record's checkpoint cut (3c)
+        uint64_t row = archive_.append({who, c.spot, c.spotType, c.start, c.end, c.fee});
+        lsn = logLeft(LeftEntry{vehicleId, row, c.spot, c.spotType, c.start, c.end, c.fee});
+      }
+      return c;
+    });
+    if (!change) return nullopt;
+    if (!log_) archive_.append({who, change->spot, change->spotType, change->start, change->end, change->fee});
+    if (lsn) {
+      metrics::Timer t(probes::walWait);
+      log_->waitDurable(lsn);
+    }
+    return change;
+  }
 
-  auto booking = svc.parkVehicle("KA01AB1234", VehicleType::Car);
-  if (booking) cout << "Parked in booking " << *booking << "\n";
-  else         cout << "Lot full!\n";
+  // park/parkReserved, under the vehicle lock, once the spot is claimed and counted
+  string openStay(BookingRepository::Vehicle& v, uint32_t idx, const string& vehicleId,
+                  VehicleType vt, uint64_t& lsn) {
+    auto now = chrono::system_clock::now();
+    Booking b{{}, idx, vt, now, nullopt};
+    {
+      metrics::Timer t(probes::uuid, probes::kSampleEvery);
+      b.id = IdGenerator::next();
+    }
+    v.save(b);
+    feed_.publish(uint8_t(SpotEvent::Parked), changeOf(b, vehicleId, 0));
+    if (log_) lsn = logParked(BookingEntry{idx, vehicleId, vt, b.id, now});
+    return b.id.str();
+  }
+
+  // count first so the counter never underflows, then release the spot:
+  // clearing the bit frees it for scans, the push for the pool
+  void releaseSpot(uint32_t idx) {
+    freeCounts_[floors_[idx]].byType[types_[idx]].fetch_add(1, memory_order_relaxed);
+    setOccupied(idx, false);
+    if (mode_ == AllocationMode::Pooled) pushFree(idx);
+  }
+
+  // claims a specific spot for a reservation, if it is free. In a pooled lot its
+  // pool entry stays behind and is dropped by the pop that finds it taken.
+  bool holdSpot(uint32_t idx) {
+    uint64_t bit = 1ull << (idx % 64);
+    if (occupied_[idx / 64].fetch_or(bit, memory_order_acq_rel) & bit) return false;
+    freeCounts_[floors_[idx]].byType[types_[idx]].fetch_sub(1, memory_order_relaxed);
+    return true;
+  }
+
+  // pooled_ has a spot's bit set while its pool holds an entry for it, so a
+  // spot is pushed at most once however holds and pops interleave
+  void pushFree(uint32_t idx) {
+    uint64_t bit = 1ull << (idx % 64);
+    if (!(pooled_[idx / 64].fetch_or(bit, memory_order_acq_rel) & bit)) pools_[types_[idx]].push(idx);
+  }
+
+  // the rest of this block: caller holds resMtx_
+
+  struct ReservationTimer {
+    enum Kind : uint8_t { Hold, NoShow, Overstay } kind;
+    Handle res;       // Hold, NoShow
+    string plate;     // Overstay: the vehicle whose stay it watches
+    Uuid booking;
+  };
+
+  struct Pending {
+    ReservationEntry entry;
+    bool held = false;   // its spot is out of walk-in allocation
+    TimerWheel<ReservationTimer>::Id holdTimer = 0, noShowTimer = 0;
+  };
+
+  optional<uint32_t> reservable(uint8_t types, chrono::system_clock::time_point start,
+                                chrono::system_clock::time_point end) {
+    if (windows_.empty()) windows_.resize(numSpots_);   // lots never reserved pay nothing
+    for (int t = 0; t < kNumSpotTypes; ++t) {
+      if (!(types >> t & 1)) continue;
+      for (size_t w = 0; w < numWords_; ++w)
+        for (uint64_t bits = typePlane(t)[w]; bits; bits &= bits - 1) {
+          uint32_t i = uint32_t(w * 64 + __builtin_ctzll(bits));
+          if (windows_[i].isFree(start, end)) return i;
+        }
+    }
+    return nullopt;
+  }
+
+  Handle addReservation(const ReservationEntry& e) {
+    if (windows_.empty()) windows_.resize(numSpots_);
+    Handle h = resIds_.intern(e.id.view());
+    if (h >= reservations_.size()) reservations_.resize(h + 1);
+    reservations_[h] = Pending{e};
+    windows_[e.spot].insert(e.start, e.end, h);
+    return h;
+  }
+
+  void armTimers(Handle h) {
+    Pending& p = *reservations_[h];
+    p.holdTimer = timers_.schedule(p.entry.start - kHoldAhead, {ReservationTimer::Hold, h, {}, {}});
+    p.noShowTimer = timers_.schedule(min(p.entry.end, p.entry.start + kNoShowAfter),
+                                     {ReservationTimer::NoShow, h, {}, {}});
+  }
+
+  // ends the reservation; a spot it still holds goes back to walk-ins
+  void dropReservation(Handle h) {
+    Pending& p = *reservations_[h];
+    timers_.cancel(p.holdTimer);
+    timers_.cancel(p.noShowTimer);
+    windows_[p.entry.spot].erase(p.entry.start, h);
+    if (p.held) releaseSpot(p.entry.spot);
+    reservations_[h].reset();
+    resIds_.release(h);
+  }
+
+  // take the spot out of walk-in allocation; if a walk-in is still on it, move
+  // the reservation to a free fitting spot whose window is clear
+  void hold(Handle h) {
+    Pending& p = *reservations_[h];
+    if (p.held) return;
+    if (holdSpot(p.entry.spot)) {
+      p.held = true;
+      return;
+    }
+    const uint64_t* plane = fitPlane(p.entry.vehicleType);
+    for (size_t i = nextFree(plane, 0, numSpots_); i < numSpots_; i = nextFree(plane, i + 1, numSpots_)) {
+      if (!windows_[i].isFree(p.entry.start, p.entry.end) || !holdSpot(uint32_t(i))) continue;
+      windows_[p.entry.spot].erase(p.entry.start, h);
+      windows_[i].insert(p.entry.start, p.entry.end, h);
+      p.entry.spot = uint32_t(i);
+      p.held = true;
+      probes::reseated.inc();
+      return;
+    }
+    // nothing free: parkReserved() seats the vehicle like a walk-in
+  }
+
+  optional<ReservationEntry> reservation(const string& reservationId) {
+    lock_guard lock(resMtx_);
+    auto h = resIds_.find(reservationId);
+    if (!h) return nullopt;
+    return reservations_[*h]->entry;
+  }
+
+  SpotChange changeOf(const Booking& b, const string& vehicleId, int64_t end) const {
+    SpotChange c{};
+    c.start = b.start.time_since_epoch().count();
+    c.end = end;
+    c.spot = b.spot;
+    c.level = floors_[b.spot] + 1;
+    c.spotType = types_[b.spot];
+    c.fee = end ? fees_.fee(SpotType(c.spotType), chrono::system_clock::duration(end - c.start)) : 0;
+    c.vehicleType = uint8_t(b.vehicleType);
+    c.plateLen = uint8_t(min(vehicleId.size(), sizeof c.plate));
+    memcpy(c.plate, vehicleId.data(), c.plateLen);
+    memcpy(c.booking, b.id.text, sizeof c.booking);
+    return c;
+  }
+
+  uint64_t logParked(const BookingEntry& e) {
+    BinWriter w;
+    w.put(lot_);
+    e.encode(w);
+    return log_->append(uint8_t(LogRecord::Parked), w.data());
+  }
+
+  uint64_t logLeft(const LeftEntry& e) {
+    BinWriter w;
+    w.put(lot_);
+    e.encode(w);
+    return log_->append(uint8_t(LogRecord::Left), w.data());
+  }
+
+  uint64_t logReserved(const ReservationEntry& e) {
+    BinWriter w;
+    w.put(lot_);
+    e.encode(w);
+    return log_->append(uint8_t(LogRecord::Reserved), w.data());
+  }
+
+  uint64_t logUnreserved(const Uuid& id) {
+    BinWriter w;
+    w.put(lot_);
+    w.putStr(id.view());
+    return log_->append(uint8_t(LogRecord::Unreserved), w.data());
+  }
+
+  const uint32_t numSpots_;
+  const size_t numFloors_, numWords_;
+  const AllocationMode mode_;
+  const FeeSchedule fees_;
+  const Handle lot_;
+  WriteAheadLog* const log_;
+  // spots as a structure of arrays, indexed by spot index within the lot: the
+  // scans touch only the bit planes, ids are cold and read to render a result
+  unique_ptr<string[]> ids_;
+  unique_ptr<uint8_t[]> types_;
+  unique_ptr<uint32_t[]> floors_;
+  unique_ptr<uint32_t[]> floorBegin_;   // floor f = [floorBegin_[f], floorBegin_[f + 1])
+  unique_ptr<uint64_t[]> typeBits_;     // kNumSpotTypes planes of numWords_, set at init
+  unique_ptr<uint64_t[]> fitBits_;      // kNumVehicleTypes planes: OR of the type planes each fits
+  unique_ptr<atomic<uint64_t>[]> occupied_;
+  unique_ptr<FloorCounts[]> freeCounts_;
+  array<uint32_t, kNumSpotTypes> capacity_{};   // set by seal()
+  FreeSpotPool pools_[kNumSpotTypes];
+  unique_ptr<atomic<uint64_t>[]> pooled_;   // Pooled lots: spot has a pool entry
+  BookingRepository bookings_;
+  ChangeFeed feed_{kFeedSlots};   // 128 bytes a slot: 512 KB per lot
+  SessionArchive archive_;
+  uint64_t archivedRows_ = 0;   // rows in the billing file at recovery
+
+  // reservations: open ones by handle, each spot's reserved windows, and the
+  // hold/no-show timers, all under resMtx_
+  mutex resMtx_;
+  Interner resIds_;
+  vector<optional<Pending>> reservations_;
+  vector<Timeline<Handle>> windows_;   // by spot; sized on the first reservation
+  TimerWheel<ReservationTimer> timers_{chrono::seconds(1)};
+
+  static constexpr size_t kFeedSlots = 4096;
+};
+
+/*
+ 3e) Allocation strategies: the parking counterpart of IRoomStrategy, but as
+     compile-time policies, so LotShard::park<Strategy, V> is one inlined loop
+     with no virtual call. A strategy is a stateless struct with
+       template <VehicleType V>
+       static optional<uint32_t> claim(LotShard::Claims&, uint32_t entrance)
+     instantiated per vehicle type, so fits(V, t) is a constant and the loops
+     over SpotTypes unroll to the fitting ones. Adding one means a struct, an
+     AllocationMode value and a case in withStrategy().
+*/
+
+struct PooledStrategy {
+  template <VehicleType V>
+  static optional<uint32_t> claim(LotShard::Claims& lot, uint32_t) {
+    for (int t = 0; t < kNumSpotTypes; ++t)
+      if (fits(V, SpotType(t)))
+        if (auto idx = lot.pop(t)) return idx;
+    return nullopt;
+  }
+};
+
+struct FirstFitStrategy {
+  template <VehicleType V>
+  static optional<uint32_t> claim(LotShard::Claims& lot, uint32_t) {
+    for (size_t f = 0; f < lot.floors(); ++f)
+      if (auto idx = lot.first<V>(f)) return idx;
+    return nullopt;
+  }
+};
+
+// entrance floor first, then one level below and above it, and so on
+struct NearestEntranceStrategy {
+  template <VehicleType V>
+  static optional<uint32_t> claim(LotShard::Claims& lot, uint32_t entrance) {
+    size_t n = lot.floors();
+    size_t e = min<size_t>(entrance, n - 1);
+    for (size_t d = 0; d < n; ++d) {
+      // e - d wraps below floor 0 and fails the bound check, like e + d past the top
+      size_t ring[2] = {e - d, e + d};
+      for (size_t k = 0; k < (d ? 2 : 1); ++k)
+        if (ring[k] < n)
+          if (auto idx = lot.first<V>(ring[k])) return idx;
+    }
+    return nullopt;
+  }
+};
+
+// packs the lower floors so the upper ones can be closed off (lights, HVAC)
+struct LowestFloorStrategy {
+  template <VehicleType V>
+  static optional<uint32_t> claim(LotShard::Claims& lot, uint32_t) {
+    for (size_t f = 0; f < lot.floors(); ++f)
+      for (int t = 0; t < kNumSpotTypes; ++t)
+        if (fits(V, SpotType(t)))
+          if (auto idx = lot.firstOfType(t, f)) return idx;
+    return nullopt;
+  }
+};
+
+// a car only takes a Large spot once every Compact one in the lot is gone
+struct BestFitTypeStrategy {
+  template <VehicleType V>
+  static optional<uint32_t> claim(LotShard::Claims& lot, uint32_t) {
+    for (int t = 0; t < kNumSpotTypes; ++t)
+      if (fits(V, SpotType(t)))
+        for (size_t f = 0; f < lot.floors(); ++f)
+          if (auto idx = lot.firstOfType(t, f)) return idx;
+    return nullopt;
+  }
+};
+
+// the one runtime branch per call: a lot's mode selects the instantiation
+template <class F>
+auto withStrategy(AllocationMode mode, F&& f) {
+  switch (mode) {
+    case AllocationMode::Pooled:          return f(PooledStrategy{});
+    case AllocationMode::FirstFit:        return f(FirstFitStrategy{});
+    case AllocationMode::NearestEntrance: return f(NearestEntranceStrategy{});
+    case AllocationMode::LowestFloor:     return f(LowestFloorStrategy{});
+    case AllocationMode::BestFitType:     return f(BestFitTypeStrategy{});
+  }
+  return f(PooledStrategy{});
+}
+
+/*
+ 4) Services: implement business logic, delegate persistence to Repos, route each call to its lot's shard
+*/
+
+class ParkingService {
+public:
+  // with a log, every change is durable before the call returns (see 3c);
+  // admission: per-gate rate and in-flight limits for parkVehicle (off by default)
+  ParkingService(ParkingLotRepository& lr,
+                 ParkingFloorRepository& fr,
+                 ParkingSpotRepository& sr,
+                 size_t maxLots = 1024,
+                 WriteAheadLog* log = nullptr,
+                 AdmissionPolicy admission = {})
+    : lotRepo_(lr), floorRepo_(fr), spotRepo_(sr), log_(log),
+      maxLots_(maxLots), shards_(make_unique<atomic<LotShard*>[]>(maxLots)),
+      admission_(admission) {}
+
+  ~ParkingService() {
+    for (size_t i = 0; i < maxLots_; ++i) delete shards_[i].load();
+  }
+
+  // create the lot structure; nullopt once maxLots lots exist. lotId: empty for a
+  // fresh UUIDv7, or the ID a router placed the lot by (nullopt if it exists).
+  // A level holds exactly spotTypeCounts; the spots-per-level argument is its
+  // sum and not read. nullopt too for levels <= 0, a negative count or more
+  // IDs than a 32-bit handle can number.
+  optional<string> createParkingLot(int levels, int /*spotsPerLevel*/,
+                                    map<SpotType,int> spotTypeCounts,
+                                    AllocationMode mode = AllocationMode::Pooled,
+                                    FeeSchedule fees = {},
+                                    const string& lotId = {})
+  {
+    metrics::Timer timer(probes::createLot);
+    // the ID batch is sized from these before a single spot is numbered
+    if (levels <= 0) return nullopt;
+    size_t perLevel = 0;
+    for (auto& [_, count]: spotTypeCounts) {
+      if (count < 0) return nullopt;
+      perLevel += size_t(count);
+    }
+    if (1 + perLevel > (UINT32_MAX - 1) / size_t(levels)) return nullopt;
+    size_t total = 1 + size_t(levels) * (1 + perLevel);   // lot, floors, spots
+
+    LotLayout layout;
+    layout.mode = mode;
+    layout.fees = fees;
+    uint64_t lsn = 0;
+    {
+      lock_guard lock(createMtx_);
+      if (lotIds_.size() >= maxLots_ || (!lotId.empty() && lotIds_.find(lotId))) return nullopt;
+
+      // one batch covers the lot, its floors and every spot
+      auto ids = IdGenerator::nextBatch(total);
+      layout.id = lotId.empty() ? ids[0].str() : lotId;
+      layout.floors.resize(levels);
+      // for each level, create spots of each type; level l owns a fixed ID range,
+      // an equal share of the checked total (its floor, then exactly perLevel spots)
+      size_t slice = (total - 1) / size_t(levels);
+      parallelFor(levels, [&](size_t lvl) {
+        auto& floor = layout.floors[lvl];
+        size_t next = 1 + lvl * slice;
+        floor.id = ids[next++].str();
+        floor.spots.reserve(slice - 1);
+        for (auto& [type,count]: spotTypeCounts)
+          for (int i=0; i<count; ++i) floor.spots.emplace_back(ids[next++].str(), type);
+      }, kMinSpotsPerThread / max<size_t>(1, perLevel));
+
+      auto [lot, shard] = build(layout);
+      // logged before the lot is visible, so no Parked record can precede it
+      if (log_) {
+        BinWriter w;
+        layout.encode(w);
+        lsn = log_->append(uint8_t(LogRecord::LotCreated), w.data());
+      }
+      shard->seal();
+      publish(layout.id, lot, move(shard));
+    }
+    if (lsn) {
+      metrics::Timer t(probes::walWait);
+      log_->waitDurable(lsn);
+    }
+    return layout.id;
+  }
+
+  // startup only, before any traffic: load the latest snapshot, replay the log tail
+  bool recover() {
+    if (!log_) return false;
+    lock_guard lock(createMtx_);
+    const string& dir = log_->dir();
+    auto from = loadSnapshot(dir, [&](BinReader& r) {
+      uint32_t lots = r.get<uint32_t>();
+      for (uint32_t i = 0; i < lots && r.ok(); ++i) {
+        LotShard* s = restoreLot(LotLayout::decode(r));
+        uint32_t n = r.get<uint32_t>();
+        for (uint32_t j = 0; j < n && r.ok(); ++j) {
+          auto e = BookingEntry::decode(r);
+          if (s) s->restorePark(e);
+        }
+        n = r.get<uint32_t>();
+        for (uint32_t j = 0; j < n && r.ok(); ++j) {
+          auto e = ReservationEntry::decode(r);
+          if (s) s->restoreReserve(e);
+        }
+      }
+    });
+    WriteAheadLog::replay(dir, from.value_or(0), [&](uint8_t type, string_view payload) {
+      BinReader r(payload.data(), payload.size());
+      switch (LogRecord(type)) {
+        case LogRecord::LotCreated:
+          restoreLot(LotLayout::decode(r));
+          break;
+        case LogRecord::Parked: {
+          auto* s = shardAt(r.get<Handle>());
+          auto e = BookingEntry::decode(r);
+          if (s && r.ok()) s->restorePark(e);
+          break;
+        }
+        case LogRecord::Left: {
+          auto* s = shardAt(r.get<Handle>());
+          auto e = LeftEntry::decode(r);
+          if (s && r.ok()) s->restoreLeft(e);
+          break;
+        }
+        case LogRecord::Reserved: {
+          auto* s = shardAt(r.get<Handle>());
+          auto e = ReservationEntry::decode(r);
+          if (s && r.ok()) s->restoreReserve(e);
+          break;
+        }
+        case LogRecord::Unreserved: {
+          auto* s = shardAt(r.get<Handle>());
+          string id(r.getStr());
+          if (s && r.ok()) s->restoreUnreserve(id);
+          break;
+        }
+      }
+    });
+    for (Handle lot = 0; lot < lotIds_.size(); ++lot) {
+      shardAt(lot)->seal();
+      shardAt(lot)->armReservations();
+    }
+    // the replayed rows get new numbers; a fresh cut keeps the old ones out of any later replay
+    checkpointLocked();
+    return true;
+  }
+
+  // fuzzy checkpoint: parks and leaves keep running, only createParkingLot waits
+  bool checkpoint() {
+    if (!log_) return false;
+    lock_guard lock(createMtx_);
+    checkpointLocked();
+    return true;
+  }
+
+  // entranceLevel (1-based) only steers NearestEntrance lots; the lot's mode picks
+  // the strategy. The entrance is also the gate whose rate limit the call uses.
+  optional<string> parkVehicle(const string& lotId,
+                               const string& vehicleId,
+                               VehicleType vt,
+                               int entranceLevel = 1)
+  {
+    metrics::Timer timer(probes::park, probes::kSampleEvery);
+    auto* s = shard(lotId);
+    if (!s) {
+      probes::rejected.inc();
+      return nullopt;
+    }
+    uint32_t entrance = uint32_t(max(entranceLevel, 1) - 1);
+    return withVehicleType(vt, [&](auto v) -> optional<string> {
+      constexpr VehicleType V = decltype(v)::value;
+      // a full lot answers from its counters: no ticket, no lock, no scan
+      if (!s->anyFree<V>()) {
+        probes::full.inc();
+        return nullopt;
+      }
+      auto ticket = admission_.admit(admission_.enabled() ? gateKey(lotId, entrance) : string());
+      if (!ticket) {
+        (ticket.verdict() == Admission::Verdict::Throttled ? probes::throttled : probes::shed).inc();
+        return nullopt;
+      }
+      auto res = withStrategy(s->mode(), [&](auto strategy) {
+        return s->park<decltype(strategy), V>(vehicleId, entrance);
+      });
+      (res ? probes::parked : probes::rejected).inc();
+      return res;
+    });
+  }
+
+  bool leaveVehicle(const string& lotId, const string& vehicleId) {
+    metrics::Timer timer(probes::leave, probes::kSampleEvery);
+    auto* s = shard(lotId);
+    return s && s->leave(vehicleId);
+  }
+
+  // leaveVehicle that also returns what was charged; nullopt if not parked here
+  optional<Receipt> checkout(const string& lotId, const string& vehicleId) {
+    metrics::Timer timer(probes::leave, probes::kSampleEvery);
+    auto* s = shard(lotId);
+    return s ? s->checkout(vehicleId) : nullopt;
+  }
+
+  // pre-book a spot for [start, end); nullopt if no fitting spot is free for the
+  // whole window (or the window is empty or over)
+  optional<string> reserveSpot(const string& lotId, const string& vehicleId, VehicleType vt,
+                               chrono::system_clock::time_point start,
+                               chrono::system_clock::time_point end) {
+    auto* s = shard(lotId);
+    return s ? s->reserve(vehicleId, vt, start, end) : nullopt;
+  }
+
+  // arrival on a reservation, in place of parkVehicle; the reservation ends here
+  optional<string> parkReserved(const string& lotId, const string& reservationId) {
+    metrics::Timer timer(probes::park, probes::kSampleEvery);
+    auto* s = shard(lotId);
+    optional<string> res;
+    if (s) {
+      res = withStrategy(s->mode(), [&](auto strategy) {
+        return s->parkReserved<decltype(strategy)>(reservationId);
+      });
+    }
+    (res ? probes::parked : probes::rejected).inc();
+    return res;
+  }
+
+  bool cancelReservation(const string& lotId, const string& reservationId) {
+    auto* s = shard(lotId);
+    return s && s->cancelReservation(reservationId);
+  }
+
+  // drives every lot's reservation timers (1 s resolution); call from one
+  // thread, about once a second
+  void advanceTimers(chrono::system_clock::time_point now = chrono::system_clock::now()) {
+    for (Handle lot = 0; lot < lotIds_.size(); ++lot)
+      if (LotShard* s = shardAt(lot)) s->advanceTimers(now);
+  }
+
+  // full scan, O(spots) string copies; dashboards should poll getAvailabilityCounts
+  vector<string> getAvailableSpots(const string& lotId, VehicleType vt) {
+    vector<string> res;
+    if (auto* s = shard(lotId))
+      withVehicleType(vt, [&](auto v) {
+        s->forEachAvailable<decltype(v)::value>(0, [&](const string& id) { res.push_back(id); return true; });
+      });
+    return res;
+  }
+
+  // one page of at most `limit` IDs starting at `cursor` (0 for the first page).
+  // Cursors are positions in the lot's spot order, so a page never repeats a spot,
+  // but a spot freed behind the cursor mid-walk is only seen on the next walk.
+  SpotPage getAvailableSpots(const string& lotId, VehicleType vt,
+                             size_t cursor, size_t limit) {
+    SpotPage page;
+    auto* s = shard(lotId);
+    if (!s || limit == 0) return page;
+    size_t next = withVehicleType(vt, [&](auto v) {
+      return s->forEachAvailable<decltype(v)::value>(cursor, [&](const string& id) {
+        page.ids.push_back(id);
+        return page.ids.size() < limit;
+      });
+    });
+    if (next < s->numSpots()) page.next = next;
+    return page;
+  }
+
+  // O(levels) counter reads, no scan and no allocation per spot
+  optional<AvailabilityCounts> getAvailabilityCounts(const string& lotId) {
+    auto* s = shard(lotId);
+    if (!s) return nullopt;
+    return s->counts();
+  }
+
+  // the fee leaveVehicle would charge now; nullopt if the vehicle is not parked here
+  optional<int64_t> quoteFee(const string& lotId, const string& vehicleId) {
+    auto* s = shard(lotId);
+    return s ? s->quote(vehicleId) : nullopt;
+  }
+
+  // completed stays of one lot in [from, to), from its in-memory billing archive:
+  // blocks inside the window come from their totals, edge blocks are scanned
+  optional<BillingReport> billingReport(const string& lotId,
+                                        chrono::system_clock::time_point from,
+                                        chrono::system_clock::time_point to) {
+    auto* s = shard(lotId);
+    if (!s) return nullopt;
+    return s->report(from, to);
+  }
+
+  // appends each lot's billing rows not yet on disk to <dir>/<lotId>.billing;
+  // checkpoint() does this for the log directory, whose recover() reloads them.
+  // With a log that is the only place rows may go: replay counts the rows in
+  // those files, so false (and nothing written) for any other dir.
+  bool flushBilling(const string& dir) {
+    if (log_ && filesystem::path(dir) != filesystem::path(log_->dir())) return false;
+    lock_guard lock(createMtx_);
+    flushLocked(dir);
+    return true;
+  }
+
+  // tail a lot's changes: the reader's poll() hands out Events whose payload is
+  // a SpotChange (event.as<SpotChange>()), typed by SpotEvent. Starts with the
+  // next change, or with the oldest one the ring still holds; a reader more than
+  // 4096 changes behind skips ahead and counts the gap in lost(). Seed state
+  // from getAvailabilityCounts() first, then apply the feed.
+  optional<ChangeFeed::Reader> subscribe(const string& lotId, bool fromOldest = false) {
+    auto* s = shard(lotId);
+    if (!s) return nullopt;
+    return s->feed().subscribe(fromOldest);
+  }
+
+  optional<string> spotIdAt(const string& lotId, uint32_t spot) {
+    auto* s = shard(lotId);
+    if (!s || spot >= s->numSpots()) return nullopt;
+    return s->spotId(spot);
+  }
+
+private:
+  // interns and stores a lot's static layout and builds its (unsealed, unpublished) shard
+  pair<Handle, unique_ptr<LotShard>> build(const LotLayout& l) {
+    Handle lot = lotIds_.intern(l.id);
+    lotRepo_.save(lot, ParkingLot{l.id, int(l.floors.size()), l.fees});
+    size_t total = 0;
+    for (auto& f : l.floors) total += f.spots.size();
+    auto shard = make_unique<LotShard>(total, l.floors.size(), lot, log_, l.mode, l.fees);
+
+    // handles are issued serially (one interner lock each for floors and spots),
+    // then each floor fills its own disjoint index range of spots and the shard
+    vector<pair<Handle, ParkingFloor>> floors;
+    vector<string_view> spotKeys;
+    vector<size_t> first(l.floors.size() + 1, 0);
+    spotKeys.reserve(total);
+    for (uint32_t lvl = 0; lvl < l.floors.size(); ++lvl) {
+      auto& f = l.floors[lvl];
+      floors.push_back({floorIds_.intern(f.id), ParkingFloor{f.id, lot, int(lvl + 1)}});
+      for (auto& sp : f.spots) spotKeys.push_back(sp.first);
+      first[lvl + 1] = spotKeys.size();
+    }
+    vector<Handle> handles = spotIds_.internAll(spotKeys);
+
+    vector<pair<Handle, ParkingSpot>> spots(total);
+    parallelFor(l.floors.size(), [&](size_t lvl) {
+      auto& f = l.floors[lvl];
+      for (size_t i = first[lvl]; i < first[lvl + 1]; ++i) {
+        auto& [spotId, type] = f.spots[i - first[lvl]];
+        spots[i] = {handles[i], ParkingSpot{spotId, floors[lvl].first, type}};
+        shard->initSpot(uint32_t(i), spotId, type, uint32_t(lvl));
+      }
+    }, kMinSpotsPerThread / max<size_t>(1, total / max<size_t>(1, l.floors.size())));
+    // one RCU version per repository for the whole lot
+    floorRepo_.saveAll(floors);
+    spotRepo_.saveAll(spots);
+    return {lot, move(shard)};
+  }
+
+  // bulk construction only goes wide for lots big enough to repay thread start-up
+  static constexpr size_t kMinSpotsPerThread = 4096;
+
+  // the lot becomes visible to parkVehicle only once fully built
+  void publish(const string& lotId, Handle lot, unique_ptr<LotShard> shard) {
+    shards_[lot].store(shard.release(), memory_order_release);
+    lotIndex_.update([&](unordered_map<string, Handle>& m) { m.emplace(lotId, lot); });
+  }
+
+  // recovery: a lot seen twice (snapshot and tail) or past maxLots is skipped
+  LotShard* restoreLot(const LotLayout& l) {
+    if (l.id.empty() || lotIds_.find(l.id) || lotIds_.size() >= maxLots_) return nullptr;
+    auto [lot, shard] = build(l);
+    LotShard* s = shard.get();
+    s->loadArchive(billingPath(log_->dir(), lot));   // before the tail's Left rows
+    publish(l.id, lot, move(shard));   // sealed by recover() once the tail is applied
+    return s;
+  }
+
+  LotLayout layoutOf(Handle lot, const LotShard& s) {
+    LotLayout l;
+    l.id = lotIds_.name(lot);
+    l.mode = s.mode();
+    l.fees = s.fees();
+    floorRepo_.forEachInLot(lot, [&](Handle, const ParkingFloor& f) {
+      if (size_t(f.level) > l.floors.size()) l.floors.resize(f.level);
+      l.floors[f.level - 1].id = f.id;
+    });
+    s.forEachSpot([&](const string& id, SpotType type, uint32_t floor) {
+      l.floors[floor].spots.emplace_back(id, type);
+    });
+    return l;
+  }
+
+  // caller holds createMtx_. Rotates before flushing: every row logged
+  // before the cut was archived before it, so the flush holds them all (3c).
+  void checkpointLocked() {
+    uint64_t from = log_->rotate();
+    flushLocked(log_->dir());
+    BinWriter w;
+    Handle lots = Handle(lotIds_.size());
+    w.put(uint32_t(lots));
+    for (Handle lot = 0; lot < lots; ++lot) {
+      LotShard* s = shardAt(lot);
+      layoutOf(lot, *s).encode(w);
+      auto bookings = s->bookings();
+      w.put(uint32_t(bookings.size()));
+      for (auto& b : bookings) b.encode(w);
+      auto reservations = s->reservations();
+      w.put(uint32_t(reservations.size()));
+      for (auto& e : reservations) e.encode(w);
+    }
+    writeSnapshot(log_->dir(), from, w.data());
+    log_->dropBefore(from);
+  }
+
+  // caller holds createMtx_
+  void flushLocked(const string& dir) {
+    ::mkdir(dir.c_str(), 0755);
+    for (Handle lot = 0; lot < lotIds_.size(); ++lot)
+      if (LotShard* s = shardAt(lot)) s->archive().flush(billingPath(dir, lot));
+  }
+
+  string billingPath(const string& dir, Handle lot) const {
+    return dir + "/" + lotIds_.name(lot) + ".billing";
+  }
+
+  LotShard* shardAt(Handle lot) {
+    return lot < maxLots_ ? shards_[lot].load(memory_order_acquire) : nullptr;
+  }
+
+  // lock-free: an RCU snapshot lookup and one acquire load
+  LotShard* shard(const string& lotId) {
+    return lotIndex_.read([&](const unordered_map<string, Handle>& m) -> LotShard* {
+      auto it = m.find(lotId);
+      return it == m.end() ? nullptr : shards_[it->second].load(memory_order_acquire);
+    });
+  }
+
+  // admission key of one entrance of one lot
+  static string gateKey(const string& lotId, uint32_t entrance) {
+    return lotId + '#' + to_string(entrance + 1);
+  }
+
+  ParkingLotRepository& lotRepo_;
+  ParkingFloorRepository& floorRepo_;
+  ParkingSpotRepository& spotRepo_;
+  WriteAheadLog* const log_;
+
+  // API boundary: external string IDs -> dense handles; the interners issue
+  // handles (under createMtx_), lotIndex_ serves the per-call lotId lookup
+  Interner lotIds_, floorIds_, spotIds_;
+  RcuCell<unordered_map<string, Handle>> lotIndex_;
+
+  // lot handle -> shard; fixed size so lookups never race with a resize
+  const size_t maxLots_;
+  unique_ptr<atomic<LotShard*>[]> shards_;
+  Admission admission_;   // parkVehicle only; leaves, reservations and reads are never held back
+  mutex createMtx_;
+
+  // occupancy gauges per lot and SpotType, read from the free counters at scrape
+  // time; last member, so it is unregistered before anything it reads goes away
+  metrics::Collector gauges_{[this](metrics::Exposition& e) {
+    static const char* kTypes[kNumSpotTypes] = {"Motorcycle", "Compact", "Large"};
+    e.family("parking_spots", "gauge", "spots per lot and SpotType");
+    e.family("parking_free_spots", "gauge", "free spots per lot and SpotType");
+    for (Handle lot = 0; lot < lotIds_.size(); ++lot) {
+      LotShard* s = shardAt(lot);
+      if (!s) continue;   // interned, not yet published
+      auto free = s->counts().byType;
+      auto total = s->capacity();
+      string id = lotIds_.name(lot);
+      for (int t = 0; t < kNumSpotTypes; ++t) {
+        string labels = "lot=\"" + id + "\",type=\"" + kTypes[t] + "\"";
+        e.sample("parking_spots", labels, total[t]);
+        e.sample("parking_free_spots", labels, free[t]);
+      }
+    }
+  }};
+};
+
+/*
+ 4b) Partitioned deployment (partition.h): lots spread over several processes.
+     A lot's ID picks its partition; each partition is one ParkingService with
+     its own WAL on the partition's leader node, shipped to a follower node.
+     ParkingRouter creates a lot under an ID it draws itself, so the lot lands
+     on the node its ID hashes to, and sends every later call for it there.
+     When a leader cannot be reached, the router hands its partitions to their
+     followers, which open the shipped log (snapshot + tail of that partition
+     only) and carry on; what had not been shipped yet is lost. The billing
+     files checkpoint() writes beside the log only grow, so they are shipped
+     too, ahead of each snapshot (partition.h), and a promoted follower keeps
+     the lot's whole billing history. Each node runs its own
+     NotificationService and timers: drive advanceTimers() and checkpoint()
+     through forEachLed().
+*/
+
+enum class ParkingRpc : uint8_t { CreateLot = 1, Park, Leave };
+
+// the largest lot a CreateLot may ask for; anything bigger is taken as a
+// malformed request rather than allocated
+constexpr int64_t kMaxRpcLotSpots = 1 << 22;
+
+// one partition of a node: its own repositories, log and service
+struct ParkingPartition {
+  ParkingLotRepository lotRepo;
+  ParkingFloorRepository floorRepo;
+  ParkingSpotRepository spotRepo;
+  WriteAheadLog wal;
+  ParkingService svc{lotRepo, floorRepo, spotRepo, 1024, &wal};
+
+  explicit ParkingPartition(const string& dir) : wal(dir) { svc.recover(); }
+  WriteAheadLog& log() { return wal; }
+};
+
+// replies carry an optional ID as [u8 present][str id]
+string encodeId(const optional<string>& id) {
+  BinWriter w;
+  w.put(uint8_t(id.has_value()));
+  w.putStr(id.value_or(string()));
+  return w.data();
+}
+
+optional<string> decodeId(const optional<string>& reply) {
+  if (!reply) return nullopt;
+  BinReader r(reply->data(), reply->size());
+  bool present = r.get<uint8_t>();
+  string id(r.getStr());
+  if (!r.ok() || !present) return nullopt;
+  return id;
+}
+
+// the service side of ParkingRpc, run by PartitionNode on the partition's leader.
+// Every enum and size from the wire is range-checked here: the service trusts
+// its callers, so anything out of range is nullopt (BadRequest), not a call.
+optional<string> parkingDispatch(ParkingPartition& part, uint8_t method, BinReader& r) {
+  switch (ParkingRpc(method)) {
+    case ParkingRpc::CreateLot: {
+      string lotId(r.getStr());
+      int levels = r.get<int32_t>();
+      map<SpotType, int> counts;
+      int64_t spotsPerFloor = 0;
+      bool valid = true;
+      for (uint32_t n = r.get<uint32_t>(); n > 0 && r.ok(); --n) {
+        uint8_t type = r.get<uint8_t>();
+        int32_t count = r.get<int32_t>();
+        valid = valid && type < kNumSpotTypes && count >= 0 && !counts.count(SpotType(type));
+        if (!valid) break;
+        counts[SpotType(type)] = count;
+        spotsPerFloor += count;
+      }
+      uint8_t mode = r.get<uint8_t>();
+      auto fees = r.get<FeeSchedule>();
+      if (!r.ok() || !valid || lotId.empty() || levels <= 0 ||
+          mode > uint8_t(AllocationMode::BestFitType) || int64_t(levels) * spotsPerFloor > kMaxRpcLotSpots)
+        return nullopt;
+      return encodeId(part.svc.createParkingLot(levels, int(spotsPerFloor), counts, AllocationMode(mode), fees,
+                                                lotId));
+    }
+    case ParkingRpc::Park: {
+      string lotId(r.getStr()), vehicleId(r.getStr());
+      uint8_t vt = r.get<uint8_t>();
+      int entrance = r.get<int32_t>();
+      if (!r.ok() || vt >= kNumVehicleTypes) return nullopt;
+      return encodeId(part.svc.parkVehicle(lotId, vehicleId, VehicleType(vt), entrance));
+    }
+    case ParkingRpc::Leave: {
+      string lotId(r.getStr()), vehicleId(r.getStr());
+      if (!r.ok()) return nullopt;
+      return string(1, char(part.svc.leaveVehicle(lotId, vehicleId)));
+    }
+  }
+  return nullopt;
+}
+
+// a process serving its share of the partitions: ParkingNode(root, port, parkingDispatch)
+using ParkingNode = PartitionNode<ParkingPartition>;
+
+// ParkingService's lot-scoped calls, sent to whichever node leads the lot's partition
+class ParkingRouter {
+public:
+  explicit ParkingRouter(const vector<Peer>& nodes) : router_(nodes) {}
+
+  // a level holds exactly spotTypeCounts
+  optional<string> createParkingLot(int levels, const map<SpotType, int>& spotTypeCounts,
+                                    AllocationMode mode = AllocationMode::Pooled,
+                                    FeeSchedule fees = {}) {
+    string lotId = IdGenerator::next().str();
+    BinWriter w;
+    w.putStr(lotId);
+    w.put(int32_t(levels));
+    w.put(uint32_t(spotTypeCounts.size()));
+    for (auto& [type, count] : spotTypeCounts) {
+      w.put(uint8_t(type));
+      w.put(int32_t(count));
+    }
+    w.put(uint8_t(mode));
+    w.put(fees);
+    return decodeId(router_.call(partitionOf(lotId), uint8_t(ParkingRpc::CreateLot), w.data()));
+  }
+
+  optional<string> parkVehicle(const string& lotId, const string& vehicleId,
+                               VehicleType vt, int entranceLevel = 1) {
+    BinWriter w;
+    w.putStr(lotId);
+    w.putStr(vehicleId);
+    w.put(uint8_t(vt));
+    w.put(int32_t(entranceLevel));
+    return decodeId(router_.call(partitionOf(lotId), uint8_t(ParkingRpc::Park), w.data()));
+  }
+
+  bool leaveVehicle(const string& lotId, const string& vehicleId) {
+    BinWriter w;
+    w.putStr(lotId);
+    w.putStr(vehicleId);
+    auto r = router_.call(partitionOf(lotId), uint8_t(ParkingRpc::Leave), w.data());
+    return r && r->size() == 1 && (*r)[0];
+  }
+
+  NodeId leaderOf(const string& lotId) const { return router_.leaderOf(partitionOf(lotId)); }
+
+  // takes node n back after it failed over, as a follower (PartitionRouter::rejoin)
+  bool rejoin(NodeId n) { return router_.rejoin(n); }
+
+private:
+  PartitionRouter router_;
+};
+
+/*
+ 5) Flow:
+    - client calls createParkingLot(...) once per lot
+    - on entry: parkVehicle(lot, id, type) → pops a free spot from the lot's smallest fitting pool or returns none
+      (a full lot, or a gate over its AdmissionPolicy, answers none before any lock)
+    - pre-booking: reserveSpot(lot, id, type, start, end); advanceTimers() about once a
+      second (e.g. from a TimerDriver shared with MeetingService) holds the spot from
+      kHoldAhead before start, releases no-shows and raises overstay alerts; at the
+      gate parkReserved(lot, reservationId) instead of parkVehicle
+    - at the pay station: quoteFee(lot, id); on exit: checkout(lot, id) (or leaveVehicle)
+      → frees the spot, pushes it back onto its pool, archives the priced stay and
+      hands back the Receipt
+    - finance: billingReport(lot, from, to) over the archive; flushBilling(dir) to export
+    - display boards: getAvailabilityCounts(lot) for per-floor / per-type free counts
+    - rare callers that need IDs: getAvailableSpots(lot, type, cursor, limit), page by page
+    - downstream consumers (signage, billing, analytics): subscribe(lot) once, then
+      poll() the reader on their own thread; publishing never waits for them
+    - durable mode: pass a WriteAheadLog, call recover() once at startup and
+      checkpoint() periodically (snapshot + drop of the log segments it covers)
+    - more than one process: run a ParkingNode per machine and a ParkingRouter in
+      front of them (section 4b); `./parkingLot cluster` shows a failover and a rejoin
+    - `./parkingLot bench` runs the hot-path benchmarks in section 6; `./parkingLot load`
+      replays a gate trace under a concurrency checker (section 7)
+*/
+
+/* Thread-safety & scaling notes:
+   - Each lot is an independent LotShard; the only shared step is the lotId → shard lookup.
+   - Pooled lots keep free spots in one lock-free Treiber stack per SpotType; a
+     successful pop is the allocation, so two cars can never be handed the same spot.
+     Park tries pools in Motorcycle → Compact → Large order, skipping types that don't fit.
+   - Spots are stored as a structure of arrays: one bit plane per SpotType, one per
+     VehicleType (every spot that type fits, built from kFitMask at init) and an
+     occupancy bitset (one atomic bit per spot) that mirrors the spotId → booking index.
+     The scanning strategies (3e) and getAvailableSpots test (fit & ~occupied) 64
+     spots per word, 256 per AVX2 block in one load and one test; for those lots
+     fetch_or on the occupancy word is the allocation. Strategies are templates on
+     the lot's mode and the vehicle's type: park has no virtual call and no
+     compatibility test left at run time.
+   - Free counters (per floor × SpotType, one cache line per floor) are bumped with a
+     relaxed RMW on park/leave. Park claims before decrementing and leave increments
+     before releasing, so a counter may briefly read one high but never below the true
+     number of free spots: zero really means full, and the scans skip such floors.
+     parkVehicle checks them first, so at peak a failing park costs a few relaxed
+     loads instead of the plate lock and a strategy walk.
+   - Admission (admission.h), when configured, sits between that check and the park:
+     a token bucket per lot entrance and a bounded in-flight queue whose callers
+     wait at most maxWait. Overload is shed at the gate, at a fixed cost, instead of
+     queueing on the plate segments and the WAL.
+   - Park/leave for the same vehicle are serialised on the plate's segment of the
+     lot's plate index (stripedHashMap.h), so a plate never holds two spots and a
+     spot is never freed twice. That one lock also covers the booking record, so a
+     checkout is one hash probe and one lock acquisition.
+   - Lot lookup and the static layout repositories are RCU snapshots (epoch.h):
+     readers take no lock and do no atomic RMW; writers publish a new version per lot.
+   - Reservations take one mutex per lot (reserve, cancel, arrival, timers); walk-in
+     parks and leaves never do. A hold is an ordinary claim of the spot's
+     occupancy bit, so scanning lots need nothing else; pooled lots track which
+     spots have a pool entry (one bit each) and drop entries a hold took, so a
+     spot is never in its pool twice.
+   - Change feeds are per lot and bounded: producers claim ring slots with one
+     fetch_add and stamp them when written; readers copy seqlock-style and never
+     write shared state, so a slow subscriber costs the write path nothing.
+   - Each lot's billing archive takes a short mutex per completed stay, outside the
+     vehicle lock (inside it with a WAL, so the row is numbered before Left is
+     logged); reports copy the sealed block list under it and scan unlocked.
+   - With a WAL, park/leave append their record under the vehicle lock but wait for
+     the fsync after releasing it; concurrent commits share one fsync (group commit).
+*/
+
+/*
+ 6) Benchmarks: `./parkingLot bench` (see benchHarness.h)
+    Sweeps lot size × occupancy × threads over the hot paths. Each config gets a
+    fresh service; park is undone by an untimed leave (and vice versa) so the
+    occupancy ratio holds steady for the whole run. Latencies cover the timed
+    call only; ops/sec is wall clock, so a park row's rate includes its leave.
+*/
+
+struct ParkingFixture {
+  ParkingLotRepository lotRepo;
+  ParkingFloorRepository floorRepo;
+  ParkingSpotRepository spotRepo;
+  ParkingService svc{lotRepo, floorRepo, spotRepo};
+  vector<string> lots;
+
+  // `lots` lots of 10 levels, 20% motorcycle / 60% compact / 20% large, prefilled with cars
+  ParkingFixture(int spots, double occupancy, size_t numLots = 1,
+                 AllocationMode mode = AllocationMode::Pooled) {
+    int perLevel = spots / 10;
+    for (size_t l = 0; l < numLots; ++l) {
+      lots.push_back(*svc.createParkingLot(10, perLevel,
+                                           {{SpotType::Motorcycle, perLevel / 5},
+                                            {SpotType::Compact, perLevel - 2 * (perLevel / 5)},
+                                            {SpotType::Large, perLevel / 5}},
+                                           mode));
+      for (int i = 0; i < int(spots * occupancy); ++i)
+        svc.parkVehicle(lots.back(), "pre-" + to_string(i), VehicleType::Car);
+    }
+  }
+
+  const string& lotFor(size_t thread) const { return lots[thread % lots.size()]; }
+};
+
+void runBenchmarks() {
+  constexpr size_t kPlates = 1024;   // per-thread plate pool, reused across cycles
+  Bench::printHeader();
+  for (int spots : {1000, 10000, 50000}) {
+    for (double occ : {0.0, 0.5, 0.9}) {
+      for (size_t threads : {1, 2, 4, 8}) {
+        vector<vector<string>> plates(threads);
+        for (size_t t = 0; t < threads; ++t)
+          for (size_t i = 0; i < kPlates; ++i)
+            plates[t].push_back("b" + to_string(t) + "-" + to_string(i));
+        auto plate = [&](size_t t, size_t i) -> const string& { return plates[t][i % kPlates]; };
+        string params = "spots=" + to_string(spots) + " occ=" + to_string(int(occ * 100)) + "%";
+
+        // one shared lot, then (with >1 thread) one lot per thread to show shard isolation
+        const size_t lotCounts[] = {1, threads};
+        for (size_t run = 0; run < (threads > 1 ? 2 : 1); ++run) {
+          size_t numLots = lotCounts[run];
+          ParkingFixture fx(spots, occ, numLots);
+          string p = params + (numLots > 1 ? " lots=" + to_string(numLots) : "");
+
+          Bench::print(Bench::run("parkVehicle", p, threads, 20000,
+            [](size_t, size_t) {},
+            [&](size_t t, size_t i) { fx.svc.parkVehicle(fx.lotFor(t), plate(t, i), VehicleType::Car); },
+            [&](size_t t, size_t i) { fx.svc.leaveVehicle(fx.lotFor(t), plate(t, i)); }));
+          Bench::print(Bench::run("leaveVehicle", p, threads, 20000,
+            [&](size_t t, size_t i) { fx.svc.parkVehicle(fx.lotFor(t), plate(t, i), VehicleType::Car); },
+            [&](size_t t, size_t i) { fx.svc.leaveVehicle(fx.lotFor(t), plate(t, i)); },
+            [](size_t, size_t) {}));
+          Bench::print(Bench::run("getAvailableSpots", p, threads, 50,
+            [&](size_t t, size_t) { fx.svc.getAvailableSpots(fx.lotFor(t), VehicleType::Car); }));
+          Bench::print(Bench::run("getAvailableSpots/pg", p, threads, 20000,
+            [&](size_t t, size_t) { fx.svc.getAvailableSpots(fx.lotFor(t), VehicleType::Car, 0, 50); }));
+          Bench::print(Bench::run("getAvailabilityCnt", p, threads, 20000,
+            [&](size_t t, size_t) { fx.svc.getAvailabilityCounts(fx.lotFor(t)); }));
+        }
+      }
+    }
+  }
+
+  // scanning strategies (3e): nearest-entrance starts at the vehicle's level
+  // (spread over the 10 levels by thread); the prefill packs the spots each
+  // strategy prefers first, so every park has to skip past them
+  for (int spots : {10000, 50000}) {
+    for (double occ : {0.5, 0.9}) {
+      for (size_t threads : {1, 4}) {
+        string p = "spots=" + to_string(spots) + " occ=" + to_string(int(occ * 100)) + "%";
+        vector<vector<string>> plates(threads);
+        for (size_t t = 0; t < threads; ++t)
+          for (size_t i = 0; i < kPlates; ++i)
+            plates[t].push_back("s" + to_string(t) + "-" + to_string(i));
+        for (auto [name, mode] : {pair{"parkVehicle/first", AllocationMode::FirstFit},
+                                  pair{"parkVehicle/nearest", AllocationMode::NearestEntrance},
+                                  pair{"parkVehicle/lowestFl", AllocationMode::LowestFloor},
+                                  pair{"parkVehicle/bestFit", AllocationMode::BestFitType}}) {
+          ParkingFixture fx(spots, occ, 1, mode);
+          Bench::print(Bench::run(name, p, threads, 20000,
+            [](size_t, size_t) {},
+            [&](size_t t, size_t i) {
+              fx.svc.parkVehicle(fx.lotFor(t), plates[t][i % kPlates], VehicleType::Car, int(1 + t % 10));
+            },
+            [&](size_t t, size_t i) { fx.svc.leaveVehicle(fx.lotFor(t), plates[t][i % kPlates]); }));
+        }
+      }
+    }
+  }
+
+  // change feed (3d): the same park/leave cycle while a subscriber thread tails
+  // the lot, to show publishing is unaffected by a reader on the ring
+  for (size_t threads : {1, 4}) {
+    ParkingFixture fx(10000, 0.5);
+    vector<vector<string>> plates(threads);
+    for (size_t t = 0; t < threads; ++t)
+      for (size_t i = 0; i < kPlates; ++i)
+        plates[t].push_back("f" + to_string(t) + "-" + to_string(i));
+    auto reader = *fx.svc.subscribe(fx.lots[0]);
+    atomic<bool> done{false};
+    thread tail([&] {
+      while (!done.load(memory_order_relaxed))
+        if (!reader.poll([](const ChangeFeed::Event&) {})) this_thread::yield();
+    });
+    Bench::print(Bench::run("parkVehicle/tailed", "spots=10000 occ=50%", threads, 20000,
+      [](size_t, size_t) {},
+      [&](size_t t, size_t i) { fx.svc.parkVehicle(fx.lotFor(t), plates[t][i % kPlates], VehicleType::Car); },
+      [&](size_t t, size_t i) { fx.svc.leaveVehicle(fx.lotFor(t), plates[t][i % kPlates]); }));
+    done = true;
+    tail.join();
+  }
+
+  // billing (3d): reports over 1M archived stays, for the whole history (block
+  // totals only) and for a window cutting through it (edge blocks scanned)
+  {
+    ParkingFixture fx(10000, 0.0);
+    vector<string> plates;
+    for (size_t i = 0; i < kPlates; ++i) plates.push_back("h" + to_string(i));
+    auto t0 = chrono::system_clock::now();
+    for (size_t i = 0; i < 1000000; ++i) {
+      fx.svc.parkVehicle(fx.lots[0], plates[i % kPlates], VehicleType::Car);
+      fx.svc.leaveVehicle(fx.lots[0], plates[i % kPlates]);
+    }
+    auto t1 = chrono::system_clock::now();
+    Bench::print(Bench::run("billingReport", "stays=1M all", 1, 200,
+      [&](size_t, size_t) { fx.svc.billingReport(fx.lots[0], t0, t1); }));
+    Bench::print(Bench::run("billingReport", "stays=1M window", 1, 200,
+      [&](size_t, size_t) { fx.svc.billingReport(fx.lots[0], t0 + (t1 - t0) / 3, t0 + (t1 - t0) / 2); }));
+    string dir = (filesystem::temp_directory_path() / "parkingLot-bench-billing").string();
+    filesystem::remove_all(dir);
+    Bench::print(Bench::run("flushBilling", "stays=1M", 1, 1,
+      [&](size_t, size_t) { fx.svc.flushBilling(dir); }));
+    filesystem::remove_all(dir);
+  }
+
+  // bulk load: each run adds another lot to the same service, so this also
+  // shows that creation cost does not grow with the lots already present
+  ParkingLotRepository lotRepo;
+  ParkingFloorRepository floorRepo;
+  ParkingSpotRepository spotRepo;
+  ParkingService svc(lotRepo, floorRepo, spotRepo);
+  for (int levels : {10, 50}) {
+    int perLevel = 10000;
+    Bench::print(Bench::run("createParkingLot", "spots=" + to_string(levels * perLevel), 1, 5,
+      [&](size_t, size_t) {
+        svc.createParkingLot(levels, perLevel, {{SpotType::Motorcycle, perLevel / 5},
+                                                {SpotType::Compact, perLevel - 2 * (perLevel / 5)},
+                                                {SpotType::Large, perLevel / 5}});
+      }));
+  }
+}
+
+// durable mode: group commit under concurrent traffic, then a restart of a
+// 100k-spot lot from its snapshot plus a log tail
+void runDurabilityBenchmarks() {
+  const string dir = (filesystem::temp_directory_path() / "parkingLot-bench-wal").string();
+  filesystem::remove_all(dir);
+  constexpr int kLevels = 10, kPerLevel = 10000;
+  map<SpotType,int> counts{{SpotType::Motorcycle, kPerLevel / 5},
+                           {SpotType::Compact, kPerLevel - 2 * (kPerLevel / 5)},
+                           {SpotType::Large, kPerLevel / 5}};
+  string params = "spots=" + to_string(kLevels * kPerLevel) + " occ=50%";
+  {
+    WriteAheadLog log(dir);
+    ParkingLotRepository lotRepo;
+    ParkingFloorRepository floorRepo;
+    ParkingSpotRepository spotRepo;
+    ParkingService svc(lotRepo, floorRepo, spotRepo, 1024, &log);
+    string lot = *svc.createParkingLot(kLevels, kPerLevel, counts);
+    for (int i = 0; i < kLevels * kPerLevel / 2; ++i)
+      svc.parkVehicle(lot, "pre-" + to_string(i), VehicleType::Car);
+    for (size_t threads : {1, 2, 4, 8}) {
+      Bench::print(Bench::run("parkVehicle+wal", params, threads, 2000,
+        [](size_t, size_t) {},
+        [&](size_t t, size_t i) { svc.parkVehicle(lot, "w" + to_string(t) + "-" + to_string(i % 256), VehicleType::Car); },
+        [&](size_t t, size_t i) { svc.leaveVehicle(lot, "w" + to_string(t) + "-" + to_string(i % 256)); }));
+    }
+    svc.checkpoint();
+    for (int i = 0; i < 10000; ++i)   // the tail recovery has to replay
+      svc.parkVehicle(lot, "tail-" + to_string(i), VehicleType::Car);
+  }
+
+  unique_ptr<WriteAheadLog> log;
+  unique_ptr<ParkingLotRepository> lotRepo;
+  unique_ptr<ParkingFloorRepository> floorRepo;
+  unique_ptr<ParkingSpotRepository> spotRepo;
+  unique_ptr<ParkingService> svc;
+  Bench::print(Bench::run("recover", params + " tail=10k", 1, 1,
+    [&](size_t, size_t) {
+      log = make_unique<WriteAheadLog>(dir);
+      lotRepo = make_unique<ParkingLotRepository>();
+      floorRepo = make_unique<ParkingFloorRepository>();
+      spotRepo = make_unique<ParkingSpotRepository>();
+      svc = make_unique<ParkingService>(*lotRepo, *floorRepo, *spotRepo, 1024, log.get());
+    },
+    [&](size_t, size_t) { svc->recover(); },
+    [](size_t, size_t) {}));
+  svc.reset();
+  log.reset();
+  filesystem::remove_all(dir);
+}
+
+// `./parkingLot cluster`: three nodes in this process, a router in front, and
+// the leader of one lot's partition going away with a car parked in it, then
+// coming back
+void runClusterDemo() {
+  const string root = (filesystem::temp_directory_path() / "parkingLot-cluster").string();
+  filesystem::remove_all(root);
+  vector<unique_ptr<ParkingNode>> nodes;
+  vector<Peer> peers;
+  for (int i = 0; i < 3; ++i) {
+    nodes.push_back(make_unique<ParkingNode>(root + "/node" + to_string(i), 0, parkingDispatch));
+    peers.push_back(Peer{"localhost", nodes.back()->port()});
+  }
+  ParkingRouter router(peers);
+  map<SpotType,int> counts{{SpotType::Motorcycle,2}, {SpotType::Compact,6}, {SpotType::Large,2}};
+  auto lot = router.createParkingLot(3, counts);
+  if (!lot || !router.parkVehicle(*lot, "KA01AB1234", VehicleType::Car)) {
+    cout << "Cluster did not take the lot\n";
+    return;
+  }
+  NodeId leader = router.leaderOf(*lot);
+  cout << "Lot " << *lot << " led by node " << leader << "\n";
+
+  // replication is asynchronous: let the follower catch up before pulling the plug
+  for (int i = 0; i < 200 && nodes[leader]->lag(partitionOf(*lot)); ++i)
+    this_thread::sleep_for(chrono::milliseconds(10));
+  nodes[leader].reset();
+
+  auto booking = router.parkVehicle(*lot, "KA02CD5678", VehicleType::Car);
+  cout << "Node " << leader << " down; lot now led by node " << router.leaderOf(*lot)
+       << (booking ? ", parked in booking " + *booking : string(", park failed")) << "\n";
+  cout << "Car parked before the failover "
+       << (router.leaveVehicle(*lot, "KA01AB1234") ? "left" : "was lost") << "\n";
+
+  // the node restarts on its old address and comes back as a follower
+  nodes[leader] = make_unique<ParkingNode>(root + "/node" + to_string(leader), peers[leader].port,
+                                           parkingDispatch);
+  bool back = router.rejoin(leader);
+  cout << "Node " << leader << (back ? " rejoined" : " could not rejoin") << "; lot still led by node "
+       << router.leaderOf(*lot) << ", second car "
+       << (router.leaveVehicle(*lot, "KA02CD5678") ? "left" : "was lost") << "\n";
+  nodes.clear();
+  filesystem::remove_all(root);
+}
+
+/*
+ 7) Load replay: `./parkingLot load [trace=<file>] [threads=4] [rate=<ops/s>]
+    [speed=1] [ops=200000] [seed=1] [mode=pooled] [emit=<file>]` (see loadGen.h)
+    Replays a gate trace against one ParkingService and checks, while it runs,
+    that no spot is ever held by two vehicles and no vehicle by two spots.
+    Without trace= it generates a seeded ten-second day with a morning rush that
+    fills the lots (emit= writes it out, for editing or replay elsewhere). Trace
+    format, one entry per line, `#` comments:
+      lot <levels> <motorcycle> <compact> <large> [mode]   spots per level
+      <ms> park <lot#> <plate> <M|C|T> [entrance]
+      <ms> leave <lot#> <plate>
+    The checker tails every lot's change feed: per spot (and per vehicle) feed
+    order is the apply order (3d), so a Parked event on a spot the shadow still
+    has taken is a double booking. At the end the shadow must agree with the
+    workers' own results and with getAvailabilityCounts(). Exit status 1 on any
+    violation.
+*/
+
+struct ParkingTrace {
+  struct Lot {
+    int levels;
+    array<int, kNumSpotTypes> perLevel;
+    AllocationMode mode;
+  };
+  struct Op {
+    bool park;
+    VehicleType type;
+    uint16_t lot;
+    uint16_t entrance;
+    uint32_t plate;   // index into plates
+  };
+  vector<Lot> lots;
+  vector<string> plates;
+  vector<Op> ops;
+  vector<LoadOp> schedule;   // parallel to ops, keyed by plate
+};
+
+static const array<string, 5> kModeNames{"pooled", "firstfit", "nearest", "lowest", "bestfit"};
+static const string kVehicleCodes = "MCT";
+
+optional<AllocationMode> parseMode(const string& s) {
+  auto it = find(kModeNames.begin(), kModeNames.end(), s);
+  if (it == kModeNames.end()) return nullopt;
+  return AllocationMode(it - kModeNames.begin());
+}
+
+optional<ParkingTrace> readParkingTrace(istream& in) {
+  ParkingTrace t;
+  unordered_map<string, uint32_t> plateIdx;
+  string line;
+  for (size_t n = 1; getline(in, line); ++n) {
+    istringstream ls(line.substr(0, line.find('#')));
+    string first, verb;
+    if (!(ls >> first)) continue;
+    bool ok = false;
+    if (first == "lot") {
+      ParkingTrace::Lot lot{0, {}, AllocationMode::Pooled};
+      string mode;
+      ok = bool(ls >> lot.levels >> lot.perLevel[0] >> lot.perLevel[1] >> lot.perLevel[2]) &&
+           lot.levels > 0;
+      // the same bounds a CreateLot RPC gets: no negative counts, no oversized lot
+      int64_t spots = 0;
+      for (int c : lot.perLevel) {
+        ok = ok && c >= 0;
+        spots += c;
+      }
+      ok = ok && int64_t(lot.levels) * spots <= kMaxRpcLotSpots;
+      if (ok && ls >> mode) ok = bool(parseMode(mode)), lot.mode = parseMode(mode).value_or(lot.mode);
+      if (ok) t.lots.push_back(lot);
+    } else {
+      uint64_t ms = 0;
+      size_t lot = 0;
+      string plate, type;
+      int entrance = 1;
+      ok = bool(istringstream(first) >> ms) && bool(ls >> verb >> lot >> plate) && lot < t.lots.size();
+      bool park = verb == "park";
+      if (ok && park) {
+        ok = bool(ls >> type) && type.size() == 1 && kVehicleCodes.find(type[0]) != string::npos;
+        if (!(ls >> entrance)) entrance = 1;
+      } else if (ok) {
+        ok = verb == "leave";
+      }
+      if (ok) {
+        auto [it, fresh] = plateIdx.try_emplace(plate, uint32_t(t.plates.size()));
+        if (fresh) t.plates.push_back(plate);
+        t.ops.push_back({park, park ? VehicleType(kVehicleCodes.find(type[0])) : VehicleType::Car,
+                         uint16_t(lot), uint16_t(max(entrance, 1)), it->second});
+        t.schedule.push_back({ms * 1000000, loadKey(plate)});
+      }
+    }
+    if (!ok) {
+      cerr << "trace line " << n << ": cannot parse '" << line << "'\n";
+      return nullopt;
+    }
+  }
+  return t;
+}
+
+void writeParkingTrace(ostream& out, const ParkingTrace& t) {
+  for (auto& l : t.lots)
+    out << "lot " << l.levels << ' ' << l.perLevel[0] << ' ' << l.perLevel[1] << ' '
+        << l.perLevel[2] << ' ' << kModeNames[size_t(l.mode)] << '\n';
+  for (size_t i = 0; i < t.ops.size(); ++i) {
+    auto& op = t.ops[i];
+    out << t.schedule[i].atNs / 1000000 << (op.park ? " park " : " leave ") << op.lot << ' '
+        << t.plates[op.plate];
+    if (op.park) out << ' ' << kVehicleCodes[size_t(op.type)] << ' ' << op.entrance;
+    out << '\n';
+  }
+}
+
+// four 10-level lots of 1000 spots; arrivals are 60% a morning rush (normal
+// around 30% of the day) and 40% spread over it, stays exponential with a mean
+// of a fortieth of the day, and a plate pool a tenth smaller than the arrivals,
+// so some drivers come back (and a few try to while still parked). Through the
+// peak of the rush the lots are full and parks are refused at the counters.
+ParkingTrace syntheticParkingTrace(size_t ops, uint64_t seed, AllocationMode mode) {
+  constexpr double kDayMs = 10000;
+  mt19937_64 rng(seed);
+  ParkingTrace t;
+  for (int l = 0; l < 4; ++l) t.lots.push_back({10, {20, 60, 20}, mode});
+  size_t cars = ops / 2;
+  for (size_t i = 0; i < max<size_t>(1, cars * 9 / 10); ++i)
+    t.plates.push_back("KA" + to_string(10 + i % 90) + "-" + to_string(100000 + i));
+  normal_distribution<double> rush(0.3 * kDayMs, 0.08 * kDayMs);
+  uniform_real_distribution<double> day(0, kDayMs), coin(0, 1);
+  exponential_distribution<double> stay(40 / kDayMs);
+  uniform_int_distribution<uint32_t> plate(0, uint32_t(t.plates.size() - 1));
+  vector<pair<double, ParkingTrace::Op>> timed;
+  while (timed.size() < ops) {
+    double at = coin(rng) < 0.6 ? rush(rng) : day(rng);
+    if (at < 0 || at >= kDayMs) continue;
+    double u = coin(rng);
+    VehicleType vt = u < 0.1 ? VehicleType::Motorcycle : u < 0.9 ? VehicleType::Car : VehicleType::Truck;
+    ParkingTrace::Op op{true, vt, uint16_t(rng() % t.lots.size()), uint16_t(1 + rng() % 10), plate(rng)};
+    timed.push_back({at, op});
+    if (double leave = at + stay(rng); leave < kDayMs && timed.size() < ops) {
+      op.park = false;
+      timed.push_back({leave, op});
+    }
+  }
+  stable_sort(timed.begin(), timed.end(), [](auto& a, auto& b) { return a.first < b.first; });
+  for (auto& [at, op] : timed) {
+    t.ops.push_back(op);
+    t.schedule.push_back({uint64_t(at * 1e6), loadKey(t.plates[op.plate])});
+  }
+  return t;
+}
+
+// tails every lot's feed on its own thread and keeps a shadow of who holds
+// which spot; anything the service could not have done is a violation
+class ParkingChecker {
+public:
+  ParkingChecker(ParkingService& svc, const vector<string>& lots, const ParkingTrace& trace)
+    : svc_(svc), lotIds_(lots) {
+    for (size_t l = 0; l < lots.size(); ++l) {
+      auto& cfg = trace.lots[l];
+      size_t spots = size_t(cfg.levels) * size_t(cfg.perLevel[0] + cfg.perLevel[1] + cfg.perLevel[2]);
+      lots_.push_back(LotState{*svc.subscribe(lots[l]), vector<string>(spots), {}});
+    }
+    thread_ = thread([this] {
+      while (!stop_.load(memory_order_acquire))
+        if (!drain()) this_thread::yield();
+      drain();
+    });
+  }
+
+  // stops tailing and compares the shadow with the service and with the
+  // workers' view (parked[lot] = plates the workers left parked)
+  void finish(const vector<unordered_set<string>>& parked) {
+    stop_.store(true, memory_order_release);
+    thread_.join();
+    for (size_t l = 0; l < lots_.size(); ++l) {
+      auto& s = lots_[l];
+      if (s.reader.lost()) continue;   // shadow incomplete: reported by print()
+      if (s.parkedAt.size() != parked[l].size())
+        violation("lot " + to_string(l) + ": feed shows " + to_string(s.parkedAt.size()) +
+                  " parked, workers " + to_string(parked[l].size()));
+      for (auto& p : parked[l])
+        if (!s.parkedAt.count(p)) violation("lot " + to_string(l) + ": " + p + " parked but never in the feed");
+      auto counts = svc_.getAvailabilityCounts(lotIds_[l]);
+      uint64_t free = counts ? uint64_t(counts->byType[0]) + counts->byType[1] + counts->byType[2] : 0;
+      if (free + s.parkedAt.size() != s.holder.size())
+        violation("lot " + to_string(l) + ": " + to_string(free) + " free + " +
+                  to_string(s.parkedAt.size()) + " parked != " + to_string(s.holder.size()) + " spots");
+    }
+  }
+
+  // prints the verdict; true when nothing was violated
+  bool print() const {
+    uint64_t lost = 0;
+    for (auto& s : lots_) lost += s.reader.lost();
+    printf("checker: %llu feed events, %zu violations", (unsigned long long)events_, violations_);
+    if (lost) printf(", %llu events lost (checker fell behind; those lots are unchecked after the gap)",
+                     (unsigned long long)lost);
+    printf("\n");
+    for (auto& v : firstViolations_) printf("  %s\n", v.c_str());
+    return violations_ == 0;
+  }
+
+private:
+  struct LotState {
+    ChangeFeed::Reader reader;
+    vector<string> holder;                      // by spot index; empty = free
+    unordered_map<string, uint32_t> parkedAt;   // plate -> spot
+  };
+
+  size_t drain() {
+    size_t n = 0;
+    for (size_t l = 0; l < lots_.size(); ++l) {
+      auto& s = lots_[l];
+      n += s.reader.poll([&](const ChangeFeed::Event& e) {
+        if (s.reader.lost()) return;   // past a gap the shadow is guesswork
+        apply(l, s, SpotEvent(e.type), e.as<SpotChange>());
+      });
+    }
+    events_ += n;
+    return n;
+  }
+
+  void apply(size_t l, LotState& s, SpotEvent ev, const SpotChange& c) {
+    string plate(c.vehicleId());
+    string where = "lot " + to_string(l) + " spot " + to_string(c.spot) + ": ";
+    if (c.spot >= s.holder.size()) return violation(where + "no such spot");
+    if (ev == SpotEvent::Parked) {
+      if (!s.holder[c.spot].empty())
+        violation(where + plate + " parked while " + s.holder[c.spot] + " holds it");
+      if (auto it = s.parkedAt.find(plate); it != s.parkedAt.end())
+        violation(where + plate + " parked while still in spot " + to_string(it->second));
+      s.holder[c.spot] = plate;
+      s.parkedAt[plate] = c.spot;
+    } else if (ev == SpotEvent::Left) {
+      if (s.holder[c.spot] != plate)
+        violation(where + plate + " left a spot held by '" + s.holder[c.spot] + "'");
+      s.holder[c.spot].clear();
+      s.parkedAt.erase(plate);
+    }
+  }
+
+  void violation(string what) {
+    if (violations_++ < 10) firstViolations_.push_back(move(what));
+  }
+
+  ParkingService& svc_;
+  const vector<string>& lotIds_;
+  vector<LotState> lots_;
+  uint64_t events_ = 0;
+  size_t violations_ = 0;
+  vector<string> firstViolations_;
+  atomic<bool> stop_{false};
+  thread thread_;
+};
+
+int runLoad(int argc, char** argv) {
+  auto opts = loadOptions(argc, argv);
+  if (!opts) return 2;
+  optional<ParkingTrace> trace;
+  if (auto file = loadArg(argc, argv, "trace")) {
+    ifstream in(*file);
+    if (!in) {
+      cerr << "cannot open " << *file << "\n";
+      return 2;
+    }
+    trace = readParkingTrace(in);
+    if (!trace) return 2;
+  } else {
+    auto mode = parseMode(loadArg(argc, argv, "mode").value_or("pooled"));
+    if (!mode) {
+      cerr << "mode= is one of pooled, firstfit, nearest, lowest, bestfit\n";
+      return 2;
+    }
+    auto ops = loadNum<size_t>(argc, argv, "ops", 200000);
+    auto seed = loadNum<uint64_t>(argc, argv, "seed", 1);
+    if (!ops || !seed) return 2;
+    trace = syntheticParkingTrace(*ops, *seed, *mode);
+  }
+  if (auto file = loadArg(argc, argv, "emit")) {
+    ofstream out(*file);
+    writeParkingTrace(out, *trace);
+  }
+
+  ParkingLotRepository lotRepo;
+  ParkingFloorRepository floorRepo;
+  ParkingSpotRepository spotRepo;
+  ParkingService svc(lotRepo, floorRepo, spotRepo);
+  vector<string> lots;
+  for (auto& l : trace->lots) {
+    int perLevel = l.perLevel[0] + l.perLevel[1] + l.perLevel[2];
+    lots.push_back(*svc.createParkingLot(l.levels, perLevel,
+                                         {{SpotType::Motorcycle, l.perLevel[0]},
+                                          {SpotType::Compact, l.perLevel[1]},
+                                          {SpotType::Large, l.perLevel[2]}}, l.mode));
+  }
+  printf("replaying %zu ops over %zu lots on %zu threads\n", trace->ops.size(), lots.size(), opts->threads);
+
+  // a plate's ops all run on one worker, so its slots here are only ever touched by that worker
+  vector<vector<uint8_t>> parked(lots.size(), vector<uint8_t>(trace->plates.size()));
+  ParkingChecker checker(svc, lots, *trace);
+  auto report = LoadGen::run(trace->schedule, *opts, [&](size_t, size_t i) {
+    auto& op = trace->ops[i];
+    const string& plate = trace->plates[op.plate];
+    if (op.park) {
+      if (!svc.parkVehicle(lots[op.lot], plate, op.type, op.entrance)) return false;
+      parked[op.lot][op.plate] = 1;
+      return true;
+    }
+    if (!svc.leaveVehicle(lots[op.lot], plate)) return false;
+    parked[op.lot][op.plate] = 0;
+    return true;
+  });
+  vector<unordered_set<string>> stillParked(lots.size());
+  for (size_t l = 0; l < lots.size(); ++l)
+    for (size_t p = 0; p < trace->plates.size(); ++p)
+      if (parked[l][p]) stillParked[l].insert(trace->plates[p]);
+  checker.finish(stillParked);
+  LoadGen::print(report, opts->interval);
+  return checker.print() ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && string(argv[1]) == "bench") {
+    runBenchmarks();
+    runDurabilityBenchmarks();
+    return 0;
+  }
+  if (argc > 1 && string(argv[1]) == "cluster") {
+    runClusterDemo();
+    return 0;
+  }
+  if (argc > 1 && string(argv[1]) == "load") return runLoad(argc, argv);
+
+  // example usage
+  ParkingLotRepository lotRepo;
+  ParkingFloorRepository floorRepo;
+  ParkingSpotRepository spotRepo;
+  ParkingService svc(lotRepo, floorRepo, spotRepo);
+
+  // create a 3-level lot, 10 spots each: 2 motorcycle, 6 compact, 2 large per level
+  map<SpotType,int> counts{{SpotType::Motorcycle,2},
+                           {SpotType::Compact,6},
+                           {SpotType::Large,2}};
+  auto lotId = svc.createParkingLot(3, 10, counts);
+
+  auto booking = svc.parkVehicle(*lotId, "KA01AB1234", VehicleType::Car);
+  if (booking) cout << "Parked in booking " << *booking << "\n";
+  else         cout << "Lot full!\n";
+
+  if (auto r = svc.checkout(*lotId, "KA01AB1234"))
+    cout << "Left " << r->spotId << ", fee " << r->feeCents << " cents\n";
 
-  svc.leaveVehicle("KA01AB1234");
+  // `./parkingLot metrics`: what a Prometheus scrape of this process would see
+  if (argc > 1 && string(argv[1]) == "metrics") cout << metrics::scrape();
   return 0;
 }
@@ -0,0 +1,937 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "epoch.h"
+#include "writeAheadLog.h"
+
+/*
+ Partitioning: one service spread over several processes (nodes).
+
+ A key (lot ID, room ID) hashes to one of kPartitions fixed arcs of a 64-bit
+ ring, so its partition never changes. Partitions are placed on nodes by
+ consistent hashing (HashRing, kVnodes points per node): a partition starts
+ out led by the first node clockwise from its arc and followed by the next
+ distinct node. Losing a node moves only the partitions it led or followed,
+ and the new leader of each is the node that was already following it.
+
+ Each partition is one service instance over its own WriteAheadLog in
+ <root>/p<NN> on its leader. A WalShipper tails that log and sends every
+ durable record, the segment boundaries and each new snapshot to the
+ follower, whose WalMirror writes them to the same path. Any other file in
+ the directory (a billing archive a checkpoint wrote beside the log) must
+ only ever be appended to; the shipper sends what the follower lacks of each
+ one before every snapshot, so the follower never drops a record whose
+ archived rows it does not have. Opening the service on the follower's
+ directory is then exactly a restart of the leader: one partition's snapshot,
+ its side files and its tail, nothing else reloaded. Replication is
+ asynchronous: a failover loses what the shipper had not sent yet, lag()
+ bytes, typically one group-commit batch. The leader retain()s its log from
+ the follower's position, so a checkpoint never drops a segment the follower
+ still needs.
+
+ RPC is one request frame and one reply frame over TCP, framed like a WAL
+ record: [u32 length][u32 crc32][u8 method][payload]. RpcClient pools
+ connections per peer and reports a failed call as nullopt, saying whether the
+ request left in full. One that never did (the peer refused the connection)
+ was not applied: PartitionRouter takes the node as down, drops it from its
+ ring, hands its partitions to their followers (Lead) and sends the call to
+ the new leader. One that did but got no answer in time may have been applied,
+ so the router returns the failure to its caller instead of resending a Park
+ or a Book, and leaves the node in place. A node that was dropped comes back
+ through rejoin(): it discards what it held and follows partitions until a
+ later failover promotes it. There is no fencing: a leader that is only cut
+ off from the router keeps its clients, so run one router tier per deployment.
+*/
+
+using NodeId = uint32_t;
+
+constexpr uint32_t kPartitionBits = 5;   // fixes the key -> partition map: pick before the first deploy
+constexpr uint32_t kPartitions = 1u << kPartitionBits;
+
+// FNV-1a with a murmur3 finaliser: stable across processes and builds, unlike std::hash
+inline uint64_t ringHash(std::string_view s) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (unsigned char c : s) h = (h ^ c) * 0x100000001b3ull;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  return h ^ (h >> 33);
+}
+
+inline uint32_t partitionOf(std::string_view key) {
+  return uint32_t(ringHash(key) >> (64 - kPartitionBits));
+}
+
+class HashRing {
+public:
+  static constexpr size_t kVnodes = 64;
+
+  void add(NodeId n) {
+    if (contains(n)) return;
+    for (size_t v = 0; v < kVnodes; ++v)
+      points_.emplace_back(ringHash("node-" + std::to_string(n) + "#" + std::to_string(v)), n);
+    std::sort(points_.begin(), points_.end());
+  }
+  void remove(NodeId n) {
+    points_.erase(std::remove_if(points_.begin(), points_.end(),
+                                 [&](auto& pt) { return pt.second == n; }),
+                  points_.end());
+  }
+  bool contains(NodeId n) const {
+    return std::any_of(points_.begin(), points_.end(), [&](auto& pt) { return pt.second == n; });
+  }
+
+  // up to n distinct nodes clockwise from the partition's arc: leader, then followers
+  std::vector<NodeId> owners(uint32_t partition, size_t n = 2) const {
+    std::vector<NodeId> res;
+    if (points_.empty()) return res;
+    uint64_t at = uint64_t(partition) << (64 - kPartitionBits);
+    size_t i = std::lower_bound(points_.begin(), points_.end(), std::make_pair(at, NodeId(0))) - points_.begin();
+    for (size_t k = 0; k < points_.size() && res.size() < n; ++k) {
+      NodeId node = points_[(i + k) % points_.size()].second;
+      if (std::find(res.begin(), res.end(), node) == res.end()) res.push_back(node);
+    }
+    return res;
+  }
+
+private:
+  std::vector<std::pair<uint64_t, NodeId>> points_;   // sorted by ring position
+};
+
+// ——— RPC ———
+
+struct Peer {
+  std::string host;
+  uint16_t port = 0;
+};
+
+namespace rpc {
+
+constexpr uint32_t kMaxFrame = 64u << 20;
+constexpr std::chrono::milliseconds kTimeout{2000};
+
+inline bool writeAll(int fd, const char* p, size_t n) {
+  while (n > 0) {
+    ssize_t w = ::send(fd, p, n, MSG_NOSIGNAL);
+    if (w <= 0) return false;
+    p += w;
+    n -= size_t(w);
+  }
+  return true;
+}
+
+inline bool readAll(int fd, char* p, size_t n) {
+  while (n > 0) {
+    ssize_t r = ::recv(fd, p, n, 0);
+    if (r <= 0) return false;
+    p += r;
+    n -= size_t(r);
+  }
+  return true;
+}
+
+inline bool sendFrame(int fd, uint8_t tag, std::string_view payload) {
+  uint32_t len = uint32_t(payload.size() + 1);
+  uint32_t crc = crc32(payload.data(), payload.size(), crc32(&tag, 1));
+  std::string f;
+  f.reserve(9 + payload.size());
+  f.append(reinterpret_cast<const char*>(&len), 4);
+  f.append(reinterpret_cast<const char*>(&crc), 4);
+  f.push_back(char(tag));
+  f.append(payload.data(), payload.size());
+  return writeAll(fd, f.data(), f.size());
+}
+
+// nullopt on a closed, timed-out or corrupt connection
+inline std::optional<std::pair<uint8_t, std::string>> recvFrame(int fd) {
+  char hdr[8];
+  if (!readAll(fd, hdr, 8)) return std::nullopt;
+  uint32_t len, crc;
+  std::memcpy(&len, hdr, 4);
+  std::memcpy(&crc, hdr + 4, 4);
+  if (len == 0 || len > kMaxFrame) return std::nullopt;
+  std::string body(len, '\0');
+  if (!readAll(fd, body.data(), len) || crc32(body.data(), len) != crc) return std::nullopt;
+  uint8_t tag = uint8_t(body[0]);
+  body.erase(0, 1);
+  return std::make_pair(tag, std::move(body));
+}
+
+inline void tune(int fd) {
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+  timeval tv{kTimeout.count() / 1000, (kTimeout.count() % 1000) * 1000};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+}
+
+}  // namespace rpc
+
+// one thread per connection: peers are routers and shippers holding a few pooled
+// connections each, not end users
+class RpcServer {
+public:
+  using Handler = std::function<std::string(uint8_t method, std::string_view payload)>;
+
+  // listens on every interface; port 0 picks a free one (see port())
+  RpcServer(uint16_t port, Handler h) : handler_(std::move(h)) {
+    listen_ = ::socket(AF_INET6, SOCK_STREAM, 0);
+    if (listen_ < 0) ioFail("socket");
+    int one = 1, zero = 0;
+    ::setsockopt(listen_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    ::setsockopt(listen_, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof zero);
+    sockaddr_in6 addr{};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    socklen_t n = sizeof addr;
+    if (::bind(listen_, reinterpret_cast<sockaddr*>(&addr), n) != 0 || ::listen(listen_, 128) != 0 ||
+        ::getsockname(listen_, reinterpret_cast<sockaddr*>(&addr), &n) != 0)
+      ioFail("listen");
+    port_ = ntohs(addr.sin6_port);
+    acceptor_ = std::thread([this] { acceptLoop(); });
+  }
+
+  ~RpcServer() { stop(); }
+  RpcServer(const RpcServer&) = delete;
+  RpcServer& operator=(const RpcServer&) = delete;
+
+  uint16_t port() const { return port_; }
+
+  // stops accepting, cuts every connection and waits for the handlers to return
+  void stop() {
+    if (stopped_.exchange(true)) return;
+    ::shutdown(listen_, SHUT_RDWR);
+    acceptor_.join();
+    ::close(listen_);
+    std::vector<std::thread> workers;
+    {
+      std::lock_guard lock(mtx_);
+      for (int fd : conns_) ::shutdown(fd, SHUT_RDWR);
+      workers.swap(workers_);
+    }
+    for (auto& t : workers) t.join();
+  }
+
+private:
+  void acceptLoop() {
+    for (;;) {
+      int fd = ::accept(listen_, nullptr, nullptr);
+      if (fd < 0) {
+        if (stopped_) return;
+        continue;
+      }
+      rpc::tune(fd);
+      timeval idle{0, 0};   // a pooled connection may sit idle for as long as it likes
+      ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof idle);
+      std::lock_guard lock(mtx_);
+      if (stopped_) {
+        ::close(fd);
+        return;
+      }
+      conns_.push_back(fd);
+      workers_.emplace_back([this, fd] { serve(fd); });
+    }
+  }
+
+  void serve(int fd) {
+    while (auto req = rpc::recvFrame(fd))
+      if (!rpc::sendFrame(fd, 0, handler_(req->first, req->second))) break;
+    std::lock_guard lock(mtx_);
+    conns_.erase(std::find(conns_.begin(), conns_.end(), fd));
+    ::close(fd);
+  }
+
+  Handler handler_;
+  int listen_ = -1;
+  uint16_t port_ = 0;
+  std::atomic<bool> stopped_{false};
+  std::mutex mtx_;
+  std::vector<int> conns_;
+  std::vector<std::thread> workers_;
+  std::thread acceptor_;
+};
+
+class RpcClient {
+public:
+  explicit RpcClient(Peer peer) : peer_(std::move(peer)) {}
+  ~RpcClient() {
+    for (int fd : idle_) ::close(fd);
+  }
+  RpcClient(const RpcClient&) = delete;
+  RpcClient& operator=(const RpcClient&) = delete;
+
+  const Peer& peer() const { return peer_; }
+
+  // the reply payload, or nullopt when the peer cannot be reached or answer in
+  // time. Never retried here: the request may have been applied. `sent`, if
+  // given, is false when the request never left in full, so the peer cannot
+  // have applied it.
+  std::optional<std::string> call(uint8_t method, std::string_view payload, bool* sent = nullptr) {
+    if (sent) *sent = false;
+    int fd = acquire();
+    if (fd < 0) return std::nullopt;
+    if (rpc::sendFrame(fd, method, payload)) {
+      if (sent) *sent = true;
+      if (auto reply = rpc::recvFrame(fd)) {
+        std::lock_guard lock(mtx_);
+        idle_.push_back(fd);
+        return std::move(reply->second);
+      }
+    }
+    ::close(fd);
+    return std::nullopt;
+  }
+
+private:
+  int acquire() {
+    {
+      std::lock_guard lock(mtx_);
+      while (!idle_.empty()) {
+        int fd = idle_.back();
+        idle_.pop_back();
+        // an idle connection has nothing to read: readable means the peer closed it
+        pollfd p{fd, POLLIN, 0};
+        if (::poll(&p, 1, 0) == 0) return fd;
+        ::close(fd);
+      }
+    }
+    return connect();
+  }
+
+  // non-blocking connect, so a dead host costs kTimeout, not the kernel's minutes
+  int connect() const {
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_socktype = SOCK_STREAM;
+    if (::getaddrinfo(peer_.host.c_str(), std::to_string(peer_.port).c_str(), &hints, &res) != 0)
+      return -1;
+    int fd = -1;
+    for (addrinfo* a = res; a && fd < 0; a = a->ai_next) {
+      fd = ::socket(a->ai_family, a->ai_socktype | SOCK_NONBLOCK, a->ai_protocol);
+      if (fd < 0) continue;
+      int err = 0;
+      socklen_t n = sizeof err;
+      pollfd p{fd, POLLOUT, 0};
+      bool ok = ::connect(fd, a->ai_addr, a->ai_addrlen) == 0 ||
+                (errno == EINPROGRESS && ::poll(&p, 1, int(rpc::kTimeout.count())) == 1 &&
+                 ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &n) == 0 && err == 0);
+      if (!ok) {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+    ::freeaddrinfo(res);
+    if (fd < 0) return -1;
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    rpc::tune(fd);
+    return fd;
+  }
+
+  const Peer peer_;
+  std::mutex mtx_;
+  std::vector<int> idle_;
+};
+
+// ——— WAL replication ———
+// Methods from kReservedMethods up belong to the node layer; services use the ones below.
+
+enum class NodeRpc : uint8_t {
+  Ship = 0xf0,   // leader -> follower: records appended past an LSN
+  ShipSnapshot,  // leader -> follower: the leader's latest snapshot
+  Lead,          // router -> node: lead a partition, shipping to the given follower
+  Drop,          // router -> node: forget a partition, led or followed, and its files
+  ShipFile,      // leader -> follower: the end of an append-only file beside the log
+};
+constexpr uint8_t kReservedMethods = 0xf0;
+
+// a file in a partition's directory that is not the log's own: append-only
+// (see the comment at the top), shipped by WalShipper
+inline bool sideFile(std::string_view name) {
+  return !name.empty() && name[0] != '.' && name.find('/') == std::string_view::npos &&
+         name != "snapshot" && name != "snapshot.tmp" &&
+         !(name.size() >= 4 && name.compare(name.size() - 4, 4, ".wal") == 0);
+}
+
+// first byte of every reply from a PartitionNode
+enum class NodeStatus : uint8_t { Ok, NotLeader, BadRequest };
+
+// Follower side of one partition: appends shipped records to its own log at the
+// leader's LSNs, rotating where the leader did, and installs shipped snapshots.
+class WalMirror {
+public:
+  explicit WalMirror(std::string dir) : dir_(std::move(dir)), log_(std::make_unique<WriteAheadLog>(dir_)) {}
+
+  // Ship payload after the partition: [u64 from][u8 segment starts at from]
+  // [u32 n][n x (u8 type, str payload)]. Applies it if `from` is where this log
+  // ends; replies with the LSN it ends at, from which the leader continues.
+  uint64_t ship(BinReader& r) {
+    uint64_t from = r.get<uint64_t>();
+    bool segStart = r.get<uint8_t>();
+    uint32_t n = r.get<uint32_t>();
+    if (!r.ok() || from != log_->appended()) return log_->appended();
+    if (segStart) log_->rotate();
+    uint64_t lsn = from;
+    for (uint32_t i = 0; i < n; ++i) {
+      uint8_t type = r.get<uint8_t>();
+      std::string_view payload = r.getStr();
+      if (!r.ok()) break;   // a torn frame cannot pass the crc; keep what decoded
+      lsn = log_->append(type, payload);
+    }
+    log_->waitDurable(lsn);
+    return lsn;
+  }
+
+  // ShipSnapshot payload after the partition: [u64 lsn][u8 restart][str snapshot
+  // payload]. restart: this copy is unusable, continue from the snapshot (or,
+  // with lsn 0 and no payload, from nothing); else the snapshot only lets this
+  // copy compact the segments before lsn, which it already has
+  uint64_t install(BinReader& r) {
+    uint64_t lsn = r.get<uint64_t>();
+    bool restart = r.get<uint8_t>();
+    std::string_view payload = r.getStr();
+    if (!r.ok() || (!restart && log_->appended() < lsn)) return log_->appended();
+    if (restart) {
+      log_.reset();
+      ::unlink((dir_ + "/snapshot").c_str());
+      WriteAheadLog::startAt(dir_, lsn);
+      log_ = std::make_unique<WriteAheadLog>(dir_);
+    }
+    if (!payload.empty()) {
+      writeSnapshot(dir_, lsn, payload);
+      log_->dropBefore(lsn);
+    }
+    return log_->appended();
+  }
+
+  // ShipFile payload after the partition: [str name][u64 offset][str bytes]. Cuts
+  // this copy of side file `name` back to offset if it is longer (the leader's
+  // copy is the truth), appends the bytes if it then ends at offset, and replies
+  // with where it ends; nullopt for a name that is not a side file
+  std::optional<uint64_t> file(BinReader& r) {
+    std::string name(r.getStr());
+    uint64_t offset = r.get<uint64_t>();
+    std::string_view bytes = r.getStr();
+    if (!r.ok() || !sideFile(name)) return std::nullopt;
+    std::string path = dir_ + "/" + name;
+    bool fresh = ::access(path.c_str(), F_OK) != 0;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) ioFail("open side file");
+    uint64_t size = uint64_t(::lseek(fd, 0, SEEK_END));
+    if (size > offset) {
+      if (::ftruncate(fd, off_t(offset)) != 0) ioFail("truncate side file");
+      size = offset;
+    }
+    if (size == offset && !bytes.empty()) {
+      for (size_t done = 0; done < bytes.size();) {
+        ssize_t w = ::pwrite(fd, bytes.data() + done, bytes.size() - done, off_t(size + done));
+        if (w <= 0) ioFail("write side file");
+        done += size_t(w);
+      }
+      size += bytes.size();
+    }
+    if (::fsync(fd) != 0) ioFail("fsync side file");
+    ::close(fd);
+    if (fresh) {
+      int d = ::open(dir_.c_str(), O_RDONLY);
+      if (d >= 0) { ::fsync(d); ::close(d); }
+    }
+    return size;
+  }
+
+private:
+  const std::string dir_;
+  std::unique_ptr<WriteAheadLog> log_;
+};
+
+// Leader side of one partition: a thread that ships `log` to the follower in
+// LSN order, in batches of up to kMaxBatch bytes, each one acknowledged
+// durable by the follower before the next, and holds the log's retain() floor
+// at what the follower has. The side files beside the log go over ahead of
+// each snapshot, in the same batch size, from where the follower's copy ends.
+class WalShipper {
+public:
+  static constexpr size_t kMaxBatch = 1 << 20;
+  static constexpr std::chrono::milliseconds kIdle{100}, kRetry{200}, kSnapshotPoll{1000};
+
+  WalShipper(uint32_t partition, WriteAheadLog& log, Peer follower)
+    : partition_(partition), log_(log), follower_(std::move(follower)) {
+    thread_ = std::thread([this] { run(); });
+  }
+
+  ~WalShipper() {
+    stop();
+    thread_.join();
+    log_.retain(UINT64_MAX);
+  }
+
+  // lets the thread finish its current step; the destructor waits for it. A
+  // node going down stops all its shippers first, so they wind down together.
+  void stop() { stop_ = true; }
+
+  const Peer& follower() const { return follower_.peer(); }
+
+  // bytes appended on the leader the follower has not acknowledged
+  uint64_t lag() {
+    uint64_t sent = sent_.load(std::memory_order_relaxed);
+    uint64_t end = log_.appended();
+    return sent == kUnknown ? end : end - std::min(end, sent);
+  }
+
+private:
+  static constexpr uint64_t kUnknown = UINT64_MAX;
+
+  // each step returns the follower's new position: unchanged when there was
+  // nothing to send, kUnknown when it answered from somewhere else (ask again),
+  // nullopt when it could not be reached (back off, then ask again)
+  void run() {
+    uint64_t snapShipped = 0;
+    auto snapChecked = std::chrono::steady_clock::time_point{};
+    while (!stop_) {
+      uint64_t sent = sent_.load(std::memory_order_relaxed);
+      std::optional<uint64_t> at;
+      if (sent == kUnknown) {
+        at = handshake();
+      } else {
+        uint64_t durable = log_.waitPast(sent, kIdle);
+        at = sent;
+        if (auto now = std::chrono::steady_clock::now(); now - snapChecked >= kSnapshotPoll) {
+          snapChecked = now;
+          at = shipSnapshot(sent, snapShipped);
+        }
+        if (at == sent && durable > sent) at = shipRecords(sent, durable);
+      }
+      if (!at) {
+        files_.clear();
+        sent_.store(kUnknown, std::memory_order_relaxed);
+        std::this_thread::sleep_for(kRetry);
+        continue;
+      }
+      sent_.store(*at, std::memory_order_relaxed);
+      if (*at != kUnknown) log_.retain(*at);
+    }
+  }
+
+  static std::optional<uint64_t> position(const std::optional<std::string>& r) {
+    if (!r || r->size() != 1 + sizeof(uint64_t) || NodeStatus((*r)[0]) != NodeStatus::Ok)
+      return std::nullopt;
+    uint64_t lsn;
+    std::memcpy(&lsn, r->data() + 1, sizeof lsn);
+    return lsn;
+  }
+
+  // where the follower's copy ends; if this log cannot continue from there,
+  // restart the follower at the latest snapshot (or at an empty log)
+  std::optional<uint64_t> handshake() {
+    BinWriter probe;
+    probe.put(partition_);
+    probe.put(kUnknown);
+    probe.put(uint8_t(0));
+    probe.put(uint32_t(0));
+    auto at = position(follower_.call(uint8_t(NodeRpc::Ship), probe.data()));
+    if (!at) return std::nullopt;
+    auto segs = WriteAheadLog::segmentStarts(log_.dir());
+    if (!segs.empty() && *at >= segs.front() && *at <= log_.appended()) return at;
+
+    if (!shipFiles()) return std::nullopt;
+    BinWriter w;
+    w.put(partition_);
+    if (!withSnapshot(log_.dir(), [&](uint64_t lsn, std::string_view payload) {
+          w.put(lsn);
+          w.put(uint8_t(1));
+          w.putStr(payload);
+        })) {
+      w.put(uint64_t(0));
+      w.put(uint8_t(1));
+      w.putStr({});
+    }
+    return position(follower_.call(uint8_t(NodeRpc::ShipSnapshot), w.data()));
+  }
+
+  // a snapshot taken since the last one shipped, once the follower is past its LSN
+  std::optional<uint64_t> shipSnapshot(uint64_t sent, uint64_t& shipped) {
+    BinWriter w;
+    w.put(partition_);
+    uint64_t at = 0;
+    withSnapshot(log_.dir(), [&](uint64_t lsn, std::string_view payload) {
+      if (lsn <= shipped || lsn > sent) return;
+      w.put(lsn);
+      w.put(uint8_t(0));
+      w.putStr(payload);
+      at = lsn;
+    });
+    if (!at) return sent;
+    if (!shipFiles()) return std::nullopt;
+    auto pos = position(follower_.call(uint8_t(NodeRpc::ShipSnapshot), w.data()));
+    if (pos) shipped = at;
+    return pos;
+  }
+
+  // one batch from `sent`, never across a segment start, so the follower can
+  // rotate exactly where this log did
+  std::optional<uint64_t> shipRecords(uint64_t sent, uint64_t durable) {
+    auto segs = WriteAheadLog::segmentStarts(log_.dir());
+    auto next = std::upper_bound(segs.begin(), segs.end(), sent);
+    uint64_t upto = next == segs.end() ? durable : std::min(durable, *next);
+    BinWriter body;
+    uint32_t n = 0;
+    size_t bytes = 0;
+    uint64_t end = WriteAheadLog::readFrom(log_.dir(), sent, upto,
+        [&](uint8_t type, std::string_view payload, uint64_t) {
+          body.put(type);
+          body.putStr(payload);
+          ++n;
+          bytes += payload.size() + 5;
+          return bytes < kMaxBatch;
+        });
+    if (end == sent) return std::nullopt;   // unreadable from here: back off and re-handshake
+    BinWriter w;
+    w.put(partition_);
+    w.put(sent);
+    w.put(uint8_t(std::binary_search(segs.begin(), segs.end(), sent)));
+    w.put(n);
+    auto pos = position(follower_.call(uint8_t(NodeRpc::Ship), w.data() + body.data()));
+    if (pos && *pos != end) return kUnknown;
+    return pos;
+  }
+
+  // brings the follower's copy of every side file up to this one's current
+  // length; the first exchange for a file sends no bytes and only learns where
+  // the follower's copy ends. false if the follower could not be reached
+  bool shipFiles() {
+    std::error_code ec;
+    for (auto& e : std::filesystem::directory_iterator(log_.dir(), ec)) {
+      std::string name = e.path().filename().string();
+      if (!sideFile(name) || !e.is_regular_file(ec)) continue;
+      uint64_t size = e.file_size(ec);
+      if (ec) continue;   // gone since the listing
+      auto it = files_.try_emplace(name, kUnknown).first;
+      while (it->second == kUnknown || it->second < size) {
+        uint64_t from = it->second == kUnknown ? size : it->second;
+        std::string chunk(std::min<uint64_t>(size - from, kMaxBatch), '\0');
+        if (!chunk.empty() && !readAt(e.path().string(), from, chunk)) break;
+        BinWriter w;
+        w.put(partition_);
+        w.putStr(name);
+        w.put(from);
+        w.putStr(chunk);
+        auto pos = position(follower_.call(uint8_t(NodeRpc::ShipFile), w.data()));
+        if (!pos) return false;
+        if (*pos == it->second) break;   // no progress: leave it for the next snapshot
+        it->second = *pos;
+      }
+    }
+    return true;
+  }
+
+  static bool readAt(const std::string& path, uint64_t at, std::string& buf) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    size_t done = 0;
+    while (done < buf.size()) {
+      ssize_t n = ::pread(fd, buf.data() + done, buf.size() - done, off_t(at + done));
+      if (n <= 0) break;
+      done += size_t(n);
+    }
+    ::close(fd);
+    return done == buf.size();
+  }
+
+  const uint32_t partition_;
+  WriteAheadLog& log_;
+  RpcClient follower_;
+  std::map<std::string, uint64_t> files_;   // side file -> length of the follower's copy
+  std::atomic<uint64_t> sent_{kUnknown};   // LSN the follower has durable
+  std::atomic<bool> stop_{false};
+  std::thread thread_;   // last member: starts after everything it touches exists
+};
+
+// ——— Nodes and routing ———
+
+// One process's share of a partitioned service. Part bundles one partition's
+// service: built from the partition's directory, it opens its WriteAheadLog
+// there and recover()s, and exposes that log as log(). A partition slot is
+// empty, a follower's WalMirror or a live Part; Lead turns the mirror into a
+// live Part in place, so a promotion replays one partition from local disk.
+// Calls below kReservedMethods are the service's own, handed to Dispatch.
+template <class Part>
+class PartitionNode {
+public:
+  // f(part, method, reader positioned after the partition) -> reply payload, or
+  // nullopt for a request that does not decode or is out of range (BadRequest)
+  using Dispatch = std::function<std::optional<std::string>(Part&, uint8_t, BinReader&)>;
+
+  PartitionNode(std::string root, uint16_t port, Dispatch dispatch)
+    : root_((std::filesystem::create_directories(root), std::move(root))), dispatch_(std::move(dispatch)),
+      server_(port, [this](uint8_t m, std::string_view payload) { return handle(m, payload); }) {}
+
+  ~PartitionNode() {
+    server_.stop();
+    for (auto& s : slots_)
+      if (s.shipper) s.shipper->stop();
+  }
+
+  uint16_t port() const { return server_.port(); }
+
+  // runs f(part) on every partition this node leads, e.g. a periodic checkpoint()
+  template <class F>
+  void forEachLed(F&& f) {
+    for (auto& s : slots_) {
+      std::shared_lock lock(s.mtx);
+      if (s.live) f(*s.live);
+    }
+  }
+
+  // bytes partition p's follower is behind; 0 if this node does not lead p
+  uint64_t lag(uint32_t p) {
+    std::shared_lock lock(slots_[p].mtx);
+    return slots_[p].shipper ? slots_[p].shipper->lag() : 0;
+  }
+
+private:
+  struct Slot {
+    std::shared_mutex mtx;   // shared for service calls, exclusive to change the slot
+    std::unique_ptr<Part> live;
+    std::unique_ptr<WalMirror> mirror;
+    std::unique_ptr<WalShipper> shipper;   // declared last: stops before live goes
+  };
+
+  static std::string status(NodeStatus s) { return std::string(1, char(s)); }
+  static std::string status(uint64_t lsn) {
+    BinWriter w;
+    w.put(NodeStatus::Ok);
+    w.put(lsn);
+    return w.data();
+  }
+
+  std::string dir(uint32_t p) const {
+    char name[8];
+    std::snprintf(name, sizeof name, "/p%02u", p);
+    return root_ + name;
+  }
+
+  std::string handle(uint8_t method, std::string_view payload) {
+    BinReader r(payload.data(), payload.size());
+    uint32_t p = r.get<uint32_t>();
+    if (!r.ok() || p >= kPartitions) return status(NodeStatus::BadRequest);
+    Slot& s = slots_[p];
+    if (method < kReservedMethods) {
+      std::shared_lock lock(s.mtx);
+      if (!s.live) return status(NodeStatus::NotLeader);
+      auto reply = dispatch_(*s.live, method, r);
+      return reply ? status(NodeStatus::Ok) + *reply : status(NodeStatus::BadRequest);
+    }
+    std::lock_guard lock(s.mtx);
+    switch (NodeRpc(method)) {
+      case NodeRpc::Ship:
+      case NodeRpc::ShipSnapshot:
+      case NodeRpc::ShipFile: {
+        if (s.live) return status(NodeStatus::NotLeader);   // a stale leader: refuse its log
+        if (!s.mirror) s.mirror = std::make_unique<WalMirror>(dir(p));
+        if (NodeRpc(method) == NodeRpc::ShipFile) {
+          auto at = s.mirror->file(r);
+          return at ? status(*at) : status(NodeStatus::BadRequest);
+        }
+        return status(NodeRpc(method) == NodeRpc::Ship ? s.mirror->ship(r) : s.mirror->install(r));
+      }
+      case NodeRpc::Lead: {
+        std::optional<Peer> follower;
+        if (r.get<uint8_t>()) {
+          follower.emplace();
+          follower->host = r.getStr();
+          follower->port = r.get<uint16_t>();
+        }
+        if (!r.ok()) return status(NodeStatus::BadRequest);
+        if (!s.live) {
+          s.mirror.reset();   // closes its log, which the Part reopens
+          s.live = std::make_unique<Part>(dir(p));
+        }
+        bool same = s.shipper && follower && s.shipper->follower().host == follower->host &&
+                    s.shipper->follower().port == follower->port;
+        if (!same) {
+          s.shipper.reset();
+          if (follower) s.shipper = std::make_unique<WalShipper>(p, s.live->log(), *follower);
+        }
+        return status(NodeStatus::Ok);
+      }
+      case NodeRpc::Drop:
+        s.shipper.reset();
+        s.live.reset();
+        s.mirror.reset();
+        std::filesystem::remove_all(dir(p));
+        return status(NodeStatus::Ok);
+    }
+    return status(NodeStatus::BadRequest);
+  }
+
+  const std::string root_;
+  const Dispatch dispatch_;
+  std::array<Slot, kPartitions> slots_;
+  RpcServer server_;   // last member: no call arrives before the slots exist or after they go
+};
+
+// The client side: every node's address, the ring of nodes that are up and
+// each partition's leader and follower. Sends each call to its partition's
+// leader. A leader that cannot be reached is dropped from the ring and each
+// partition it led or followed gets a Lead to its new leader, which was its
+// follower, with a new follower from the ring. A call is resent only when it
+// never reached the node that failed it.
+class PartitionRouter {
+public:
+  static constexpr NodeId kNone = NodeId(-1);
+
+  explicit PartitionRouter(const std::vector<Peer>& nodes) {
+    for (auto& n : nodes) clients_.push_back(std::make_unique<RpcClient>(n));
+    ring_.update([&](HashRing& r) {
+      for (NodeId n = 0; n < clients_.size(); ++n) r.add(n);
+    });
+    std::lock_guard lock(failMtx_);
+    reassign([](const HashRing&, uint32_t, Owners&) {});
+  }
+
+  // the reply of partition p's leader to a service call; nullopt when no node
+  // could take it, the leader refused the request, or the leader did not answer
+  // in time (then the call may or may not have been applied)
+  std::optional<std::string> call(uint32_t p, uint8_t method, std::string_view payload) {
+    BinWriter w;
+    w.put(p);
+    std::string frame = w.data();
+    frame.append(payload.data(), payload.size());
+    for (size_t attempt = 0; attempt <= clients_.size(); ++attempt) {
+      NodeId leader = leaderOf(p);
+      if (leader == kNone) return std::nullopt;
+      bool sent;
+      auto reply = clients_[leader]->call(method, frame, &sent);
+      if (!reply) {
+        if (sent) return std::nullopt;
+        failover(leader);
+        continue;
+      }
+      NodeStatus st = reply->empty() ? NodeStatus::BadRequest : NodeStatus((*reply)[0]);
+      if (st == NodeStatus::Ok) return reply->substr(1);
+      if (st != NodeStatus::NotLeader) return std::nullopt;
+      std::lock_guard lock(failMtx_);   // a failover in flight sends the Lead; else resend it
+      lead(p);
+    }
+    return std::nullopt;
+  }
+
+  bool up(NodeId n) const {
+    return ring_.read([&](const HashRing& r) { return r.contains(n); });
+  }
+  NodeId leaderOf(uint32_t p) const {
+    return owners_.read([&](const Table& t) { return t[p].leader; });
+  }
+
+  // drops node n from the ring and moves its partitions: done on the first call
+  // that cannot reach it, or by hand for a node that takes calls but no longer
+  // answers them
+  void failover(NodeId dead) {
+    std::lock_guard lock(failMtx_);
+    if (!up(dead)) return;   // another call got here first
+    ring_.update([&](HashRing& r) { r.remove(dead); });
+    // a new leader that is down too fails over on the next call that reaches it
+    reassign([&](const HashRing&, uint32_t, Owners& o) {
+      if (o.leader == dead) o.leader = std::exchange(o.follower, kNone);
+      if (o.follower == dead) o.follower = kNone;
+    });
+  }
+
+  // takes a dropped node back: it forgets every partition it still holds, then
+  // follows those whose ring owners include it, starting from their leaders'
+  // snapshots. Leadership does not move back, so no partition is led from a
+  // copy that has not caught up. False, leaving n out, if n cannot be reached.
+  bool rejoin(NodeId n) {
+    std::lock_guard lock(failMtx_);
+    if (n >= clients_.size() || up(n)) return false;
+    for (uint32_t p = 0; p < kPartitions; ++p) {
+      BinWriter w;
+      w.put(p);
+      if (!ok(clients_[n]->call(uint8_t(NodeRpc::Drop), w.data()))) return false;
+    }
+    ring_.update([&](HashRing& r) { r.add(n); });
+    reassign([&](const HashRing& r, uint32_t p, Owners& o) {
+      auto want = r.owners(p, 2);
+      if (o.leader != n && std::find(want.begin(), want.end(), n) != want.end()) o.follower = n;
+    });
+    return true;
+  }
+
+private:
+  struct Owners {
+    NodeId leader = kNone, follower = kNone;
+  };
+  using Table = std::array<Owners, kPartitions>;
+
+  static bool ok(const std::optional<std::string>& r) {
+    return r && !r->empty() && NodeStatus((*r)[0]) == NodeStatus::Ok;
+  }
+
+  // tells p's leader to lead it (again), shipping to its follower
+  bool lead(uint32_t p) {
+    Owners o = owners_.read([&](const Table& t) { return t[p]; });
+    if (o.leader == kNone) return false;
+    BinWriter w;
+    w.put(p);
+    w.put(uint8_t(o.follower != kNone));
+    if (o.follower != kNone) {
+      w.putStr(clients_[o.follower]->peer().host);
+      w.put(clients_[o.follower]->peer().port);
+    }
+    return ok(clients_[o.leader]->call(uint8_t(NodeRpc::Lead), w.data()));
+  }
+
+  // applies f(ring, p, owners) to every partition, fills a missing leader or
+  // follower from the ring, and sends a Lead for each partition that changed.
+  // Caller holds failMtx_.
+  template <class F>
+  void reassign(F&& f) {
+    HashRing ring = ring_.read([](const HashRing& r) { return r; });
+    std::vector<uint32_t> changed;
+    owners_.update([&](Table& t) {
+      for (uint32_t p = 0; p < kPartitions; ++p) {
+        Owners& o = t[p];
+        Owners was = o;
+        f(ring, p, o);
+        auto cand = ring.owners(p, 2);
+        if (o.leader == kNone && !cand.empty()) o.leader = cand[0];   // no copy left: starts empty
+        if (o.follower == kNone || o.follower == o.leader) {
+          auto c = std::find_if(cand.begin(), cand.end(), [&](NodeId c) { return c != o.leader; });
+          o.follower = c == cand.end() ? kNone : *c;
+        }
+        if (o.leader != was.leader || o.follower != was.follower) changed.push_back(p);
+      }
+    });
+    for (uint32_t p : changed) lead(p);
+  }
+
+  std::vector<std::unique_ptr<RpcClient>> clients_;   // by NodeId
+  RcuCell<HashRing> ring_;                            // nodes that are up
+  RcuCell<Table> owners_;                             // by partition
+  std::mutex failMtx_;   // one ring change, with its Leads, at a time
+};
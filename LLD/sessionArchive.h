@@ -0,0 +1,375 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "writeAheadLog.h"   // crc32, ioFail, MappedFile
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+ SessionArchive: append-only columnar history of completed sessions: who held
+ which resource, of what kind, from when to when, for what amount.
+
+ Rows go into an open block under a short mutex; at kBlockRows the block is
+ sealed and never changes again. Every block keeps a zone map (min start,
+ min/max end) and per-kind totals, so a report skips blocks outside its
+ window and takes whole blocks inside it from the totals without touching a
+ row. Only blocks straddling a window edge are scanned: branchless passes over
+ contiguous int64 columns, four rows per AVX2 compare where available (gcc
+ at -O2 leaves the scalar loop unvectorised).
+
+ flush(path) seals the open block and appends every block not yet on disk to
+ one file, column by column: starts as zigzag deltas, ends as durations,
+ everything as LEB128 varints, each block behind a length and crc32. A row
+ of 33 raw bytes typically takes 10-15. load(path) reads it back and cuts
+ a torn tail, like the WAL. Flushed blocks beyond keepBlocks are dropped from
+ memory: reports then cover only what is held, load() restores the rest.
+*/
+
+class SessionArchive {
+public:
+  static constexpr size_t kBlockRows = 4096;
+  static constexpr int kKinds = 8;
+
+  struct Row {
+    uint32_t who;         // e.g. a hash of a plate
+    uint32_t resource;    // e.g. a spot index
+    uint8_t kind;         // < kKinds, e.g. a SpotType
+    int64_t start, end;   // clock ticks, start <= end
+    int64_t amount;       // e.g. the fee in cents
+  };
+
+  struct Totals {
+    uint64_t sessions = 0;
+    int64_t amount = 0;
+  };
+
+  explicit SessionArchive(size_t keepBlocks = SIZE_MAX) : keepBlocks_(keepBlocks) {}
+
+  // returns the row's number: rows appended or loaded before it. Rows reach
+  // the file in this order, so a file of n rows holds exactly rows [0, n).
+  uint64_t append(const Row& r) {
+    std::lock_guard lock(mtx_);
+    open_.push(r);
+    if (open_.rows() == kBlockRows) sealOpen();
+    return rows_++;
+  }
+
+  // per kind: sessions that ended in [from, to) and their summed amount
+  std::array<Totals, kKinds> ended(int64_t from, int64_t to) const {
+    std::array<Totals, kKinds> res{};
+    forEachBlock([&](const Block& b) { b.ended(from, to, res); });
+    return res;
+  }
+
+  // per kind: ticks of [from, to) covered by sessions, summed over sessions
+  // (time in use, for occupancy against capacity * (to - from))
+  std::array<int64_t, kKinds> busy(int64_t from, int64_t to) const {
+    std::array<int64_t, kKinds> res{};
+    forEachBlock([&](const Block& b) { b.busy(from, to, res); });
+    return res;
+  }
+
+  // rows held in memory
+  size_t size() const {
+    std::lock_guard lock(mtx_);
+    size_t n = open_.rows();
+    for (auto& b : blocks_) n += b->rows();
+    return n;
+  }
+
+  // seals the open block and appends every block not yet on disk to path
+  void flush(const std::string& path) {
+    std::lock_guard serial(flushMtx_);
+    std::vector<std::shared_ptr<const Block>> todo;
+    {
+      std::lock_guard lock(mtx_);
+      if (open_.rows()) sealOpen();
+      todo.assign(blocks_.begin() + (flushed_ - dropped_), blocks_.end());
+    }
+    if (todo.empty()) return;
+    std::string out;
+    for (auto& b : todo) b->encode(out);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) ioFail("open archive");
+    for (const char* p = out.data(); p < out.data() + out.size();) {
+      ssize_t k = ::write(fd, p, out.data() + out.size() - p);
+      if (k < 0) ioFail("write archive");
+      p += k;
+    }
+    if (::fdatasync(fd) != 0) ioFail("fdatasync archive");
+    ::close(fd);
+
+    std::lock_guard lock(mtx_);
+    flushed_ += todo.size();
+    while (blocks_.size() > keepBlocks_ && dropped_ < flushed_) {
+      blocks_.pop_front();
+      ++dropped_;
+    }
+  }
+
+  // startup only, on an empty archive: adds the blocks stored in path (they
+  // count as flushed) and truncates a torn tail; returns the rows loaded
+  size_t load(const std::string& path) {
+    MappedFile m(path);
+    const char* p = m.data();
+    const char* end = p + m.size();
+    size_t rows = 0;
+    std::lock_guard lock(mtx_);
+    while (p && p < end) {
+      auto b = std::make_shared<Block>();
+      const char* next = Block::decode(p, end, *b);
+      if (!next) break;
+      p = next;
+      rows += b->rows();
+      rows_ += b->rows();
+      blocks_.push_back(std::move(b));
+      ++sealed_;
+    }
+    flushed_ = sealed_;
+    if (p && p < end && ::truncate(path.c_str(), off_t(p - m.data())) != 0) ioFail("truncate archive");
+    return rows;
+  }
+
+private:
+  struct Block {
+    std::vector<uint32_t> who, resource;
+    std::vector<uint8_t> kind;
+    std::vector<int64_t> start, end, amount;
+    // zone map and totals, kept current by push()
+    int64_t minStart = INT64_MAX, minEnd = INT64_MAX, maxEnd = INT64_MIN;
+    std::array<Totals, kKinds> totals{};
+    std::array<int64_t, kKinds> length{};   // sum of end - start
+    uint8_t kinds = 0;                       // bit k: some row has kind k
+
+    size_t rows() const { return start.size(); }
+
+    void push(const Row& r) {
+      who.push_back(r.who);
+      resource.push_back(r.resource);
+      kind.push_back(r.kind);
+      start.push_back(r.start);
+      end.push_back(r.end);
+      amount.push_back(r.amount);
+      minStart = std::min(minStart, r.start);
+      minEnd = std::min(minEnd, r.end);
+      maxEnd = std::max(maxEnd, r.end);
+      ++totals[r.kind].sessions;
+      totals[r.kind].amount += r.amount;
+      length[r.kind] += r.end - r.start;
+      kinds |= uint8_t(1u << r.kind);
+    }
+
+    void ended(int64_t from, int64_t to, std::array<Totals, kKinds>& res) const {
+      if (!rows() || maxEnd < from || minEnd >= to) return;
+      bool whole = minEnd >= from && maxEnd < to;
+      for (int k = 0; k < kKinds; ++k) {
+        if (!(kinds >> k & 1)) continue;
+        if (whole) {
+          res[k].sessions += totals[k].sessions;
+          res[k].amount += totals[k].amount;
+          continue;
+        }
+        uint64_t n = 0;
+        int64_t sum = 0;
+        size_t i = 0;
+#if defined(__AVX2__)
+        i = endedAvx2(from, to, k, n, sum);
+#endif
+        for (; i < rows(); ++i) {
+          int64_t in = (end[i] >= from) & (end[i] < to) & (kind[i] == k);
+          n += uint64_t(in);
+          sum += amount[i] & -in;
+        }
+        res[k].sessions += n;
+        res[k].amount += sum;
+      }
+    }
+
+    void busy(int64_t from, int64_t to, std::array<int64_t, kKinds>& res) const {
+      if (!rows() || maxEnd <= from || minStart >= to) return;
+      bool whole = minStart >= from && maxEnd <= to;
+      for (int k = 0; k < kKinds; ++k) {
+        if (!(kinds >> k & 1)) continue;
+        if (whole) {
+          res[k] += length[k];
+          continue;
+        }
+        int64_t sum = 0;
+        size_t i = 0;
+#if defined(__AVX2__)
+        i = busyAvx2(from, to, k, sum);
+#endif
+        for (; i < rows(); ++i) {
+          int64_t overlap = std::min(end[i], to) - std::max(start[i], from);
+          sum += std::max<int64_t>(overlap, 0) & -int64_t(kind[i] == k);
+        }
+        res[k] += sum;
+      }
+    }
+
+#if defined(__AVX2__)
+    // the loops above for the rows up to the last multiple of 4; returns where
+    // the scalar tail starts
+    size_t endedAvx2(int64_t from, int64_t to, int k, uint64_t& n, int64_t& sum) const {
+      __m256i vfrom = _mm256_set1_epi64x(from), vto = _mm256_set1_epi64x(to);
+      __m256i vk = _mm256_set1_epi64x(k), count = _mm256_setzero_si256(), acc = count;
+      size_t i = 0;
+      for (; i + 4 <= rows(); i += 4) {
+        __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&end[i]));
+        __m256i in = _mm256_andnot_si256(_mm256_cmpgt_epi64(vfrom, e), _mm256_cmpgt_epi64(vto, e));
+        in = _mm256_and_si256(in, _mm256_cmpeq_epi64(kinds4(i), vk));
+        count = _mm256_sub_epi64(count, in);   // lanes are 0 or -1
+        acc = _mm256_add_epi64(acc, _mm256_and_si256(in,
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&amount[i]))));
+      }
+      n += uint64_t(hsum(count));
+      sum += hsum(acc);
+      return i;
+    }
+
+    size_t busyAvx2(int64_t from, int64_t to, int k, int64_t& sum) const {
+      __m256i vfrom = _mm256_set1_epi64x(from), vto = _mm256_set1_epi64x(to);
+      __m256i vk = _mm256_set1_epi64x(k), zero = _mm256_setzero_si256(), acc = zero;
+      size_t i = 0;
+      for (; i + 4 <= rows(); i += 4) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&start[i]));
+        __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&end[i]));
+        // no 64-bit min/max before AVX-512: compare and blend
+        __m256i lo = _mm256_blendv_epi8(s, vfrom, _mm256_cmpgt_epi64(vfrom, s));
+        __m256i hi = _mm256_blendv_epi8(e, vto, _mm256_cmpgt_epi64(e, vto));
+        __m256i overlap = _mm256_sub_epi64(hi, lo);
+        __m256i keep = _mm256_and_si256(_mm256_cmpgt_epi64(overlap, zero),
+                                        _mm256_cmpeq_epi64(kinds4(i), vk));
+        acc = _mm256_add_epi64(acc, _mm256_and_si256(overlap, keep));
+      }
+      sum += hsum(acc);
+      return i;
+    }
+
+    __m256i kinds4(size_t i) const {
+      int32_t packed;
+      std::memcpy(&packed, &kind[i], 4);
+      return _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(packed));
+    }
+
+    static int64_t hsum(__m256i v) {
+      alignas(32) int64_t lanes[4];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), v);
+      return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    // [u32 magic][u32 rows][u32 payload bytes][u32 crc][payload]
+    void encode(std::string& out) const {
+      std::string body;
+      for (uint32_t v : who) putVar(body, v);
+      for (uint32_t v : resource) putVar(body, v);
+      body.append(reinterpret_cast<const char*>(kind.data()), kind.size());
+      int64_t prev = 0;
+      for (int64_t v : start) {
+        putVar(body, zigzag(v - prev));
+        prev = v;
+      }
+      for (size_t i = 0; i < rows(); ++i) putVar(body, uint64_t(end[i] - start[i]));
+      for (int64_t v : amount) putVar(body, zigzag(v));
+      uint32_t hdr[4] = {kMagic, uint32_t(rows()), uint32_t(body.size()),
+                         crc32(body.data(), body.size())};
+      out.append(reinterpret_cast<const char*>(hdr), sizeof hdr);
+      out += body;
+    }
+
+    // returns the end of the block record, or nullptr if it is short or corrupt
+    static const char* decode(const char* p, const char* end, Block& b) {
+      uint32_t hdr[4];
+      if (size_t(end - p) < sizeof hdr) return nullptr;
+      std::memcpy(hdr, p, sizeof hdr);
+      p += sizeof hdr;
+      uint32_t rows = hdr[1];
+      if (hdr[0] != kMagic || rows > kBlockRows || size_t(end - p) < hdr[2] ||
+          crc32(p, hdr[2]) != hdr[3])
+        return nullptr;
+      const char* bodyEnd = p + hdr[2];
+      std::vector<uint64_t> cols[5];   // who, resource, start, length, amount
+      for (int c = 0; c < 2; ++c)
+        if (!getVars(p, bodyEnd, rows, cols[c])) return nullptr;
+      if (size_t(bodyEnd - p) < rows) return nullptr;
+      const char* kinds = p;
+      p += rows;
+      for (int c = 2; c < 5; ++c)
+        if (!getVars(p, bodyEnd, rows, cols[c])) return nullptr;
+      int64_t start = 0;
+      for (uint32_t i = 0; i < rows; ++i) {
+        start += unzigzag(cols[2][i]);
+        uint8_t kind = uint8_t(kinds[i]);
+        if (kind >= kKinds) return nullptr;
+        b.push(Row{uint32_t(cols[0][i]), uint32_t(cols[1][i]), kind,
+                   start, start + int64_t(cols[3][i]), unzigzag(cols[4][i])});
+      }
+      return bodyEnd;
+    }
+  };
+
+  static constexpr uint32_t kMagic = 0x43524153;   // "SARC"
+
+  static uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+  static int64_t unzigzag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+  static void putVar(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+      out.push_back(char(v | 0x80));
+      v >>= 7;
+    }
+    out.push_back(char(v));
+  }
+
+  static bool getVars(const char*& p, const char* end, uint32_t n, std::vector<uint64_t>& out) {
+    out.resize(n);
+    for (uint32_t i = 0; i < n; ++i) {
+      uint64_t v = 0;
+      for (int shift = 0;; shift += 7) {
+        if (p == end || shift > 63) return false;
+        uint8_t byte = uint8_t(*p++);
+        v |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+      }
+      out[i] = v;
+    }
+    return true;
+  }
+
+  // caller holds mtx_
+  void sealOpen() {
+    blocks_.push_back(std::make_shared<const Block>(std::move(open_)));
+    open_ = Block{};
+    ++sealed_;
+  }
+
+  // the open block is visited under the lock, sealed blocks after it is dropped
+  template <class F>
+  void forEachBlock(F&& f) const {
+    std::vector<std::shared_ptr<const Block>> sealed;
+    {
+      std::lock_guard lock(mtx_);
+      f(open_);
+      sealed.assign(blocks_.begin(), blocks_.end());
+    }
+    for (auto& b : sealed) f(*b);
+  }
+
+  const size_t keepBlocks_;
+  mutable std::mutex mtx_;
+  std::mutex flushMtx_;   // one flush at a time, appends keep going meanwhile
+  Block open_;
+  std::deque<std::shared_ptr<const Block>> blocks_;   // sealed, oldest first
+  // block counts since construction: sealed, written to disk, dropped from memory
+  uint64_t sealed_ = 0, flushed_ = 0, dropped_ = 0;
+  uint64_t rows_ = 0;   // rows appended or loaded since construction
+};
@@ -0,0 +1,186 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ StripedHashMap: string keys -> V, split by hash into a fixed number of
+ segments, each an open-addressing table (linear probing) behind its own
+ cache-line-padded mutex.
+
+ Every operation locks exactly one segment, the key's, so with() can run a
+ compound step on one key (look up, decide, insert or erase, touch whatever
+ else that key guards) in a single lock acquisition: the segment mutex doubles
+ as the per-key lock. Erase shifts the following entries back instead of
+ leaving a tombstone, so a table under constant churn keeps short probes; a
+ segment doubles, under its own lock only, once it passes 50% load. Slots keep
+ the key's hash, so probes compare strings only on a hash match.
+*/
+
+template <class V>
+class StripedHashMap {
+  struct Slot;
+  struct Segment;
+
+public:
+  explicit StripedHashMap(size_t expected = 64, size_t segments = 64) {
+    size_t n = 1;
+    while (n < segments) n *= 2;
+    segMask_ = n - 1;
+    segments_ = std::make_unique<Segment[]>(n);
+    for (size_t i = 0; i < n; ++i) segments_[i].rehash(expected * 2 / n + 1);
+  }
+
+  // one key inside its locked segment; valid only within the with() callback
+  class Ref {
+  public:
+    V* get() { return found_ ? &seg_.slots[pos_].value : nullptr; }
+
+    // inserts or overwrites
+    V& put(V v) {
+      if (!found_) {
+        if ((seg_.used + 1) * 2 > seg_.slots.size()) {
+          seg_.rehash(seg_.slots.size() * 2);
+          pos_ = seg_.probe(key_, hash_);
+        }
+        Slot& s = seg_.slots[pos_];
+        s.used = true;
+        s.hash = hash_;
+        s.key.assign(key_.data(), key_.size());
+        ++seg_.used;
+        found_ = true;
+      }
+      return seg_.slots[pos_].value = std::move(v);
+    }
+
+    bool erase() {
+      if (!found_) return false;
+      seg_.eraseAt(pos_);
+      found_ = false;
+      pos_ = seg_.probe(key_, hash_);
+      return true;
+    }
+
+  private:
+    friend class StripedHashMap;
+    Ref(Segment& seg, std::string_view key, size_t hash)
+      : seg_(seg), key_(key), hash_(hash), pos_(seg.probe(key, hash)),
+        found_(seg.slots[pos_].used) {}
+    Segment& seg_;
+    std::string_view key_;
+    size_t hash_;
+    size_t pos_;
+    bool found_;
+  };
+
+  // f(Ref&) under the key's segment lock; returns what f returns
+  template <class F>
+  decltype(auto) with(std::string_view key, F&& f) {
+    return with(key, [](std::mutex& m) { return std::unique_lock(m); }, std::forward<F>(f));
+  }
+
+  // same, taking the segment mutex through lockFn(mutex&), which returns the
+  // held lock (e.g. a metered one)
+  template <class LockFn, class F>
+  decltype(auto) with(std::string_view key, LockFn&& lockFn, F&& f) {
+    size_t hash = std::hash<std::string_view>{}(key);
+    Segment& seg = segmentOf(hash);
+    auto lock = lockFn(seg.mtx);
+    Ref ref(seg, key, hash);
+    return f(ref);
+  }
+
+  std::optional<V> find(std::string_view key) {
+    return with(key, [](Ref& r) -> std::optional<V> {
+      if (V* v = r.get()) return *v;
+      return std::nullopt;
+    });
+  }
+
+  // f(key, value) for every entry, one segment (and lock) at a time
+  template <class F>
+  void forEach(F&& f) {
+    for (size_t i = 0; i <= segMask_; ++i) {
+      std::lock_guard lock(segments_[i].mtx);
+      for (auto& s : segments_[i].slots)
+        if (s.used) f(std::string_view(s.key), s.value);
+    }
+  }
+
+  size_t size() {
+    size_t n = 0;
+    for (size_t i = 0; i <= segMask_; ++i) {
+      std::lock_guard lock(segments_[i].mtx);
+      n += segments_[i].used;
+    }
+    return n;
+  }
+
+private:
+  struct Slot {
+    bool used = false;
+    size_t hash = 0;
+    std::string key;
+    V value{};
+  };
+
+  struct alignas(64) Segment {
+    std::mutex mtx;
+    std::vector<Slot> slots;
+    size_t used = 0;
+
+    // slot holding key, or the empty slot ending its probe path
+    size_t probe(std::string_view key, size_t hash) const {
+      size_t mask = slots.size() - 1;
+      for (size_t i = home(hash);; i = (i + 1) & mask) {
+        const Slot& s = slots[i];
+        if (!s.used || (s.hash == hash && s.key == key)) return i;
+      }
+    }
+
+    // the low bits pick the segment, so slots are placed by the high ones
+    size_t home(size_t hash) const { return (hash >> 16) & (slots.size() - 1); }
+
+    // backward-shift delete: pull later entries of the run into the hole
+    // unless their home slot lies cyclically in (hole, j]
+    void eraseAt(size_t hole) {
+      size_t mask = slots.size() - 1;
+      for (size_t j = (hole + 1) & mask; slots[j].used; j = (j + 1) & mask) {
+        size_t k = home(slots[j].hash);
+        bool stays = hole <= j ? (hole < k && k <= j) : (hole < k || k <= j);
+        if (stays) continue;
+        slots[hole] = std::move(slots[j]);
+        hole = j;
+      }
+      slots[hole].used = false;
+      slots[hole].key.clear();
+      slots[hole].value = V{};
+      --used;
+    }
+
+    void rehash(size_t minSlots) {
+      size_t n = 8;
+      while (n < minSlots) n *= 2;
+      std::vector<Slot> old(n);
+      old.swap(slots);
+      for (auto& s : old) {
+        if (!s.used) continue;
+        size_t i = home(s.hash);
+        while (slots[i].used) i = (i + 1) & (n - 1);
+        slots[i] = std::move(s);
+      }
+    }
+  };
+
+  Segment& segmentOf(size_t hash) { return segments_[hash & segMask_]; }
+
+  std::unique_ptr<Segment[]> segments_;
+  size_t segMask_;
+};
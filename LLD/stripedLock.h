@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+/*
+ StripedLock: a fixed table of cache-line-padded mutexes, selected by hashing a
+ Handle. Replaces per-key std::map<string, mutex> registries, which race on
+ insert and walk a string tree on every lock.
+
+ The table never grows, so lookup is a multiply and a mask with nothing shared
+ to synchronise. Two keys may share a stripe; that only costs a little extra
+ contention, never correctness. Size it well above the expected thread count
+ (default 1024 stripes ~ 64 KiB).
+*/
+
+class StripedLock {
+public:
+  explicit StripedLock(size_t stripes = 1024) {
+    size_t n = 1;
+    while (n < stripes) n *= 2;
+    mask_ = n - 1;
+    stripes_ = std::make_unique<Stripe[]>(n);
+  }
+
+  std::mutex& forKey(uint32_t key) {
+    // Fibonacci hashing spreads sequential handles across stripes
+    uint64_t h = uint64_t(key) * 0x9e3779b97f4a7c15ull;
+    return stripes_[(h >> 32) & mask_].mtx;
+  }
+
+  size_t stripes() const { return mask_ + 1; }
+
+private:
+  struct alignas(64) Stripe {
+    std::mutex mtx;
+  };
+
+  std::unique_ptr<Stripe[]> stripes_;
+  size_t mask_;
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+/*
+ Timeline: the bookings of one resource (room, parking spot) as a sorted flat
+ vector of non-overlapping [start, end) intervals.
+
+ Because accepted intervals never overlap, sorting by start also sorts by end,
+ so a conflict query is one binary search: the only interval that can overlap
+ [s, e) is the last one starting before e. Intervals may span any number of
+ days; nothing is bucketed by date. Insert/erase shift the tail of one
+ resource's vector, which stays small and cache-resident.
+*/
+
+template <class Payload>
+class Timeline {
+public:
+  using TimePoint = std::chrono::system_clock::time_point;
+
+  struct Interval {
+    TimePoint start;
+    TimePoint end;
+    Payload payload;
+  };
+
+  bool isFree(TimePoint s, TimePoint e) const {
+    auto it = firstStartingAtOrAfter(e);
+    return it == iv_.begin() || std::prev(it)->end <= s;
+  }
+
+  // inserts unless it would overlap an existing interval
+  bool insert(TimePoint s, TimePoint e, Payload p) {
+    auto it = firstStartingAtOrAfter(e);
+    if (it != iv_.begin() && std::prev(it)->end > s) return false;
+    iv_.insert(it, Interval{s, e, p});
+    return true;
+  }
+
+  bool erase(TimePoint s, Payload p) {
+    auto it = std::lower_bound(iv_.begin(), iv_.end(), s,
+        [](const Interval& i, TimePoint t) { return i.start < t; });
+    for (; it != iv_.end() && it->start == s; ++it) {
+      if (it->payload == p) { iv_.erase(it); return true; }
+    }
+    return false;
+  }
+
+  // Batch check in one merge pass: spans must be sorted by start. ok[i] is
+  // false if spans[i] overlaps a stored interval or an earlier accepted span.
+  std::vector<bool> fitSorted(const std::vector<std::pair<TimePoint, TimePoint>>& spans) const {
+    std::vector<bool> ok(spans.size());
+    auto it = iv_.begin();
+    TimePoint lastEnd = TimePoint::min();
+    for (size_t i = 0; i < spans.size(); ++i) {
+      auto [s, e] = spans[i];
+      while (it != iv_.end() && it->end <= s) ++it;
+      ok[i] = lastEnd <= s && (it == iv_.end() || it->start >= e);
+      if (ok[i]) lastEnd = e;
+    }
+    return ok;
+  }
+
+  // merges a batch sorted by start that fitSorted() accepted; O(n + m), one allocation
+  void insertSorted(const std::vector<Interval>& batch) {
+    std::vector<Interval> merged;
+    merged.reserve(iv_.size() + batch.size());
+    std::merge(iv_.begin(), iv_.end(), batch.begin(), batch.end(), std::back_inserter(merged),
+               [](const Interval& a, const Interval& b) { return a.start < b.start; });
+    iv_.swap(merged);
+  }
+
+  // visit every interval overlapping [s, e), in start order, without copying
+  template <class F>
+  void forEachOverlapping(TimePoint s, TimePoint e, F&& f) const {
+    auto it = std::lower_bound(iv_.begin(), iv_.end(), s,
+        [](const Interval& i, TimePoint t) { return i.end <= t; });
+    for (; it != iv_.end() && it->start < e; ++it) f(*it);
+  }
+
+  const std::vector<Interval>& intervals() const { return iv_; }
+  size_t size() const { return iv_.size(); }
+
+private:
+  typename std::vector<Interval>::const_iterator firstStartingAtOrAfter(TimePoint t) const {
+    return std::lower_bound(iv_.begin(), iv_.end(), t,
+        [](const Interval& i, TimePoint x) { return i.start < x; });
+  }
+
+  std::vector<Interval> iv_;
+};
@@ -0,0 +1,251 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ TimerWheel: a hierarchical timing wheel of deadlines carrying a small payload.
+
+ Time is cut into ticks. Level 0 has one slot per tick for the next 64 ticks,
+ level 1 one slot per 64 ticks for the next 64^2, and so on for kLevels levels
+ (with 1 s ticks, far past any calendar horizon). A timer goes into the level
+ of the highest 6-bit digit in which its tick differs from the current one, so
+ schedule() and cancel() are O(1) list operations however many timers there
+ are and however far out. When time reaches a higher-level slot its timers
+ cascade down, each timer moving at most kLevels times, and level 0 fires.
+ Nodes live in one vector recycled through a free list, and ids carry a
+ generation, so cancelling a timer that already fired is a harmless no-op.
+
+ Not thread-safe: the owner serialises calls, e.g. under the lock that guards
+ the state the timers refer to. TimerDriver (below) is one thread advancing
+ several owners' wheels, for callers without an event loop of their own.
+*/
+
+template <class T>
+class TimerWheel {
+public:
+  using Clock = std::chrono::system_clock;
+  using TimePoint = Clock::time_point;
+  using Id = uint64_t;   // 0 is never issued
+
+  explicit TimerWheel(Clock::duration tick, TimePoint origin = Clock::now())
+    : tick_(tick), origin_(origin) {
+    for (auto& level : heads_) level.fill(kNil);
+  }
+
+  // due at `when`; a deadline already past fires on the next advance()
+  Id schedule(TimePoint when, T payload) {
+    uint32_t i;
+    if (!free_.empty()) {
+      i = free_.back();
+      free_.pop_back();
+    } else {
+      i = uint32_t(nodes_.size());
+      nodes_.emplace_back();
+    }
+    Node& n = nodes_[i];
+    n.payload = std::move(payload);
+    n.tick = std::max(tickOf(when), now_ + 1);
+    n.live = true;
+    link(i);
+    ++size_;
+    return (uint64_t(n.gen) << 32) | (uint64_t(i) + 1);
+  }
+
+  // false if the timer already fired or was cancelled
+  bool cancel(Id id) {
+    uint32_t i = uint32_t(id) - 1;
+    if (!id || i >= nodes_.size() || nodes_[i].gen != uint32_t(id >> 32) || !nodes_[i].live) return false;
+    --size_;
+    if (nodes_[i].linked) {
+      unlink(i);
+      recycle(i);
+    } else {
+      nodes_[i].live = false;   // due in a running advance(), which recycles it
+    }
+    return true;
+  }
+
+  // fires every timer due by `now`, calling f(T&&) in tick order; f may
+  // schedule() or cancel(). O(1) per elapsed tick plus the timers moved or
+  // fired; an empty wheel jumps straight to `now`. Returns how many fired.
+  template <class F>
+  size_t advance(TimePoint now, F&& f) {
+    uint64_t target = tickOf(now);
+    std::vector<uint32_t> due;
+    while (now_ < target) {
+      if (!size_) {
+        now_ = target;
+        break;
+      }
+      ++now_;
+      // cascade every level whose lower digits just wrapped, highest first
+      for (int l = kLevels - 1; l >= 1; --l)
+        if (!(now_ & ((uint64_t(1) << (kBits * l)) - 1))) relink(l, digit(now_, l));
+      uint32_t i = heads_[0][digit(now_, 0)];
+      while (i != kNil) {
+        uint32_t next = nodes_[i].next;
+        unlink(i);
+        if (nodes_[i].tick <= now_) due.push_back(i);
+        else link(i);   // was out of the top level's reach when placed
+        i = next;
+      }
+    }
+    // unlinked first, so f sees a consistent wheel and may cancel a timer
+    // that is due in this same batch
+    size_t fired = 0;
+    for (uint32_t d : due) {
+      bool live = nodes_[d].live;
+      T payload = std::move(nodes_[d].payload);
+      recycle(d);
+      if (!live) continue;
+      --size_;
+      ++fired;
+      f(std::move(payload));
+    }
+    return fired;
+  }
+
+  // timers pending
+  size_t size() const { return size_; }
+
+private:
+  static constexpr uint32_t kNil = UINT32_MAX;
+  static constexpr int kBits = 6, kSlots = 1 << kBits, kLevels = 6;
+
+  struct Node {
+    T payload{};
+    uint64_t tick = 0;
+    uint32_t prev = kNil, next = kNil;
+    uint32_t gen = 0;
+    uint8_t level = 0, slot = 0;
+    bool live = false;     // pending: scheduled, not yet fired or cancelled
+    bool linked = false;   // in a slot's list
+  };
+
+  static size_t digit(uint64_t tick, int level) { return size_t(tick >> (kBits * level)) & (kSlots - 1); }
+
+  uint64_t tickOf(TimePoint t) const {
+    return t <= origin_ ? 0 : uint64_t((t - origin_) / tick_);
+  }
+
+  // level: the highest digit in which the deadline differs from now_. One
+  // beyond the top level's span parks in the top slot that cascades last and
+  // is placed again from there.
+  void link(uint32_t i) {
+    Node& n = nodes_[i];
+    uint64_t diff = n.tick ^ now_;
+    int level = diff ? (63 - __builtin_clzll(diff)) / kBits : 0;
+    size_t slot;
+    if (level < kLevels) {
+      slot = digit(n.tick, level);
+    } else {
+      level = kLevels - 1;
+      slot = (digit(now_, level) + kSlots - 1) & (kSlots - 1);
+    }
+    n.level = uint8_t(level);
+    n.slot = uint8_t(slot);
+    n.linked = true;
+    uint32_t& head = heads_[level][slot];
+    n.prev = kNil;
+    n.next = head;
+    if (head != kNil) nodes_[head].prev = i;
+    head = i;
+  }
+
+  void unlink(uint32_t i) {
+    Node& n = nodes_[i];
+    n.linked = false;
+    if (n.prev != kNil) nodes_[n.prev].next = n.next;
+    else heads_[n.level][n.slot] = n.next;
+    if (n.next != kNil) nodes_[n.next].prev = n.prev;
+  }
+
+  // moves a higher-level slot's timers to the levels now_ puts them in
+  void relink(int level, size_t slot) {
+    uint32_t i = heads_[level][slot];
+    heads_[level][slot] = kNil;
+    while (i != kNil) {
+      uint32_t next = nodes_[i].next;
+      link(i);
+      i = next;
+    }
+  }
+
+  void recycle(uint32_t i) {
+    nodes_[i].live = false;
+    nodes_[i].linked = false;
+    ++nodes_[i].gen;
+    free_.push_back(i);
+  }
+
+  const Clock::duration tick_;
+  const TimePoint origin_;
+  uint64_t now_ = 0;   // last tick advanced to
+  std::array<std::array<uint32_t, kSlots>, kLevels> heads_;
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> free_;
+  size_t size_ = 0;
+};
+
+/*
+ TimerDriver: one background thread that calls each registered job with the
+ current time once a period, e.g. [&](auto now) { svc.advanceTimers(now); }.
+ Jobs run one after another on that thread. Declare the driver after the
+ services it drives, so it stops before they are destroyed.
+*/
+
+class TimerDriver {
+public:
+  using Clock = std::chrono::system_clock;
+  using Job = std::function<void(Clock::time_point)>;
+
+  explicit TimerDriver(Clock::duration period = std::chrono::seconds(1)) : period_(period) {}
+  ~TimerDriver() { stop(); }
+
+  void add(Job job) {
+    std::lock_guard lock(mtx_);
+    jobs_.push_back(std::move(job));
+  }
+
+  void start() {
+    std::lock_guard lock(mtx_);
+    if (thread_.joinable()) return;
+    stop_ = false;
+    thread_ = std::thread([this] { run(); });
+  }
+
+  void stop() {
+    {
+      std::lock_guard lock(mtx_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+  }
+
+private:
+  void run() {
+    std::unique_lock lock(mtx_);
+    while (!stop_) {
+      auto now = Clock::now();
+      for (auto& job : jobs_) job(now);
+      cv_.wait_for(lock, period_, [&] { return stop_; });
+    }
+  }
+
+  const Clock::duration period_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<Job> jobs_;
+  bool stop_ = false;
+  std::thread thread_;
+};
@@ -0,0 +1,460 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ WriteAheadLog + snapshots: durability without a database round trip per call.
+
+ append() copies a record into an in-memory buffer under a short mutex and
+ returns its LSN (log byte offset just past the record); it does no I/O. One
+ flusher thread swaps the buffer out, write()s it and fdatasync()s once for
+ everything that arrived meanwhile, then wakes the waiters: concurrent commits
+ share one fsync per batch (group commit). I/O failure aborts the process;
+ after a failed fsync the page cache state is unknown and retrying can lie.
+
+ The log is a run of segment files <dir>/<first LSN, 16 hex digits>.wal holding
+ [u32 length][u32 crc32][u8 type][payload] records. Replay stops at the first
+ short or corrupt record, which is what a crash mid-write leaves behind, and
+ opening a log truncates that torn tail away.
+
+ Snapshots are fuzzy checkpoints: rotate() starts a new segment at LSN L, the
+ owner serialises its live state while traffic keeps running, and
+ writeSnapshot() stores it tagged with L (tmp file + rename). Recovery maps the
+ snapshot and replays every record past L. That is sound as long as owners
+ apply a mutation before appending its record, append in per-key order, and
+ replay last-writer-wins per key, so an effect caught by both the snapshot
+ and the tail converges to the same state. dropBefore(L) deletes older segments.
+
+ A replica (partition.h) tails the durable prefix with waitPast() and
+ readFrom(), and retain()s what it has not received yet, so a checkpoint never
+ deletes a segment that still has to be shipped.
+*/
+
+// durability I/O has no safe fallback: report and stop
+[[noreturn]] inline void ioFail(const char* what) {
+  std::perror(what);
+  std::abort();
+}
+
+inline uint32_t crc32(const void* data, size_t n, uint32_t crc = 0) {
+  static const auto table = [] {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  auto* p = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < n; ++i) crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+// little helpers for the record/snapshot payloads: PODs raw, strings length-prefixed
+class BinWriter {
+public:
+  template <class T>
+  void put(const T& v) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    buf_.append(reinterpret_cast<const char*>(&v), sizeof v);
+  }
+  void putStr(std::string_view s) {
+    put(uint32_t(s.size()));
+    buf_.append(s.data(), s.size());
+  }
+  const std::string& data() const { return buf_; }
+  void clear() { buf_.clear(); }
+
+private:
+  std::string buf_;
+};
+
+// reads past the end flip ok() to false and return zeros, so decoders check once at the end
+class BinReader {
+public:
+  BinReader(const char* p, size_t n) : p_(p), end_(p + n) {}
+
+  template <class T>
+  T get() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T v{};
+    if (size_t(end_ - p_) < sizeof v) { ok_ = false; return v; }
+    std::memcpy(&v, p_, sizeof v);
+    p_ += sizeof v;
+    return v;
+  }
+  std::string_view getStr() {
+    uint32_t n = get<uint32_t>();
+    if (!ok_ || size_t(end_ - p_) < n) { ok_ = false; return {}; }
+    std::string_view s(p_, n);
+    p_ += n;
+    return s;
+  }
+  bool ok() const { return ok_; }
+
+private:
+  const char* p_;
+  const char* end_;
+  bool ok_ = true;
+};
+
+// read-only mmap of a whole file; empty when the file is missing
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        ::madvise(p, st.st_size, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(p);
+        size_ = st.st_size;
+      }
+    }
+    ::close(fd);
+  }
+  ~MappedFile() { if (data_) ::munmap(const_cast<char*>(data_), size_); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+class WriteAheadLog {
+public:
+  // continues the log in dir (created if missing) after its last valid record
+  explicit WriteAheadLog(std::string dir) : dir_(std::move(dir)) {
+    ::mkdir(dir_.c_str(), 0755);
+    auto segs = segments(dir_);
+    uint64_t lsn = 0;
+    if (!segs.empty()) {
+      lsn = scan(segName(dir_, segs.back()), segs.back(), 0,
+                 [](uint8_t, std::string_view) {});
+      if (::truncate(segName(dir_, segs.back()).c_str(), off_t(lsn - segs.back())) != 0)
+        ioFail("truncate");
+    }
+    appended_ = durable_ = segStart_ = lsn;
+    openSegment(lsn);
+    flusher_ = std::thread([this] { run(); });
+  }
+
+  ~WriteAheadLog() {
+    {
+      std::lock_guard lock(mtx_);
+      stop_ = true;
+    }
+    work_.notify_one();
+    flusher_.join();
+    ::close(fd_);
+  }
+
+  WriteAheadLog(const WriteAheadLog&) = delete;
+  WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+  const std::string& dir() const { return dir_; }
+
+  // buffers one record; durable once waitDurable(returned LSN) returns
+  uint64_t append(uint8_t type, std::string_view payload) {
+    uint32_t len = uint32_t(payload.size() + 1);
+    uint32_t crc = crc32(payload.data(), payload.size(), crc32(&type, 1));
+    std::lock_guard lock(mtx_);
+    buf_.append(reinterpret_cast<const char*>(&len), 4);
+    buf_.append(reinterpret_cast<const char*>(&crc), 4);
+    buf_.push_back(char(type));
+    buf_.append(payload.data(), payload.size());
+    appended_ += 8 + len;
+    work_.notify_one();
+    return appended_;
+  }
+
+  void waitDurable(uint64_t lsn) {
+    std::unique_lock lock(mtx_);
+    done_.wait(lock, [&] { return durable_ >= lsn; });
+  }
+
+  uint64_t commit(uint8_t type, std::string_view payload) {
+    uint64_t lsn = append(type, payload);
+    waitDurable(lsn);
+    return lsn;
+  }
+
+  // LSN just past the last appended (not necessarily durable) record
+  uint64_t appended() {
+    std::lock_guard lock(mtx_);
+    return appended_;
+  }
+
+  // waits up to `timeout` for the durable LSN to pass lsn; returns the durable LSN
+  uint64_t waitPast(uint64_t lsn, std::chrono::milliseconds timeout) {
+    std::unique_lock lock(mtx_);
+    done_.wait_for(lock, timeout, [&] { return durable_ > lsn || stop_; });
+    return durable_;
+  }
+
+  // closes the current segment at LSN L and continues in a new one; returns L.
+  // Everything appended before the call is durable when it returns.
+  uint64_t rotate() {
+    std::unique_lock lock(mtx_);
+    done_.wait(lock, [&] { return !cut_; });   // one rotation at a time
+    uint64_t lsn = appended_;
+    if (lsn == segStart_) return lsn;          // nothing since the last rotation
+    cut_ = Cut{buf_.size(), lsn};
+    work_.notify_one();
+    done_.wait(lock, [&] { return segStart_ >= lsn; });
+    return lsn;
+  }
+
+  // deletes segments that end at or before lsn (a rotate() result), but none
+  // that ends past the retain() floor
+  void dropBefore(uint64_t lsn) {
+    lsn = std::min(lsn, retain_.load(std::memory_order_acquire));
+    auto segs = segments(dir_);
+    for (size_t i = 0; i + 1 < segs.size() && segs[i + 1] <= lsn; ++i)
+      ::unlink(segName(dir_, segs[i]).c_str());
+  }
+
+  // keeps every record past lsn on disk until the floor is raised again
+  void retain(uint64_t lsn) { retain_.store(lsn, std::memory_order_release); }
+
+  // for a replica whose log fell behind a snapshot: with no log open on dir,
+  // deletes its segments and leaves an empty one, so the next log continues at lsn
+  static void startAt(const std::string& dir, uint64_t lsn) {
+    ::mkdir(dir.c_str(), 0755);
+    for (uint64_t s : segments(dir)) ::unlink(segName(dir, s).c_str());
+    int fd = ::open(segName(dir, lsn).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ::fsync(fd) != 0) ioFail("open wal segment");
+    ::close(fd);
+  }
+
+  // first LSN of each segment on disk, ascending
+  static std::vector<uint64_t> segmentStarts(const std::string& dir) { return segments(dir); }
+
+  // f(type, payload) for every valid record ending after `from`, in log order;
+  // returns the LSN just past the last valid record
+  template <class F>
+  static uint64_t replay(const std::string& dir, uint64_t from, F&& f) {
+    auto segs = segments(dir);
+    uint64_t end = from;
+    for (size_t i = 0; i < segs.size(); ++i) {
+      if (i + 1 < segs.size() && segs[i + 1] <= from) continue;   // wholly before from
+      end = scan(segName(dir, segs[i]), segs[i], from, f);
+    }
+    return end;
+  }
+
+  // f(type, payload, end LSN) for every valid record between `from` and `upto`;
+  // both must be record boundaries (0, a rotate() result, an LSN this log
+  // returned), so the scan seeks straight to `from`. An f returning bool stops
+  // the read by returning false after a record. Returns the LSN reached, short
+  // of `upto` when stopped or when a segment is missing or torn.
+  template <class F>
+  static uint64_t readFrom(const std::string& dir, uint64_t from, uint64_t upto, F&& f) {
+    auto segs = segments(dir);
+    auto it = std::upper_bound(segs.begin(), segs.end(), from);
+    if (it == segs.begin()) return from;   // not on disk any more
+    uint64_t end = from;
+    for (--it; it != segs.end() && end < upto && *it <= end; ++it)
+      end = scan(segName(dir, *it), *it, end, f, end - *it, upto);
+    return end;
+  }
+
+private:
+  struct Cut {
+    size_t offset;   // position in buf_ where the new segment starts
+    uint64_t lsn;
+  };
+
+  static std::string segName(const std::string& dir, uint64_t start) {
+    char name[32];
+    std::snprintf(name, sizeof name, "/%016llx.wal", (unsigned long long)start);
+    return dir + name;
+  }
+
+  static std::vector<uint64_t> segments(const std::string& dir) {
+    std::vector<uint64_t> res;
+    if (DIR* d = ::opendir(dir.c_str())) {
+      while (dirent* e = ::readdir(d)) {
+        std::string_view n = e->d_name;
+        if (n.size() == 20 && n.substr(16) == ".wal")
+          res.push_back(std::strtoull(std::string(n.substr(0, 16)).c_str(), nullptr, 16));
+      }
+      ::closedir(d);
+    }
+    std::sort(res.begin(), res.end());
+    return res;
+  }
+
+  // from `seek` bytes into the segment (a record boundary); stops once past `stop`
+  template <class F>
+  static uint64_t scan(const std::string& path, uint64_t start, uint64_t from, F&& f,
+                       size_t seek = 0, uint64_t stop = UINT64_MAX) {
+    MappedFile m(path);
+    const char* p = m.data();
+    size_t off = std::min(seek, m.size());
+    while (m.size() - off >= 9 && start + off < stop) {
+      uint32_t len, crc;
+      std::memcpy(&len, p + off, 4);
+      std::memcpy(&crc, p + off + 4, 4);
+      if (len == 0 || m.size() - off - 8 < len) break;      // torn
+      if (crc32(p + off + 8, len) != crc) break;             // corrupt
+      off += 8 + len;
+      if (start + off <= from) continue;
+      if constexpr (std::is_invocable_r_v<bool, F, uint8_t, std::string_view, uint64_t>) {
+        if (!f(uint8_t(p[off - len]), std::string_view(p + off - len + 1, len - 1), start + off))
+          break;
+      } else if constexpr (std::is_invocable_v<F, uint8_t, std::string_view, uint64_t>)
+        f(uint8_t(p[off - len]), std::string_view(p + off - len + 1, len - 1), start + off);
+      else
+        f(uint8_t(p[off - len]), std::string_view(p + off - len + 1, len - 1));
+    }
+    return start + off;
+  }
+
+  void openSegment(uint64_t start) {
+    fd_ = ::open(segName(dir_, start).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) ioFail("open wal segment");
+    // make the new file's directory entry durable too
+    int d = ::open(dir_.c_str(), O_RDONLY);
+    if (d >= 0) { ::fsync(d); ::close(d); }
+  }
+
+  void writeOut(const char* p, size_t n) {
+    while (n > 0) {
+      ssize_t w = ::write(fd_, p, n);
+      if (w < 0) ioFail("write wal");
+      p += w;
+      n -= size_t(w);
+    }
+  }
+
+  void run() {
+    std::string out;
+    std::unique_lock lock(mtx_);
+    for (;;) {
+      work_.wait(lock, [&] { return !buf_.empty() || cut_ || stop_; });
+      if (buf_.empty() && !cut_ && stop_) return;
+      out.swap(buf_);
+      uint64_t upto = appended_;
+      std::optional<Cut> cut = cut_;
+      lock.unlock();
+
+      // one write + one fdatasync for the whole batch
+      size_t head = cut ? cut->offset : out.size();
+      writeOut(out.data(), head);
+      if (::fdatasync(fd_) != 0) ioFail("fdatasync wal");
+      if (cut) {
+        ::close(fd_);
+        openSegment(cut->lsn);
+        writeOut(out.data() + head, out.size() - head);
+        if (::fdatasync(fd_) != 0) ioFail("fdatasync wal");
+      }
+      out.clear();
+
+      lock.lock();
+      durable_ = upto;
+      if (cut) {
+        segStart_ = cut->lsn;
+        cut_.reset();
+      }
+      done_.notify_all();
+    }
+  }
+
+  const std::string dir_;
+  int fd_ = -1;
+  std::mutex mtx_;
+  std::condition_variable work_, done_;
+  std::string buf_;                 // appended, not yet handed to the flusher
+  uint64_t appended_ = 0, durable_ = 0, segStart_ = 0;
+  std::optional<Cut> cut_;
+  std::atomic<uint64_t> retain_{UINT64_MAX};   // dropBefore() keeps everything past this
+  bool stop_ = false;
+  std::thread flusher_;             // last member: starts after everything it touches exists
+};
+
+constexpr uint64_t kSnapshotMagic = 0x31504e534c4c44ull;
+
+// <dir>/snapshot: magic, LSN to replay from, payload size, crc, payload
+inline void writeSnapshot(const std::string& dir, uint64_t lsn, std::string_view payload) {
+  std::string tmp = dir + "/snapshot.tmp", path = dir + "/snapshot";
+  BinWriter w;
+  w.put(kSnapshotMagic);
+  w.put(lsn);
+  w.put(uint64_t(payload.size()));
+  w.put(crc32(payload.data(), payload.size()));
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) ioFail("open snapshot");
+  for (std::string_view part : {std::string_view(w.data()), payload}) {
+    const char* p = part.data();
+    size_t n = part.size();
+    while (n > 0) {
+      ssize_t k = ::write(fd, p, n);
+      if (k < 0) ioFail("write snapshot");
+      p += k;
+      n -= size_t(k);
+    }
+  }
+  if (::fsync(fd) != 0) ioFail("fsync snapshot");
+  ::close(fd);
+  if (::rename(tmp.c_str(), path.c_str()) != 0) ioFail("rename snapshot");
+  int d = ::open(dir.c_str(), O_RDONLY);
+  if (d >= 0) { ::fsync(d); ::close(d); }
+}
+
+// maps <dir>/snapshot and runs f(lsn, payload) on a valid one; false if none
+template <class F>
+bool withSnapshot(const std::string& dir, F&& f) {
+  MappedFile m(dir + "/snapshot");
+  BinReader hdr(m.data(), m.size());
+  if (hdr.get<uint64_t>() != kSnapshotMagic) return false;
+  uint64_t lsn = hdr.get<uint64_t>();
+  uint64_t n = hdr.get<uint64_t>();
+  uint32_t crc = hdr.get<uint32_t>();
+  constexpr size_t kHeader = 28;
+  if (!hdr.ok() || m.size() - kHeader != n || crc32(m.data() + kHeader, n) != crc)
+    return false;
+  f(lsn, std::string_view(m.data() + kHeader, n));
+  return true;
+}
+
+// maps <dir>/snapshot and runs f(reader) over its payload; returns the LSN to
+// replay from, or nullopt when there is no valid snapshot (replay from 0)
+template <class F>
+std::optional<uint64_t> loadSnapshot(const std::string& dir, F&& f) {
+  std::optional<uint64_t> res;
+  withSnapshot(dir, [&](uint64_t lsn, std::string_view payload) {
+    BinReader r(payload.data(), payload.size());
+    f(r);
+    res = lsn;
+  });
+  return res;
+}